@@ -0,0 +1,403 @@
+/* Produces the table in the Benchmarks section of README.md.
+ * Generates three corpora in a work directory, then times creating an archive of each, extracting it and reading
+ * 20 random entries from it with file_bundler, GNU tar, bsdtar (cpio newc format) and Info-ZIP (zip -0 / unzip),
+ * skipping the tools that aren't installed.
+ *
+ * Usage: bench_archivers <work directory> [cold | warm]
+ *   cold (the default): the page cache is dropped before every run.
+ *   warm: the page cache is dropped before every run too, then the run's inputs are read back into it, so both modes
+ *   start from the same file system state and differ only in what is cached.
+ * Dropping the page cache needs root (/proc/sys/vm/drop_caches), the tool stops if it can't.
+ *
+ * Every figure is the best of 3 runs and includes a sync() after the run. CPU time includes child processes,
+ * disk traffic comes from getrusage() block counts. The work directory needs about 4 GiB.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+static constexpr int RUN_COUNT = 3;
+static constexpr int RANDOM_READ_COUNT = 20;
+static constexpr std::uint64_t READ_BUFFER_SIZE = 1 << 20;
+
+struct Usage
+{
+  double wall = 0;
+  double cpu = 0;
+  std::uint64_t bytes_read = 0;
+  std::uint64_t bytes_written = 0;
+};
+
+struct Corpus
+{
+  std::string name;
+  int file_count;
+  bool text;
+  std::function<std::uint64_t(std::mt19937_64&)> get_size;
+};
+
+/* Command lines of an external archiver, {archive}, {list}, {output} and {member} are filled in. */
+struct Archiver
+{
+  std::string name;
+  std::string program;
+  std::string extension;
+  std::string create;
+  std::string extract;
+  std::string read_member;
+};
+
+static bool warm = false;
+
+static double get_seconds(const timeval& p_time)
+{
+  return p_time.tv_sec + p_time.tv_usec / 1e6;
+}
+
+/* CPU time and block counts of this process and its waited for children. */
+static Usage get_usage()
+{
+  rusage self;
+  rusage children;
+  Usage usage;
+
+  ::getrusage(RUSAGE_SELF, &self);
+  ::getrusage(RUSAGE_CHILDREN, &children);
+
+  usage.cpu = get_seconds(self.ru_utime) + get_seconds(self.ru_stime) + get_seconds(children.ru_utime) + get_seconds(children.ru_stime);
+  usage.bytes_read = static_cast<std::uint64_t>(self.ru_inblock + children.ru_inblock) * 512;
+  usage.bytes_written = static_cast<std::uint64_t>(self.ru_oublock + children.ru_oublock) * 512;
+  return usage;
+}
+
+static void run_command(const std::string& p_command)
+{
+  if (std::system(p_command.c_str()) != 0)
+  {
+    std::cerr << "failed: " << p_command << std::endl;
+  }
+}
+
+static bool has_program(const std::string& p_program)
+{
+  return std::system(("command -v " + p_program + " > /dev/null 2>&1").c_str()) == 0;
+}
+
+static void drop_page_cache()
+{
+  ::sync();
+  std::ofstream drop_caches("/proc/sys/vm/drop_caches");
+
+  if (!(drop_caches << "3" << std::endl))
+  {
+    std::cerr << "can't drop the page cache, run as root" << std::endl;
+    std::exit(1);
+  }
+}
+
+/* Reads p_paths (files or directory trees) so they are in the page cache. */
+static void read_into_cache(const std::vector<fs::path>& p_paths)
+{
+  std::vector<char> buffer(READ_BUFFER_SIZE);
+
+  auto read_file = [&](const fs::path& p_path)
+  {
+    std::ifstream file(p_path, std::ios::binary);
+
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {}
+  };
+
+  for (const auto& path : p_paths)
+  {
+    if (fs::is_directory(path))
+    {
+      for (const auto& entry : fs::recursive_directory_iterator(path))
+      {
+        if (entry.is_regular_file())
+        {
+          read_file(entry.path());
+        }
+      }
+    }
+    else if (fs::exists(path))
+    {
+      read_file(path);
+    }
+  }
+}
+
+/* Best of RUN_COUNT runs of p_run, each after p_prepare() and a dropped (and in warm mode refilled) page cache. */
+static Usage measure(const std::vector<fs::path>& p_inputs, const std::function<void()>& p_prepare, const std::function<void()>& p_run)
+{
+  Usage best;
+  best.wall = 1e300;
+
+  for (int i = 0; i < RUN_COUNT; i++)
+  {
+    p_prepare();
+    drop_page_cache();
+
+    if (warm)
+    {
+      read_into_cache(p_inputs);
+    }
+
+    ::sync();
+    Usage before = get_usage();
+    auto begin = std::chrono::steady_clock::now();
+
+    p_run();
+    ::sync();
+
+    Usage after = get_usage();
+    Usage usage;
+    usage.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    usage.cpu = after.cpu - before.cpu;
+    usage.bytes_read = after.bytes_read - before.bytes_read;
+    usage.bytes_written = after.bytes_written - before.bytes_written;
+
+    if (usage.wall < best.wall)
+    {
+      best = usage;
+    }
+  }
+
+  return best;
+}
+
+static void make_corpus(const fs::path& p_directory, const Corpus& p_corpus)
+{
+  static const char* words[] = {"alpha ", "beta ", "gamma ", "delta\n", "render ", "texture ", "mesh ", "0123456789 "};
+  std::mt19937_64 random(42);
+  fs::path directory = p_directory / p_corpus.name;
+
+  fs::remove_all(directory);
+
+  for (int i = 0; i < p_corpus.file_count; i++)
+  {
+    fs::path subdirectory = directory / ("d" + std::to_string(i % 32));
+    std::uint64_t size = p_corpus.get_size(random);
+    std::string data;
+
+    fs::create_directories(subdirectory);
+    data.reserve(size + 16);
+
+    while (data.size() < size)
+    {
+      if (p_corpus.text)
+      {
+        data += words[random() % 8];
+      }
+      else
+      {
+        std::uint64_t value = random();
+        data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+      }
+    }
+
+    data.resize(size);
+    std::ofstream(subdirectory / ("f" + std::to_string(i) + (p_corpus.text ? ".txt" : ".bin")), std::ios::binary) << data;
+  }
+}
+
+/* Files of the corpus relative to the work directory, sorted, which is how every tool is given them. */
+static std::vector<std::string> list_corpus(const fs::path& p_directory, const std::string& p_name)
+{
+  std::vector<std::string> paths;
+
+  for (const auto& entry : fs::recursive_directory_iterator(p_directory / p_name))
+  {
+    if (entry.is_regular_file())
+    {
+      paths.push_back(entry.path().lexically_relative(p_directory).string());
+    }
+  }
+
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+static std::string fill(std::string p_command, const std::string& p_archive, const std::string& p_list, const std::string& p_output, const std::string& p_member)
+{
+  const std::pair<std::string, std::string> fields[] = {{"{archive}", p_archive}, {"{list}", p_list}, {"{output}", p_output}, {"{member}", p_member}};
+
+  for (const auto& field : fields)
+  {
+    for (std::size_t position; (position = p_command.find(field.first)) != std::string::npos;)
+    {
+      p_command.replace(position, field.first.size(), field.second);
+    }
+  }
+
+  return p_command;
+}
+
+static void print_row(const std::string& p_corpus, const std::string& p_operation, const std::string& p_tool, const Usage& p_usage, std::uint64_t p_archive_size = 0)
+{
+  std::cout << "| " << p_corpus << " | " << p_operation << " | " << p_tool << " | "
+            << std::fixed << std::setprecision(3) << p_usage.wall << " | " << p_usage.cpu << " | "
+            << std::setprecision(1) << p_usage.bytes_read / 1048576.0 << " / " << p_usage.bytes_written / 1048576.0 << " | "
+            << (p_archive_size != 0 ? std::to_string(p_archive_size / 1024) + " KiB" : std::string()) << " |" << std::endl;
+}
+
+int main(int p_argc, char** p_argv)
+{
+  if (p_argc < 2 || (p_argc > 2 && std::string(p_argv[2]) != "cold" && std::string(p_argv[2]) != "warm"))
+  {
+    std::cerr << "usage: bench_archivers <work directory> [cold | warm]" << std::endl;
+    return 1;
+  }
+
+  fs::path directory = fs::absolute(p_argv[1]);
+  fs::path output = directory / "out";
+  warm = p_argc > 2 && std::string(p_argv[2]) == "warm";
+
+  const Corpus corpora[] =
+  {
+    /* Text files of 0.5-16 KB. */
+    {"small", 20000, true, [](std::mt19937_64& p_random) { return 512 + p_random() % 16000; }},
+
+    /* Random files, sizes log-uniform between 1 KB and 4 MB. */
+    {"mixed", 2000, false, [](std::mt19937_64& p_random)
+      {
+        double fraction = (p_random() % 10000) / 10000.0;
+        return static_cast<std::uint64_t>(std::exp(std::log(1024.0) + fraction * (std::log(4.0 * (1 << 20)) - std::log(1024.0))));
+      }},
+
+    /* Random files of 64 MiB. */
+    {"large", 8, false, [](std::mt19937_64&) { return std::uint64_t(64) << 20; }}
+  };
+
+  const Archiver archivers[] =
+  {
+    {"tar", "tar", ".tar", "tar -cf {archive} -T {list}", "tar -xf {archive} -C {output}", "tar -xOf {archive} {member} > /dev/null"},
+    {"cpio (newc, bsdtar)", "bsdtar", ".cpio", "bsdtar --format newc -cf {archive} -T {list}", "bsdtar -xf {archive} -C {output}", "bsdtar -xOf {archive} {member} > /dev/null"},
+    {"zip -0", "zip", ".zip", "zip -q -0 {archive} -@ < {list}", "unzip -q {archive} -d {output}", "unzip -p {archive} {member} > /dev/null"}
+  };
+
+  fs::create_directories(directory);
+
+  /* Tools run with paths relative to the work directory, like the paths bundled. */
+  fs::current_path(directory);
+
+  std::cout << "| corpus | operation | tool | wall s | CPU s | read / written MiB | archive |" << std::endl;
+  std::cout << "|---|---|---|---|---|---|---|" << std::endl;
+
+  for (const auto& corpus : corpora)
+  {
+    make_corpus(directory, corpus);
+
+    std::vector<std::string> paths = list_corpus(directory, corpus.name);
+    std::string list_path = (directory / ("list_" + corpus.name)).string();
+    std::string archive_base = (directory / ("archive_" + corpus.name)).string();
+    std::vector<std::string> members;
+    std::mt19937_64 random(7);
+
+    {
+      std::ofstream list(list_path);
+
+      for (const auto& path : paths)
+      {
+        list << path << '\n';
+      }
+    }
+
+    for (int i = 0; i < RANDOM_READ_COUNT; i++)
+    {
+      members.push_back(paths[random() % paths.size()]);
+    }
+
+    auto clear_output = [&]()
+    {
+      fs::remove_all(output);
+      fs::create_directories(output);
+    };
+
+    /* file_bundler: the API, the same calls an application would make. */
+    std::string bundle_path = archive_base + ".bundle";
+    Usage usage;
+
+    usage = measure({directory / corpus.name}, [&]() { fs::remove(bundle_path); }, [&]() { fb::bundle(bundle_path, paths); });
+    print_row(corpus.name, "create", "file_bundler", usage, fs::file_size(bundle_path));
+
+    usage = measure({bundle_path}, clear_output, [&]() { fb::debundle(bundle_path, output.string()); });
+    print_row(corpus.name, "extract", "file_bundler", usage);
+
+    /* Opens the bundle and streams each entry through a reused buffer, like the other tools writing to /dev/null. */
+    usage = measure({bundle_path}, clear_output, [&]()
+    {
+      fb::Reader reader(bundle_path);
+      std::vector<std::uint8_t> buffer(READ_BUFFER_SIZE);
+
+      for (const auto& member : members)
+      {
+        std::int64_t index = reader.find(member);
+        std::uint64_t size = index >= 0 ? reader.get_size(index) : 0;
+
+        for (std::uint64_t offset = 0; offset < size; offset += buffer.size())
+        {
+          if (reader.read(index, offset, buffer.data(), std::min<std::uint64_t>(buffer.size(), size - offset)) != fb::STATUS::OK)
+          {
+            std::cerr << "can't read " << member << std::endl;
+          }
+        }
+      }
+    });
+
+    print_row(corpus.name, std::to_string(RANDOM_READ_COUNT) + " random reads", "file_bundler", usage);
+    fs::remove(bundle_path);
+
+    for (const auto& archiver : archivers)
+    {
+      std::string archive_path = archive_base + archiver.extension;
+
+      if (!has_program(archiver.program))
+      {
+        std::cerr << archiver.program << " not found, skipping " << archiver.name << std::endl;
+        continue;
+      }
+
+      usage = measure({directory / corpus.name}, [&]() { fs::remove(archive_path); }, [&]() { run_command(fill(archiver.create, archive_path, list_path, "", "")); });
+      print_row(corpus.name, "create", archiver.name, usage, fs::file_size(archive_path));
+
+      usage = measure({archive_path}, clear_output, [&]() { run_command(fill(archiver.extract, archive_path, list_path, output.string(), "")); });
+      print_row(corpus.name, "extract", archiver.name, usage);
+
+      usage = measure({archive_path}, clear_output, [&]()
+      {
+        for (const auto& member : members)
+        {
+          run_command(fill(archiver.read_member, archive_path, list_path, "", member));
+        }
+      });
+
+      print_row(corpus.name, std::to_string(RANDOM_READ_COUNT) + " random reads", archiver.name, usage);
+      fs::remove(archive_path);
+    }
+
+    fs::remove_all(output);
+    fs::remove_all(directory / corpus.name);
+    fs::remove(list_path);
+  }
+
+  return 0;
+}
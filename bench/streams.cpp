@@ -0,0 +1,149 @@
+/* Per-call cost of the stream layer: small writes and reads through the templated backends that bundle() and
+ * debundle() are instantiated with, against the same calls dispatched at run time (a virtual call per operation,
+ * the shape the stream layer had before it was templated). Then bundle() and debundle() in memory of many tiny
+ * files, where per-call overhead dominates.
+ * Usage: streams [call count], 20000000 calls by default.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+
+#if defined(_MSC_VER)
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+/* Run time dispatch, kept out of line like a call through a base stream from another translation unit. */
+class Dynamic_Sink
+{
+  public:
+  virtual int write(const std::uint8_t* p_address, std::uint64_t p_size) = 0;
+  virtual ~Dynamic_Sink() {}
+};
+
+class Dynamic_Source
+{
+  public:
+  virtual int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size) = 0;
+  virtual ~Dynamic_Source() {}
+};
+
+class Dynamic_Vector_Stream : public Dynamic_Sink
+{
+  private:
+  fb::_::Vector_Stream& stream;
+
+  public:
+  NOINLINE int write(const std::uint8_t* p_address, std::uint64_t p_size) override
+  {
+    return this->stream.write(p_address, p_size);
+  }
+
+  Dynamic_Vector_Stream(fb::_::Vector_Stream& p_stream) : stream(p_stream) {}
+};
+
+class Dynamic_Memory_Stream : public Dynamic_Source
+{
+  private:
+  fb::_::Memory_Stream& stream;
+
+  public:
+  NOINLINE int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size) override
+  {
+    return this->stream.read_at(p_offset, p_address, p_size);
+  }
+
+  Dynamic_Memory_Stream(fb::_::Memory_Stream& p_stream) : stream(p_stream) {}
+};
+
+/* Nanoseconds per call of p_run(i) over p_count calls. */
+template <typename Run>
+static double time_calls(std::uint64_t p_count, Run p_run)
+{
+  auto begin = std::chrono::steady_clock::now();
+
+  for (std::uint64_t i = 0; i < p_count; i++)
+  {
+    p_run(i);
+  }
+
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / p_count;
+}
+
+template <typename Sink>
+static void write_calls(Sink& p_sink, std::uint64_t p_count)
+{
+  for (std::uint64_t i = 0; i < p_count; i++)
+  {
+    p_sink.write(reinterpret_cast<const std::uint8_t*>(&i), sizeof(i));
+  }
+}
+
+int main(int p_argc, char** p_argv)
+{
+  std::uint64_t count = p_argc > 1 ? std::strtoull(p_argv[1], nullptr, 10) : 20000000;
+  std::vector<std::uint8_t> source(1 << 16, 7);
+  std::uint64_t value = 0;
+  std::uint64_t sum = 0;
+
+  /* Written to a vector that keeps its capacity between runs, so growth isn't measured. */
+  std::vector<std::uint8_t> written;
+  written.reserve(count * sizeof(std::uint64_t));
+
+  auto run_writes = [&](auto& p_sink)
+  {
+    written.clear();
+    auto begin = std::chrono::steady_clock::now();
+    write_calls(p_sink, count);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / count;
+  };
+
+  fb::_::Vector_Stream vector_stream(&written);
+  Dynamic_Vector_Stream dynamic_vector_stream(vector_stream);
+  Dynamic_Sink& dynamic_sink = dynamic_vector_stream;
+
+  /* Once untimed, to fault in the vector's pages. */
+  run_writes(vector_stream);
+
+  double templated_write = run_writes(vector_stream);
+  double dynamic_write = run_writes(dynamic_sink);
+
+  fb::_::Memory_Stream memory_stream(source.data(), source.size());
+  Dynamic_Memory_Stream dynamic_memory_stream(memory_stream);
+  Dynamic_Source& dynamic_source = dynamic_memory_stream;
+
+  double templated_read = time_calls(count, [&](std::uint64_t p_i) { memory_stream.read_at((p_i * 8) & 0xfff0, reinterpret_cast<std::uint8_t*>(&value), sizeof(value)); sum += value; });
+  double dynamic_read = time_calls(count, [&](std::uint64_t p_i) { dynamic_source.read_at((p_i * 8) & 0xfff0, reinterpret_cast<std::uint8_t*>(&value), sizeof(value)); sum += value; });
+
+  std::cout << "8-byte write:   " << templated_write << " ns templated, " << dynamic_write << " ns dispatched at run time" << std::endl;
+  std::cout << "8-byte read_at: " << templated_read << " ns templated, " << dynamic_read << " ns dispatched at run time" << std::endl;
+
+  /* Whole calls on 100000 files of 16 bytes. */
+  std::vector<fb::File> files;
+  std::uint64_t file_count = 100000;
+
+  for (std::uint64_t i = 0; i < file_count; i++)
+  {
+    files.emplace_back("f" + std::to_string(i), std::vector<std::uint8_t>(16, static_cast<std::uint8_t>(i)));
+  }
+
+  fb::File package;
+  int status = fb::STATUS::OK;
+  double bundle_time = time_calls(1, [&](std::uint64_t) { package = fb::bundle(files, &status); }) / file_count;
+  double debundle_time = time_calls(1, [&](std::uint64_t) { sum += fb::debundle(package, &status).size(); }) / file_count;
+
+  std::cout << "bundle() to memory:   " << bundle_time << " ns per 16-byte file" << std::endl;
+  std::cout << "debundle() to memory: " << debundle_time << " ns per 16-byte file" << std::endl;
+
+  /* Keeps the reads from being optimised away. */
+  return sum == 0 && status == fb::STATUS::OK ? 1 : 0;
+}
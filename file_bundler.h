@@ -32,528 +32,7402 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include <fstream>
 #include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <numeric>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+#include <exception>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FILE_BUNDLER_POSIX
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#endif
+
+/* perf_event_open() counters (Options::performance_counters) are opt-in: define FILE_BUNDLER_PERF_COUNTERS before including. */
+#if defined(__linux__) && defined(FILE_BUNDLER_PERF_COUNTERS)
+#include <linux/perf_event.h>
+#endif
+
+#ifdef __APPLE__
+#include <sys/uio.h>
+#endif
 
 namespace fs = std::filesystem;
 
 namespace file_bundler
 {
 
-/* Implementation details. */
-namespace /* file_bundler:: */ _
+/* Status codes reported by stream operations and the de-bundler. */
+namespace STATUS
+{
+  enum
+  {
+    OK,
+    TRUNCATED,    // Source ended before the requested number of bytes could be read.
+    OUT_OF_RANGE, // Seek or write beyond the bounds of a fixed size stream object.
+    IO_ERROR,     // Underlying file stream reported a failure.
+    CORRUPT,      // Bundle metadata is inconsistent.
+    UNSAFE_PATH,  // Bundled path is absolute or escapes the output directory.
+    MISSING_CHUNK, // Bundle refers to chunks that aren't in the chunk store (or none was given), see Options::chunk_store.
+    MISSING_INDEX  // Bundle was written without an index, see Options::index.
+  };
+}
+
+/* Source and sink requirements.
+ * Any type meeting these can be handed to bundle(), debundle() and Basic_Reader, which are
+ * instantiated per type; there are no virtual calls between the bundler and the storage backend.
+ *
+ * A source provides:
+ *   std::uint64_t get_size();
+ *   int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size);
+ *
+ *   read_at() reads exactly p_size bytes at p_offset and returns a STATUS code.
+ *   It must be safe to call from several threads if the source is shared by a multi-threaded reader.
+ *
+ * A sink provides:
+ *   int write(const std::uint8_t* p_address, std::uint64_t p_size);
+ *   std::uint64_t get_total_bytes_written();
+ *
+ *   write() appends p_size bytes and returns a STATUS code.
+ *
+ * A positional sink additionally provides:
+ *   int write_at(std::uint64_t p_offset, const std::uint8_t* p_address, std::uint64_t p_size);
+ *
+ *   write_at() writes p_size bytes at p_offset, counted like get_total_bytes_written(), and leaves the
+ *   sequential write position alone.
+ */
+template <typename Type, typename = void>
+struct is_source : std::false_type {};
+
+template <typename Type>
+struct is_source<Type, std::void_t<decltype(std::declval<Type&>().read_at(std::uint64_t(), static_cast<std::uint8_t*>(nullptr), std::uint64_t())),
+                                   decltype(std::declval<Type&>().get_size())>> : std::true_type {};
+
+template <typename Type, typename = void>
+struct is_sink : std::false_type {};
+
+template <typename Type>
+struct is_sink<Type, std::void_t<decltype(std::declval<Type&>().write(static_cast<const std::uint8_t*>(nullptr), std::uint64_t())),
+                                 decltype(std::declval<Type&>().get_total_bytes_written())>> : std::true_type {};
+
+template <typename Type, typename = void>
+struct is_positional_sink : std::false_type {};
+
+template <typename Type>
+struct is_positional_sink<Type, std::void_t<decltype(std::declval<Type&>().write_at(std::uint64_t(), static_cast<const std::uint8_t*>(nullptr), std::uint64_t()))>>
+  : is_sink<Type> {};
+
+/* Backends for reading a bundle from disk, see Options::backend. */
+namespace BACKEND
 {
+  enum
+  {
+    DESCRIPTOR, // pread() on POSIX, std::fstream elsewhere.
+    MAPPED      // mmap() (POSIX only, falls back to DESCRIPTOR elsewhere).
+  };
+}
 
-namespace STREAM_OBJECT_TYPE
+/* I/O scheduling classes for Options::io_priority (Linux, see ioprio_set(2)). */
+namespace IO_PRIORITY
 {
   enum
   {
-    MEMORY,
-    VECTOR,
-    FILE
+    UNCHANGED,       // Whatever the calling thread has.
+    BEST_EFFORT = 2, // Served by Options::io_priority_level, 0 (first) to 7 (last).
+    IDLE = 3         // Served only when no other I/O is waiting for the disk.
   };
 }
 
-/* Basic stream helper for memory <-> file operations. */
-class Base_Stream
+/* I/O parameters, either set by hand through Options or picked by tune(). */
+struct Tuning
 {
-  protected:
-  int stream_object_type = 0;
-  std::uint64_t current_offset = 0;
+  std::uint64_t chunk_size = 1 << 20;
+  std::uint64_t thread_count = 1;
+  int backend = BACKEND::DESCRIPTOR;
 
-  /* Possible stream objects: */
+  /* Set by tune(): whether the values were measured, and whether they came from the per mount point cache. */
+  bool probed = false;
+  bool cached = false;
+};
 
-  /* 1. File object */
-  std::fstream file;
-  std::string file_path;
+/* Filled in by bundle() and debundle() when Options::stats is set. */
+struct Stats
+{
+  struct Node
+  {
+    std::uint64_t worker_count = 0;
+    std::uint64_t bytes = 0;
 
-  /* 2. Vector */
-  std::vector<std::uint8_t>* vector = nullptr;
+    /* Until the node's last worker finished. */
+    double seconds = 0;
 
-  /* 3. Raw memory buffer */
-  std::uint8_t* memory = nullptr;
-  std::uint64_t memory_size = 0;
+    /* Bytes per second. */
+    double get_throughput()
+    {
+      return this->seconds > 0 ? this->bytes / this->seconds : 0;
+    }
+  };
+
+  /* File contents copied and wall time of the copy phase. Bundling into a chunk store only counts new chunks. */
+  std::uint64_t bytes = 0;
+  double seconds = 0;
+
+  /* Per NUMA node, a single entry unless Options::numa is set on a NUMA machine. */
+  std::vector<Node> nodes;
+
+  /* Parameters the run used, measured ones with Options::auto_tune. */
+  Tuning tuning;
+
+  /* Files taken from the extraction cache instead of the bundle, see Options::cache_directory. */
+  std::uint64_t cache_hits = 0;
+
+  /* Value of counters that couldn't be read. */
+  static constexpr std::uint64_t UNAVAILABLE = UINT64_MAX;
+
+  /* Events over the whole run, all threads included, see Options::performance_counters. */
+  struct Counters
+  {
+    std::uint64_t cycles = UNAVAILABLE;
+    std::uint64_t instructions = UNAVAILABLE;
+    std::uint64_t cache_misses = UNAVAILABLE;
+    std::uint64_t page_faults = UNAVAILABLE;
+    std::uint64_t context_switches = UNAVAILABLE;
+  };
+
+  Counters counters;
+};
+
+/* Report of analyze(). Figures come from a sample of the contents wherever reading everything would be slow. */
+struct Analysis
+{
+  std::uint64_t file_count = 0;
+  std::uint64_t total_size = 0;
+
+  /* Size classes: class 0 holds empty files, class i files of 2^(i-1) to 2^i - 1 bytes. */
+  std::vector<std::uint64_t> size_histogram;
+  std::vector<std::uint64_t> size_histogram_bytes;
 
+  /* Share of bytes in files that likely duplicate an earlier file (same size, same sampled content hash). */
+  double duplicate_ratio = 0;
+
+  struct Extension
+  {
+    std::string extension;
+    std::uint64_t file_count = 0;
+    std::uint64_t total_size = 0;
+    std::uint64_t sampled_bytes = 0;
+
+    /* Order-0 entropy of the sampled bytes in bits per byte, and the size reduction it suggests (0 to 1). */
+    double entropy = 0;
+    double compressibility = 0;
+  };
+
+  /* Largest total size first. */
+  std::vector<Extension> extensions;
+
+  /* Share of path bytes that repeat the previous path's prefix, with paths sorted. */
+  double prefix_sharing = 0;
+
+  /* Header, paths and sizes sections of the current layout, and their share of the whole bundle. */
+  std::uint64_t metadata_size = 0;
+  double metadata_overhead = 0;
+
+  /* Recommendations. */
+  std::uint64_t alignment = 1;        // Offset files should start at a multiple of, 1 for none.
+  std::uint64_t solid_block_size = 0; // Compress small files together in blocks of this size, 0 to compress each file alone.
+  std::string codec = "none";         // "none", "lz4" (fast) or "zstd" (strong).
+  bool deduplicate = false;           // Whether Options::chunk_store / Options::cache_directory would pay off.
+  std::vector<std::string> notes;     // Reasons behind the above, one sentence each.
+};
+
+/* Records what bundle() and debundle() spend their time on, per thread, see Options::tracer.
+ * Spans cover parsing metadata, each file (or part of a file) read and written, directory creation and the time
+ * workers spend taking tasks off the queues, so stalls in parallel runs show up as gaps or long waits.
+ * The result is written as Chrome trace event JSON, for chrome://tracing or https://ui.perfetto.dev.
+ * Safe to share between concurrent runs; spans accumulate until clear().
+ */
+class Tracer
+{
   public:
-  /* Returns empty string if not file stream object */
-  std::string get_file_path()
+  struct Span
   {
-    return this->file_path;
+    std::string name;
+    std::string detail;          // Usually the bundled path the span worked on, may be empty.
+    std::uint64_t thread = 0;    // Numbered in order of first appearance, from 0.
+    double begin = 0;            // Microseconds since the tracer was created.
+    double end = 0;
+  };
+
+  private:
+  std::mutex mutex;
+  std::vector<Span> spans;
+  std::unordered_map<std::thread::id, std::uint64_t> threads;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  static void escape(const std::string& p_text, std::string& p_json)
+  {
+    for (unsigned char character : p_text)
+    {
+      if (character == '"' || character == '\\')
+      {
+        p_json += '\\';
+        p_json += static_cast<char>(character);
+      }
+      else if (character < 0x20)
+      {
+        char code[8];
+        std::snprintf(code, sizeof(code), "\\u%04x", character);
+        p_json += code;
+      }
+      else
+      {
+        p_json += static_cast<char>(character);
+      }
+    }
+  }
+
+  public:
+  /* Microseconds since the tracer was created. */
+  double now()
+  {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - this->start).count();
+  }
+
+  /* Adds a span of the calling thread. */
+  void record(const char* p_name, const std::string& p_detail, double p_begin, double p_end)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto thread = this->threads.emplace(std::this_thread::get_id(), this->threads.size()).first->second;
+
+    this->spans.push_back({p_name, p_detail, thread, p_begin, p_end});
+  }
+
+  /* Spans recorded so far, in the order they ended. Not to be called while a traced run is in progress. */
+  const std::vector<Span>& get_spans()
+  {
+    return this->spans;
+  }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->spans.clear();
+  }
+
+  /* Spans as Chrome trace event JSON, one complete ("X") event each. */
+  std::string to_chrome_trace()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::string json = "{\"traceEvents\":[";
+    char numbers[96];
+
+    for (std::size_t i = 0; i < this->spans.size(); i++)
+    {
+      const auto& span = this->spans[i];
+
+      json += i == 0 ? "\n{\"name\":\"" : ",\n{\"name\":\"";
+      escape(span.name, json);
+      std::snprintf(numbers, sizeof(numbers), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f",
+                    static_cast<unsigned long long>(span.thread), span.begin, span.end - span.begin);
+      json += numbers;
+
+      if (!span.detail.empty())
+      {
+        json += ",\"args\":{\"path\":\"";
+        escape(span.detail, json);
+        json += "\"}";
+      }
+
+      json += '}';
+    }
+
+    json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return json;
+  }
+
+  /* Writes to_chrome_trace() to p_path. */
+  bool write_chrome_trace(const std::string& p_path)
+  {
+    std::ofstream output(p_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    output << to_chrome_trace();
+    return static_cast<bool>(output.flush());
   }
+};
+
+/* Tuning knobs for bundle() and debundle(). */
+struct Options
+{
+  /* Threads bundling or extracting files, the calling thread included. 0 uses one per hardware thread.
+   * Parallel bundling needs a sink with write_at(), see is_positional_sink.
+   */
+  std::uint64_t thread_count = 1;
+
+  /* Spread threads over NUMA nodes, pin them there and give each node a contiguous part of the payload. */
+  bool numa = false;
+
+  /* Largest read or write of a single copy, 0 uses 1 MiB. */
+  std::uint64_t chunk_size = 0;
+
+  /* How debundle() reads a bundle given by path, see BACKEND. */
+  int backend = BACKEND::DESCRIPTOR;
+
+  /* Pick chunk_size, thread_count and backend by probing the disk that is read from, see tune().
+   * Applies to bundling from paths and debundling from a path; overrides the three fields above.
+   */
+  bool auto_tune = false;
+
+  /* Optional, receives throughput figures. */
+  Stats* stats = nullptr;
+
+  /* Optional, receives a span per step of the run, see Tracer. */
+  Tracer* tracer = nullptr;
+
+  /* Fill Stats::counters with CPU cycles, instructions, cache misses, page faults and context switches of the run
+   * (Linux, perf_event_open()). Counters the system doesn't provide are left at Stats::UNAVAILABLE, and so are all
+   * of them unless a translation unit of the program defines FILE_BUNDLER_PERF_COUNTERS before including.
+   */
+  bool performance_counters = false;
+
+  /* Extraction cache directory, empty to extract without one. Only used when debundling to disk.
+   * Objects in the cache are named by the SHA-256 of their content and stored read-only. Files are materialised
+   * from the cache as reflinks where the file system supports them and as copies otherwise, see cache_hard_links.
+   * The cache is safe to share between concurrent processes and can be deleted at any time.
+   */
+  std::string cache_directory;
+
+  /* Materialise files from cache_directory as hard links where reflinks aren't supported, instead of copies.
+   * Hard linked files are the cache's objects themselves, read-only; changing one (after a chmod) changes it for
+   * every later extraction, so replace extracted files rather than modify them.
+   */
+  bool cache_hard_links = false;
+
+  /* Chunk store directory, empty to bundle file contents as usual.
+   * When set, bundle() splits file contents into content-defined chunks, stores each distinct chunk once in this
+   * directory and writes only references to them into the bundle, so bundles sharing most of their content share
+   * most of their storage, and writing a new version costs about as much as its new content.
+   * Such bundles need the same store to be read (debundle(), Basic_Reader::set_chunk_store()); see collect_garbage().
+   */
+  std::string chunk_store;
+
+  /* Append a lookup index that Basic_Indexed_Reader uses in place, see INDEX in file_bundler::_.
+   * Bundles with an index can't be read by versions that predate it. Ignored with chunk_store.
+   */
+  bool index = false;
+
+  /* Upper bounds on the file contents moved per second, and on the chunks copied per second (a chunk read and
+   * written counts once), over all threads of the run; 0 for no bound. Bundling runs as fast as the budget allows,
+   * pacing itself chunk by chunk, so a background run keeps a predictable share of the disk.
+   */
+  std::uint64_t bytes_per_second = 0;
+  std::uint64_t operations_per_second = 0;
+
+  /* I/O scheduling class and level of the run (Linux), see IO_PRIORITY. */
+  int io_priority = IO_PRIORITY::UNCHANGED;
+  int io_priority_level = 4;
 
+  /* Added to the nice value of the run (Linux), 0 leaves it as is. Lowering it needs privileges.
+   * With either of these set, the run happens on a thread of its own (worker threads inherit its priorities),
+   * so the calling thread's priorities are left untouched. Both are best effort; refusals are ignored.
+   */
+  int nice = 0;
+};
+
+/* Implementation details. */
+namespace /* file_bundler:: */ _
+{
+
+/* Size of the intermediate buffer used when copying file contents between streams. */
+constexpr std::uint64_t COPY_CHUNK_SIZE = 1 << 20;
+
+/* Stream backends.
+ * Everything that moves bytes is a template over its source and sink types (see is_source and is_sink),
+ * so every combination is compiled on its own and the copy path inlines down to memcpy or a syscall.
+ */
+
+/* Fixed size memory block.
+ * As a source it can be read from any number of threads at once.
+ * As a sink it is filled front to back and never grows.
+ */
+class Memory_Stream
+{
+  private:
+  std::uint8_t* memory = nullptr;
+  std::uint64_t memory_size = 0;
+  std::uint64_t total_bytes_written = 0;
+
+  public:
   void open(std::uint8_t* p_address, std::uint64_t p_size)
   {
     this->memory = p_address;
     this->memory_size = p_size;
-    this->stream_object_type = STREAM_OBJECT_TYPE::MEMORY;
+    this->total_bytes_written = 0;
+  }
+
+  std::uint64_t get_size()
+  {
+    return this->memory_size;
+  }
+
+  std::uint8_t* get_data()
+  {
+    return this->memory;
+  }
+
+  std::uint64_t get_total_bytes_written()
+  {
+    return this->total_bytes_written;
+  }
+
+  /* Reads exactly p_size bytes or nothing at all.
+   * Returns STATUS::TRUNCATED if the block does not hold p_size bytes at p_offset.
+   */
+  int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    /* Written this way so that a huge p_offset or p_size can't wrap around. */
+    if (p_offset > this->memory_size || p_size > this->memory_size - p_offset)
+    {
+      return STATUS::TRUNCATED;
+    }
+
+    if (p_size != 0)
+    {
+      std::memcpy(p_address, this->memory + p_offset, p_size);
+    }
+
+    return STATUS::OK;
+  }
+
+  int write(const std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_size > this->memory_size - this->total_bytes_written)
+    {
+      return STATUS::OUT_OF_RANGE;
+    }
+
+    if (p_size != 0)
+    {
+      std::memcpy(this->memory + this->total_bytes_written, p_address, p_size);
+    }
+
+    this->total_bytes_written += p_size;
+    return STATUS::OK;
+  }
+
+  /* Leaves the sequential write position untouched. */
+  int write_at(std::uint64_t p_offset, const std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_offset > this->memory_size || p_size > this->memory_size - p_offset)
+    {
+      return STATUS::OUT_OF_RANGE;
+    }
+
+    if (p_size != 0)
+    {
+      std::memcpy(this->memory + p_offset, p_address, p_size);
+    }
+
+    return STATUS::OK;
+  }
+
+  Memory_Stream(std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    open(p_address, p_size);
   }
 
-  void open(std::vector<std::uint8_t>* p_vector, std::uint64_t p_size)
+  Memory_Stream() {}
+};
+
+/* Appends to a std::vector, growing it as needed. */
+class Vector_Stream
+{
+  private:
+  std::vector<std::uint8_t>* vector = nullptr;
+  std::uint64_t total_bytes_written = 0;
+
+  public:
+  void open(std::vector<std::uint8_t>* p_vector)
   {
     this->vector = p_vector;
-    this->vector->reserve(p_size + sizeof(std::uint8_t)); // Initialize internal pointer even if p_size is zero.
-    this->vector->resize(p_size);
+    this->total_bytes_written = 0;
+  }
+
+  std::uint64_t get_total_bytes_written()
+  {
+    return this->total_bytes_written;
+  }
+
+  int write(const std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    this->vector->insert(this->vector->end(), p_address, p_address + p_size);
+    this->total_bytes_written += p_size;
+    return STATUS::OK;
+  }
 
-    this->memory = this->vector->data();
-    this->memory_size = this->vector->size();
-    this->stream_object_type = STREAM_OBJECT_TYPE::VECTOR;
+  Vector_Stream(std::vector<std::uint8_t>* p_vector)
+  {
+    open(p_vector);
   }
 
+  Vector_Stream() {}
+};
+
+/* File on disk accessed through std::fstream.
+ * Positional reads still have to seek the shared stream object, so they are serialised internally.
+ */
+class File_Stream
+{
+  private:
+  std::fstream file;
+  std::string file_path;
+  std::mutex file_mutex;
+  std::uint64_t total_bytes_written = 0;
+
+  public:
   void open(const std::string& p_file_path, std::ios_base::openmode p_openmode)
   {
     this->file.open(p_file_path, p_openmode);
     this->file_path = p_file_path;
-    this->stream_object_type = STREAM_OBJECT_TYPE::FILE;
+    this->total_bytes_written = 0;
   }
 
-  Base_Stream(std::uint8_t* p_address, std::uint64_t p_size)
+  bool is_open()
   {
-    open(p_address, p_size);
+    return this->file.is_open();
+  }
+
+  std::string get_file_path()
+  {
+    return this->file_path;
+  }
+
+  std::uint64_t get_total_bytes_written()
+  {
+    return this->total_bytes_written;
+  }
+
+  std::uint64_t get_size()
+  {
+    std::lock_guard<std::mutex> lock(this->file_mutex);
+
+    if (!this->file.is_open())
+    {
+      return 0;
+    }
+
+    this->file.clear();
+    this->file.seekg(0, std::ios::end);
+    auto size = this->file.tellg();
+
+    return size < 0 ? 0 : static_cast<std::uint64_t>(size);
   }
 
-  Base_Stream(std::vector<std::uint8_t>* p_vector, std::uint64_t p_size)
+  int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_size == 0)
+    {
+      return STATUS::OK;
+    }
+
+    std::lock_guard<std::mutex> lock(this->file_mutex);
+
+    if (!this->file.is_open())
+    {
+      return STATUS::IO_ERROR;
+    }
+
+    this->file.clear();
+
+    if (!this->file.seekg(p_offset))
+    {
+      return STATUS::IO_ERROR;
+    }
+
+    this->file.read(reinterpret_cast<char*>(p_address), p_size);
+
+    if (static_cast<std::uint64_t>(this->file.gcount()) != p_size)
+    {
+      return this->file.eof() ? STATUS::TRUNCATED : STATUS::IO_ERROR;
+    }
+
+    return STATUS::OK;
+  }
+
+  int write(const std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_size == 0)
+    {
+      return STATUS::OK;
+    }
+
+    if (!this->file.write(reinterpret_cast<const char*>(p_address), p_size))
+    {
+      return STATUS::IO_ERROR;
+    }
+
+    this->total_bytes_written += p_size;
+    return STATUS::OK;
+  }
+
+  int flush()
+  {
+    return this->file.flush() ? STATUS::OK : STATUS::IO_ERROR;
+  }
+
+  File_Stream(const std::string& p_file_path, std::ios_base::openmode p_openmode = std::ios::in | std::ios::binary)
+  {
+    open(p_file_path, p_openmode);
+  }
+
+  File_Stream() {}
+};
+
+#ifdef FILE_BUNDLER_POSIX
+/* Offsets past 2 GiB need a 64-bit off_t, build with -D_FILE_OFFSET_BITS=64 on 32-bit targets. */
+static_assert(sizeof(off_t) >= sizeof(std::uint64_t), "file_bundler requires a 64-bit off_t");
+
+/* Largest transfer handed to a single read/write syscall, keeps sizes within ssize_t on every target. */
+constexpr std::uint64_t MAX_IO_SIZE = 1 << 30;
+
+/* Raw file descriptor, closed along with the stream.
+ * Reads and positional writes go through pread()/pwrite() and can be issued from any number of threads at once.
+ * Sequential writes are passed straight to write() unless a buffer is set with set_buffer_size().
+ * Positional writes count from where sequential writing started, the end of the file in std::ios::app mode,
+ * so they line up with get_total_bytes_written().
+ */
+class Descriptor_Stream
+{
+  private:
+  int descriptor = -1;
+  std::uint64_t total_bytes_written = 0;
+
+  /* File offset sequential writing started at, see write_at(). */
+  std::uint64_t write_start = 0;
+
+  /* Write buffer, only allocated once something is buffered. */
+  std::vector<std::uint8_t> buffer;
+  std::uint64_t buffer_size = 0;
+  std::uint64_t buffered = 0;
+
+  /* Loops over short writes and EINTR. */
+  int write_all(const std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    std::uint64_t written = 0;
+
+    while (written < p_size)
+    {
+      auto result = ::write(this->descriptor, p_address + written, std::min(p_size - written, MAX_IO_SIZE));
+
+      if (result < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (result <= 0)
+      {
+        return STATUS::IO_ERROR;
+      }
+
+      written += result;
+    }
+
+    return STATUS::OK;
+  }
+
+  public:
+  /* Takes ownership of p_descriptor. */
+  void open(int p_descriptor)
+  {
+    close();
+    this->descriptor = p_descriptor;
+    this->total_bytes_written = 0;
+    this->write_start = 0;
+  }
+
+  /* Same open modes as std::fstream, so the two can be swapped for one another. */
+  void open(const std::string& p_file_path, std::ios_base::openmode p_openmode)
+  {
+    int flags = O_CLOEXEC;
+
+    if ( (p_openmode & std::ios::in) && (p_openmode & std::ios::out) )
+    {
+      flags |= O_RDWR;
+    }
+    else if (p_openmode & std::ios::out)
+    {
+      /* No O_APPEND for std::ios::app: Linux pwrite() ignores the offset on such descriptors and appends,
+       * which would scatter the ranges of a parallel bundle. Seeking to the end once below appends just the same.
+       */
+      flags |= O_WRONLY | O_CREAT;
+      flags |= (p_openmode & std::ios::app) ? 0 : O_TRUNC;
+    }
+    else
+    {
+      flags |= O_RDONLY;
+    }
+
+    open(::open(p_file_path.c_str(), flags, 0666));
+
+    if (this->descriptor >= 0 && (p_openmode & std::ios::out) && (p_openmode & std::ios::app))
+    {
+      auto end = ::lseek(this->descriptor, 0, SEEK_END);
+
+      if (end < 0)
+      {
+        close();
+        return;
+      }
+
+      this->write_start = end;
+    }
+  }
+
+  bool is_open()
+  {
+    return this->descriptor >= 0;
+  }
+
+  int get_descriptor()
+  {
+    return this->descriptor;
+  }
+
+  /* Buffer sequential writes smaller than p_buffer_size, 0 disables buffering. */
+  void set_buffer_size(std::uint64_t p_buffer_size)
+  {
+    this->buffer_size = p_buffer_size;
+  }
+
+  /* Writes out anything still buffered. */
+  int flush()
+  {
+    int status = STATUS::OK;
+
+    if (this->buffered != 0)
+    {
+      status = write_all(this->buffer.data(), this->buffered);
+      this->buffered = 0;
+    }
+
+    return status;
+  }
+
+  /* Flushes and closes, returns the status of the flush. */
+  int close()
+  {
+    int status = STATUS::OK;
+
+    if (this->descriptor >= 0)
+    {
+      status = flush();
+      ::close(this->descriptor);
+      this->descriptor = -1;
+    }
+
+    return status;
+  }
+
+  std::uint64_t get_total_bytes_written()
+  {
+    return this->total_bytes_written;
+  }
+
+  std::uint64_t get_size()
+  {
+    struct stat file_status;
+
+    if (this->descriptor < 0 || ::fstat(this->descriptor, &file_status) != 0)
+    {
+      return 0;
+    }
+
+    return file_status.st_size + this->buffered;
+  }
+
+  int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    std::uint64_t done = 0;
+
+    while (done < p_size)
+    {
+      auto result = ::pread(this->descriptor, p_address + done, std::min(p_size - done, MAX_IO_SIZE), p_offset + done);
+
+      if (result < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (result < 0)
+      {
+        return STATUS::IO_ERROR;
+      }
+
+      if (result == 0)
+      {
+        return STATUS::TRUNCATED;
+      }
+
+      done += result;
+    }
+
+    return STATUS::OK;
+  }
+
+  int write(const std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    int status = STATUS::OK;
+
+    if (p_size < this->buffer_size)
+    {
+      if (p_size > this->buffer_size - this->buffered && (status = flush()) != STATUS::OK)
+      {
+        return status;
+      }
+
+      if (this->buffer.size() < this->buffer_size)
+      {
+        this->buffer.resize(this->buffer_size);
+      }
+
+      if (p_size != 0)
+      {
+        std::memcpy(this->buffer.data() + this->buffered, p_address, p_size);
+      }
+
+      this->buffered += p_size;
+    }
+    else if ( (status = flush()) != STATUS::OK || (status = write_all(p_address, p_size)) != STATUS::OK )
+    {
+      return status;
+    }
+
+    this->total_bytes_written += p_size;
+    return STATUS::OK;
+  }
+
+  /* Leaves the sequential write position untouched. */
+  int write_at(std::uint64_t p_offset, const std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    std::uint64_t done = 0;
+
+    while (done < p_size)
+    {
+      auto result = ::pwrite(this->descriptor, p_address + done, std::min(p_size - done, MAX_IO_SIZE), this->write_start + p_offset + done);
+
+      if (result < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (result <= 0)
+      {
+        return STATUS::IO_ERROR;
+      }
+
+      done += result;
+    }
+
+    return STATUS::OK;
+  }
+
+  Descriptor_Stream(int p_descriptor)
+  {
+    open(p_descriptor);
+  }
+
+  Descriptor_Stream(const std::string& p_file_path, std::ios_base::openmode p_openmode = std::ios::in | std::ios::binary)
+  {
+    open(p_file_path, p_openmode);
+  }
+
+  Descriptor_Stream() {}
+
+  Descriptor_Stream(const Descriptor_Stream&) = delete;
+  Descriptor_Stream& operator=(const Descriptor_Stream&) = delete;
+
+  ~Descriptor_Stream()
+  {
+    close();
+  }
+};
+
+/* Read-only mapping of a whole file.
+ * Reads are plain memcpy calls and can be issued from any number of threads at once.
+ */
+class Mapped_Stream
+{
+  private:
+  std::uint8_t* memory = nullptr;
+  std::uint64_t memory_size = 0;
+
+  public:
+  void open(const std::string& p_file_path)
+  {
+    close();
+
+    int descriptor = ::open(p_file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat file_status;
+
+    if (descriptor < 0)
+    {
+      return;
+    }
+
+    /* Files larger than the address space (32-bit targets) can't be mapped whole. */
+    if (::fstat(descriptor, &file_status) == 0 && file_status.st_size > 0 && static_cast<std::uint64_t>(file_status.st_size) <= SIZE_MAX)
+    {
+      void* mapping = ::mmap(nullptr, file_status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+      if (mapping != MAP_FAILED)
+      {
+        this->memory = static_cast<std::uint8_t*>(mapping);
+        this->memory_size = file_status.st_size;
+      }
+    }
+
+    /* The mapping stays valid without the descriptor. */
+    ::close(descriptor);
+  }
+
+  void close()
+  {
+    if (this->memory != nullptr)
+    {
+      ::munmap(this->memory, this->memory_size);
+      this->memory = nullptr;
+      this->memory_size = 0;
+    }
+  }
+
+  /* Start of the mapping, nullptr if the file couldn't be mapped. */
+  std::uint8_t* get_data()
+  {
+    return this->memory;
+  }
+
+  std::uint64_t get_size()
+  {
+    return this->memory_size;
+  }
+
+  int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_offset > this->memory_size || p_size > this->memory_size - p_offset)
+    {
+      return STATUS::TRUNCATED;
+    }
+
+    if (p_size != 0)
+    {
+      std::memcpy(p_address, this->memory + p_offset, p_size);
+    }
+
+    return STATUS::OK;
+  }
+
+  Mapped_Stream(const std::string& p_file_path)
+  {
+    open(p_file_path);
+  }
+
+  Mapped_Stream() {}
+
+  Mapped_Stream(const Mapped_Stream&) = delete;
+  Mapped_Stream& operator=(const Mapped_Stream&) = delete;
+
+  ~Mapped_Stream()
+  {
+    close();
+  }
+};
+#endif
+
+/* Backend for files on disk: raw descriptors where available, std::fstream otherwise. */
+#ifdef FILE_BUNDLER_POSIX
+using Disk_Stream = Descriptor_Stream;
+#else
+using Disk_Stream = File_Stream;
+#endif
+
+/* Block size, cache size and fetch concurrency of Remote_Stream, see its setters. */
+constexpr std::uint64_t REMOTE_BLOCK_SIZE = 256 << 10;
+constexpr std::uint64_t REMOTE_CACHE_SIZE = 64 << 20;
+constexpr std::uint64_t REMOTE_MAX_REQUEST_SIZE = 8 << 20;
+constexpr std::uint64_t REMOTE_PARALLEL_FETCHES = 4;
+
+/* Source for bundles that are expensive to reach, e.g. over HTTP, read through range requests of a transport.
+ * A transport is any source (get_size() and read_at(), safe to call from several threads); each read_at() is one request.
+ * Reads are served from a cache of fixed size blocks, least recently used first out. Missing blocks next to each other
+ * are fetched in one request, up to REMOTE_PARALLEL_FETCHES requests run at once, and a block that another thread is
+ * already fetching is waited for rather than fetched twice. Reading an entry only fetches the metadata and that entry.
+ */
+template <typename Transport>
+class Remote_Stream
+{
+  private:
+  struct Block
+  {
+    std::vector<std::uint8_t> data;
+    std::uint64_t last_use = 0;
+    bool ready = false;
+    int status = STATUS::OK;
+  };
+
+  Transport transport;
+  std::uint64_t size = 0;
+  std::uint64_t block_size = REMOTE_BLOCK_SIZE;
+  std::uint64_t cache_size = REMOTE_CACHE_SIZE;
+  std::uint64_t parallel_fetches = REMOTE_PARALLEL_FETCHES;
+
+  std::mutex mutex;
+  std::condition_variable fetched;
+  std::unordered_map<std::uint64_t, std::shared_ptr<Block>> blocks;
+  std::uint64_t clock = 0;
+  std::atomic<std::uint64_t> request_count{0};
+  std::atomic<std::uint64_t> fetched_bytes{0};
+
+  /* Fetches blocks [p_first, p_first + p_count) in one request and hands them to the waiting readers. */
+  void fetch(std::uint64_t p_first, std::uint64_t p_count, const std::vector<std::shared_ptr<Block>>& p_blocks)
+  {
+    std::uint64_t offset = p_first * this->block_size;
+    std::uint64_t size = std::min(p_count * this->block_size, this->size - offset);
+    std::vector<std::uint8_t> buffer(size);
+
+    int status = this->transport.read_at(offset, buffer.data(), size);
+    this->request_count++;
+    this->fetched_bytes += size;
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    for (std::uint64_t i = 0; i < p_count; i++)
+    {
+      auto& block = *p_blocks[i];
+      auto begin = i * this->block_size;
+
+      if ( (block.status = status) == STATUS::OK )
+      {
+        block.data.assign(buffer.begin() + begin, buffer.begin() + std::min(begin + this->block_size, size));
+      }
+      else
+      {
+        /* Failed blocks aren't cached, the next read asks again. */
+        this->blocks.erase(p_first + i);
+      }
+
+      block.ready = true;
+    }
+
+    this->fetched.notify_all();
+  }
+
+  /* Drops least recently used blocks until the cache fits, keeping the ones in p_keep. Called with the mutex held. */
+  void evict(std::uint64_t p_keep_first, std::uint64_t p_keep_last)
+  {
+    while (this->blocks.size() * this->block_size > this->cache_size)
+    {
+      auto oldest = this->blocks.end();
+
+      for (auto block = this->blocks.begin(); block != this->blocks.end(); block++)
+      {
+        bool kept = block->first >= p_keep_first && block->first <= p_keep_last;
+
+        if (block->second->ready && !kept && (oldest == this->blocks.end() || block->second->last_use < oldest->second->last_use))
+        {
+          oldest = block;
+        }
+      }
+
+      if (oldest == this->blocks.end())
+      {
+        return;
+      }
+
+      this->blocks.erase(oldest);
+    }
+  }
+
+  /* Reads part of a range whose blocks all fit in the cache at once, see read_at(). */
+  int read_window(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    std::uint64_t first = p_offset / this->block_size;
+    std::uint64_t last = (p_offset + p_size - 1) / this->block_size;
+    std::vector<std::shared_ptr<Block>> needed;
+
+    /* Runs of blocks this thread fetches: first block and its blocks. */
+    std::vector<std::pair<std::uint64_t, std::vector<std::shared_ptr<Block>>>> runs;
+    std::uint64_t run_limit = std::max<std::uint64_t>(1, REMOTE_MAX_REQUEST_SIZE / this->block_size);
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+
+      for (std::uint64_t index = first; index <= last; index++)
+      {
+        auto& block = this->blocks[index];
+
+        if (block == nullptr)
+        {
+          block = std::make_shared<Block>();
+
+          if (runs.empty() || runs.back().first + runs.back().second.size() != index || runs.back().second.size() == run_limit)
+          {
+            runs.emplace_back(index, std::vector<std::shared_ptr<Block>>());
+          }
+
+          runs.back().second.push_back(block);
+        }
+
+        block->last_use = ++this->clock;
+        needed.push_back(block);
+      }
+
+      evict(first, last);
+    }
+
+    /* Runs past the first are fetched by helper threads, at most parallel_fetches requests at a time. */
+    for (std::uint64_t batch = 0; batch < runs.size(); batch += this->parallel_fetches)
+    {
+      std::vector<std::thread> threads;
+      auto batch_end = std::min<std::uint64_t>(runs.size(), batch + this->parallel_fetches);
+
+      for (auto run = batch + 1; run < batch_end; run++)
+      {
+        threads.emplace_back([&, run] { fetch(runs[run].first, runs[run].second.size(), runs[run].second); });
+      }
+
+      fetch(runs[batch].first, runs[batch].second.size(), runs[batch].second);
+
+      for (auto& thread : threads)
+      {
+        thread.join();
+      }
+    }
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+
+    for (std::uint64_t index = first; index <= last; index++)
+    {
+      auto& block = *needed[index - first];
+      this->fetched.wait(lock, [&] { return block.ready; });
+
+      if (block.status != STATUS::OK)
+      {
+        return block.status;
+      }
+
+      /* Part of this block within the requested range. */
+      std::uint64_t block_offset = index * this->block_size;
+      std::uint64_t begin = std::max(p_offset, block_offset);
+      std::uint64_t end = std::min(p_offset + p_size, block_offset + block.data.size());
+
+      if (end < begin || end - block_offset > block.data.size())
+      {
+        return STATUS::TRUNCATED;
+      }
+
+      std::memcpy(p_address + (begin - p_offset), block.data.data() + (begin - block_offset), end - begin);
+    }
+
+    return STATUS::OK;
+  }
+
+  public:
+  std::uint64_t get_size()
+  {
+    return this->size;
+  }
+
+  /* Large reads go through the cache a window at a time, so they never hold more than the cache size. */
+  int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_offset > this->size || p_size > this->size - p_offset)
+    {
+      return STATUS::TRUNCATED;
+    }
+
+    std::uint64_t window = std::max(this->block_size, this->cache_size / 2 / this->block_size * this->block_size);
+
+    while (p_size != 0)
+    {
+      /* Windows end on block boundaries so neighbouring windows don't share blocks. */
+      auto size = std::min(p_size, window - p_offset % this->block_size);
+      int status = read_window(p_offset, p_address, size);
+
+      if (status != STATUS::OK)
+      {
+        return status;
+      }
+
+      p_offset += size;
+      p_address += size;
+      p_size -= size;
+    }
+
+    return STATUS::OK;
+  }
+
+  /* Bytes per block (rounded up to a power of two) and bytes of blocks to keep. Drops the cache. */
+  void set_cache_size(std::uint64_t p_block_size, std::uint64_t p_cache_size)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->block_size = 1;
+
+    while (this->block_size < p_block_size)
+    {
+      this->block_size *= 2;
+    }
+
+    this->cache_size = std::max(p_cache_size, this->block_size);
+    this->blocks.clear();
+  }
+
+  /* Most requests in flight at once, 1 to fetch one run of blocks after another. */
+  void set_parallel_fetches(std::uint64_t p_parallel_fetches)
+  {
+    this->parallel_fetches = std::max<std::uint64_t>(1, p_parallel_fetches);
+  }
+
+  /* Requests made and bytes fetched so far. */
+  std::uint64_t get_request_count()
+  {
+    return this->request_count;
+  }
+
+  std::uint64_t get_fetched_bytes()
+  {
+    return this->fetched_bytes;
+  }
+
+  Transport& get_transport()
+  {
+    return this->transport;
+  }
+
+  /* Arguments are passed on to the transport's constructor. */
+  template <typename... Arguments>
+  Remote_Stream(Arguments&&... p_arguments) : transport(std::forward<Arguments>(p_arguments)...)
+  {
+    this->size = this->transport.get_size();
+  }
+
+  Remote_Stream(const Remote_Stream&) = delete;
+  Remote_Stream& operator=(const Remote_Stream&) = delete;
+};
+
+#ifdef FILE_BUNDLER_POSIX
+/* Transport for Remote_Stream: HTTP/1.1 range requests to a plain http:// server, one connection per request.
+ * No TLS, redirects or proxies; put a local proxy in front for those.
+ */
+class Http_Transport
+{
+  private:
+  std::string host;
+  std::string port;
+  std::string path;
+  std::uint64_t size = 0;
+  bool opened = false;
+
+  /* Requests bytes [p_offset, p_offset + p_size) and reads the response headers into p_headers
+   * and whatever part of the body came along with them into p_body. Returns the connected socket or -1.
+   */
+  int request(std::uint64_t p_offset, std::uint64_t p_size, std::string& p_headers, std::string& p_body)
+  {
+    addrinfo hints = {};
+    addrinfo* addresses = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (::getaddrinfo(this->host.c_str(), this->port.c_str(), &hints, &addresses) != 0)
+    {
+      return -1;
+    }
+
+    int connection = -1;
+
+    for (auto address = addresses; address != nullptr && connection < 0; address = address->ai_next)
+    {
+      if ( (connection = ::socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol)) >= 0 &&
+           ::connect(connection, address->ai_addr, address->ai_addrlen) != 0 )
+      {
+        ::close(connection);
+        connection = -1;
+      }
+    }
+
+    ::freeaddrinfo(addresses);
+
+    if (connection < 0)
+    {
+      return -1;
+    }
+
+    timeval timeout = {30, 0};
+    ::setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string message = "GET " + this->path + " HTTP/1.1\r\nHost: " + this->host + "\r\nRange: bytes=" + std::to_string(p_offset) + '-' +
+                          std::to_string(p_offset + p_size - 1) + "\r\nConnection: close\r\n\r\n";
+
+    if (!send_all(connection, message.data(), message.size()))
+    {
+      ::close(connection);
+      return -1;
+    }
+
+    std::string response;
+    char buffer[4096];
+    std::size_t end = std::string::npos;
+
+    while ( (end = response.find("\r\n\r\n")) == std::string::npos && response.size() < 65536 )
+    {
+      auto received = ::recv(connection, buffer, sizeof(buffer), 0);
+
+      if (received < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (received <= 0)
+      {
+        ::close(connection);
+        return -1;
+      }
+
+      response.append(buffer, received);
+    }
+
+    if (end == std::string::npos)
+    {
+      ::close(connection);
+      return -1;
+    }
+
+    p_headers = response.substr(0, end + 2);
+    p_body = response.substr(end + 4);
+
+    for (auto& character : p_headers)
+    {
+      character = static_cast<char>(std::tolower(static_cast<unsigned char>(character)));
+    }
+
+    return connection;
+  }
+
+  static bool send_all(int p_socket, const char* p_address, std::uint64_t p_size)
+  {
+    while (p_size != 0)
+    {
+#ifdef MSG_NOSIGNAL
+      auto sent = ::send(p_socket, p_address, p_size, MSG_NOSIGNAL);
+#else
+      auto sent = ::send(p_socket, p_address, p_size, 0);
+#endif
+
+      if (sent < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (sent <= 0)
+      {
+        return false;
+      }
+
+      p_address += sent;
+      p_size -= sent;
+    }
+
+    return true;
+  }
+
+  /* Status code of a response, 0 if it doesn't parse. */
+  static int get_status_code(const std::string& p_headers)
+  {
+    auto space = p_headers.find(' ');
+    return p_headers.compare(0, 5, "http/") == 0 && space != std::string::npos ? std::atoi(p_headers.c_str() + space + 1) : 0;
+  }
+
+  public:
+  /* Size of the remote file, taken from the Content-Range of a one byte request. */
+  std::uint64_t get_size()
+  {
+    return this->size;
+  }
+
+  /* False if the server couldn't be reached or doesn't answer range requests. */
+  bool is_open()
+  {
+    return this->opened;
+  }
+
+  int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_size == 0)
+    {
+      return STATUS::OK;
+    }
+
+    std::string headers;
+    std::string body;
+    int connection = request(p_offset, p_size, headers, body);
+
+    if (connection < 0)
+    {
+      return STATUS::IO_ERROR;
+    }
+
+    /* Only a partial response for exactly the requested range will do. */
+    std::string expected = "\ncontent-range: bytes " + std::to_string(p_offset) + '-' + std::to_string(p_offset + p_size - 1) + '/';
+
+    if (get_status_code(headers) != 206 || headers.find(expected) == std::string::npos)
+    {
+      ::close(connection);
+      return STATUS::IO_ERROR;
+    }
+
+    std::uint64_t received = std::min<std::uint64_t>(body.size(), p_size);
+    std::memcpy(p_address, body.data(), received);
+
+    while (received < p_size)
+    {
+      auto size = ::recv(connection, p_address + received, p_size - received, 0);
+
+      if (size < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (size <= 0)
+      {
+        ::close(connection);
+        return STATUS::TRUNCATED;
+      }
+
+      received += size;
+    }
+
+    ::close(connection);
+    return STATUS::OK;
+  }
+
+  /* p_path is the path of the bundle on the server, starting with '/'. */
+  Http_Transport(const std::string& p_host, std::uint16_t p_port, const std::string& p_path) :
+    host(p_host), port(std::to_string(p_port)), path(p_path)
+  {
+    std::string headers;
+    std::string body;
+    int connection = request(0, 1, headers, body);
+
+    if (connection < 0)
+    {
+      return;
+    }
+
+    ::close(connection);
+
+    /* "content-range: bytes 0-0/<size>", or with 416 for an empty file, the size after the slash all the same. */
+    auto range = headers.find("\ncontent-range: bytes ");
+    auto slash = range == std::string::npos ? std::string::npos : headers.find('/', range);
+    int status_code = get_status_code(headers);
+
+    if ( (status_code == 206 || status_code == 416) && slash != std::string::npos && std::isdigit(static_cast<unsigned char>(headers[slash + 1])) )
+    {
+      this->size = std::strtoull(headers.c_str() + slash + 1, nullptr, 10);
+      this->opened = true;
+    }
+  }
+};
+#endif
+
+template <typename Type, typename = void>
+struct has_flush : std::false_type {};
+
+template <typename Type>
+struct has_flush<Type, std::void_t<decltype(std::declval<Type&>().flush())>> : std::true_type {};
+
+template <typename Type, typename = void>
+struct has_data : std::false_type {};
+
+/* Sources that hold the whole bundle in memory. */
+template <typename Type>
+struct has_data<Type, std::void_t<decltype(std::declval<Type&>().get_data())>> : std::true_type {};
+
+#ifdef FILE_BUNDLER_POSIX
+/* After a failed write: waits for p_descriptor to take more data if it is non-blocking and full.
+ * Returns false for real errors.
+ */
+inline bool wait_writable(int p_descriptor)
+{
+  if (errno == EINTR)
+  {
+    return true;
+  }
+
+  if (errno != EAGAIN && errno != EWOULDBLOCK)
+  {
+    return false;
+  }
+
+  pollfd descriptor = {p_descriptor, POLLOUT, 0};
+
+  while (::poll(&descriptor, 1, -1) < 0)
+  {
+    if (errno != EINTR)
+    {
+      return false;
+    }
+  }
+
+  return (descriptor.revents & (POLLERR | POLLNVAL)) == 0;
+}
+#endif
+
+/* Flushes sinks that buffer writes, a no-op for the rest. */
+template <typename Sink>
+int flush(Sink& p_sink)
+{
+  if constexpr (has_flush<Sink>::value)
+  {
+    return p_sink.flush();
+  }
+
+  return STATUS::OK;
+}
+
+/* Longest burst a Throttle lets through at full speed after being idle, in seconds of its rates. */
+constexpr double THROTTLE_BURST = 0.1;
+
+/* Token buckets for Options::bytes_per_second and Options::operations_per_second, shared by every thread of a run.
+ * Takers run into debt rather than waiting for tokens to accumulate and then sleep it off, so a thread arriving while
+ * others are asleep waits behind them and the total rate holds for any number of threads and any chunk size.
+ */
+class Throttle
+{
+  private:
+  std::mutex mutex;
+  double byte_rate = 0;
+  double operation_rate = 0;
+  double bytes = 0;
+  double operations = 0;
+  std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+  Tracer* tracer = nullptr;
+
+  /* Refills p_tokens for p_elapsed seconds at p_rate, takes p_amount and returns how long the debt takes to pay off. */
+  static double take(double& p_tokens, double p_rate, double p_elapsed, double p_amount)
+  {
+    if (p_rate <= 0)
+    {
+      return 0;
+    }
+
+    p_tokens = std::min(p_tokens + p_elapsed * p_rate, p_rate * THROTTLE_BURST) - p_amount;
+    return p_tokens < 0 ? -p_tokens / p_rate : 0;
+  }
+
+  public:
+  Throttle(const Options& p_options) :
+    byte_rate(static_cast<double>(p_options.bytes_per_second)), operation_rate(static_cast<double>(p_options.operations_per_second)),
+    bytes(byte_rate * THROTTLE_BURST), operations(operation_rate * THROTTLE_BURST), tracer(p_options.tracer) {}
+
+  Throttle(const Throttle&) = delete;
+  Throttle& operator=(const Throttle&) = delete;
+
+  /* This throttle if it limits anything, nullptr (no throttling) otherwise. */
+  Throttle* get()
+  {
+    return this->byte_rate > 0 || this->operation_rate > 0 ? this : nullptr;
+  }
+
+  /* Accounts for one operation moving p_size bytes, sleeping until the budget allows it. */
+  void acquire(std::uint64_t p_size)
+  {
+    double wait = 0;
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      auto now = std::chrono::steady_clock::now();
+      double elapsed = std::chrono::duration<double>(now - this->last).count();
+
+      this->last = now;
+      wait = std::max(take(this->bytes, this->byte_rate, elapsed, static_cast<double>(p_size)), take(this->operations, this->operation_rate, elapsed, 1));
+    }
+
+    if (wait > 0)
+    {
+      double begin = this->tracer != nullptr ? this->tracer->now() : 0;
+      std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+
+      if (this->tracer != nullptr)
+      {
+        this->tracer->record("throttle", std::string(), begin, this->tracer->now());
+      }
+    }
+  }
+};
+
+/* Calls p_step(offset, size) for p_size bytes: in one go without a throttle, otherwise in steps of at most
+ * p_chunk_size bytes paced by p_throttle. For copies that need no intermediate buffer (to or from memory).
+ */
+template <typename Step>
+int pace(Throttle* p_throttle, std::uint64_t p_size, std::uint64_t p_chunk_size, Step&& p_step)
+{
+  int status = STATUS::OK;
+
+  if (p_throttle == nullptr)
+  {
+    return p_step(std::uint64_t(0), p_size);
+  }
+
+  for (std::uint64_t offset = 0; offset < p_size && status == STATUS::OK; offset += p_chunk_size)
+  {
+    auto step_size = std::min(p_chunk_size, p_size - offset);
+
+    p_throttle->acquire(step_size);
+    status = p_step(offset, step_size);
+  }
+
+  return status;
+}
+
+/* Copies p_size bytes found at p_offset in p_source to p_sink, going through p_chunk and paced by p_throttle (if given). */
+template <typename Source, typename Sink>
+int copy(Source& p_source, std::uint64_t p_offset, std::uint64_t p_size, Sink& p_sink, std::vector<std::uint8_t>& p_chunk, std::uint64_t p_chunk_size = COPY_CHUNK_SIZE,
+         Throttle* p_throttle = nullptr)
+{
+  int status = STATUS::OK;
+
+  /* Grow the chunk up to p_chunk_size as larger files come along. */
+  if (p_chunk.size() < std::min(p_chunk_size, p_size))
+  {
+    p_chunk.resize(std::min(p_chunk_size, p_size));
+  }
+
+  for (std::uint64_t offset = 0; offset < p_size; offset += p_chunk.size())
+  {
+    auto chunk_size = std::min<std::uint64_t>(p_chunk.size(), p_size - offset);
+
+    if (p_throttle != nullptr)
+    {
+      p_throttle->acquire(chunk_size);
+    }
+
+    if ( (status = p_source.read_at(p_offset + offset, p_chunk.data(), chunk_size)) != STATUS::OK ||
+         (status = p_sink.write(p_chunk.data(), chunk_size)) != STATUS::OK )
+    {
+      return status;
+    }
+  }
+
+  return STATUS::OK;
+}
+
+/* Same as copy() but writes to p_sink at p_sink_offset, for positional sinks. */
+template <typename Source, typename Sink>
+int copy_at(Source& p_source, std::uint64_t p_offset, std::uint64_t p_size, Sink& p_sink, std::uint64_t p_sink_offset, std::vector<std::uint8_t>& p_chunk,
+            std::uint64_t p_chunk_size = COPY_CHUNK_SIZE, Throttle* p_throttle = nullptr)
+{
+  int status = STATUS::OK;
+
+  if (p_chunk.size() < std::min(p_chunk_size, p_size))
+  {
+    p_chunk.resize(std::min(p_chunk_size, p_size));
+  }
+
+  for (std::uint64_t offset = 0; offset < p_size; offset += p_chunk.size())
+  {
+    auto chunk_size = std::min<std::uint64_t>(p_chunk.size(), p_size - offset);
+
+    if (p_throttle != nullptr)
+    {
+      p_throttle->acquire(chunk_size);
+    }
+
+    if ( (status = p_source.read_at(p_offset + offset, p_chunk.data(), chunk_size)) != STATUS::OK ||
+         (status = p_sink.write_at(p_sink_offset + offset, p_chunk.data(), chunk_size)) != STATUS::OK )
+    {
+      return status;
+    }
+  }
+
+  return STATUS::OK;
+}
+
+/* Records a span on a tracer (if there is one) from construction to destruction, see Tracer. */
+class Trace_Span
+{
+  private:
+  Tracer* tracer = nullptr;
+  const char* name = nullptr;
+  std::string detail;
+  double begin = 0;
+
+  public:
+  Trace_Span(Tracer* p_tracer, const char* p_name) : tracer(p_tracer), name(p_name)
+  {
+    if (this->tracer != nullptr)
+    {
+      this->begin = this->tracer->now();
+    }
+  }
+
+  /* p_detail is only copied when tracing. */
+  Trace_Span(Tracer* p_tracer, const char* p_name, const std::string& p_detail) : Trace_Span(p_tracer, p_name)
+  {
+    if (this->tracer != nullptr)
+    {
+      this->detail = p_detail;
+    }
+  }
+
+  Trace_Span(const Trace_Span&) = delete;
+  Trace_Span& operator=(const Trace_Span&) = delete;
+
+  ~Trace_Span()
+  {
+    if (this->tracer != nullptr)
+    {
+      this->tracer->record(this->name, this->detail, this->begin, this->tracer->now());
+    }
+  }
+};
+
+/* Number of events in Stats::Counters. */
+constexpr int COUNTER_COUNT = 5;
+
+/* Opens and reads the counters of a Counter_Scope, set only where FILE_BUNDLER_PERF_COUNTERS is defined (see
+ * Performance_Counters). Going through function pointers keeps Counter_Scope, bundle() and debundle() identical in
+ * every translation unit, whichever way each one was built.
+ */
+struct Counter_Hooks
+{
+  void (*start)(int* p_descriptors) = nullptr;
+  void (*stop)(int* p_descriptors, Stats::Counters& p_counters) = nullptr;
+};
+
+inline Counter_Hooks& get_counter_hooks()
+{
+  static Counter_Hooks hooks;
+  return hooks;
+}
+
+#if defined(__linux__) && defined(FILE_BUNDLER_PERF_COUNTERS)
+/* Hardware and software event counters of the calling thread and the threads it starts, see Options::performance_counters.
+ * Each counter is opened on its own, so one the kernel refuses (no PMU in a VM, perf_event_paranoid) doesn't take
+ * the others with it. Kernel time is counted when allowed, which is what shows syscall-bound paths.
+ */
+class Performance_Counters
+{
+  private:
+  static int open_counter(std::uint32_t p_type, std::uint64_t p_config)
+  {
+    perf_event_attr attributes = {};
+    attributes.size = sizeof(attributes);
+    attributes.type = p_type;
+    attributes.config = p_config;
+    attributes.disabled = 1;
+    attributes.inherit = 1;
+
+    int descriptor = static_cast<int>(::syscall(SYS_perf_event_open, &attributes, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+
+    if (descriptor < 0 && (errno == EACCES || errno == EPERM))
+    {
+      /* User space only, all that perf_event_paranoid 2 allows. */
+      attributes.exclude_kernel = 1;
+      attributes.exclude_hv = 1;
+      descriptor = static_cast<int>(::syscall(SYS_perf_event_open, &attributes, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    return descriptor;
+  }
+
+  public:
+  /* Opens and enables a counter per event into p_descriptors, -1 for those that couldn't be opened. */
+  static void start(int* p_descriptors)
+  {
+    const std::pair<std::uint32_t, std::uint64_t> events[COUNTER_COUNT] =
+    {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+      {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}
+    };
+
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+      if ( (p_descriptors[i] = open_counter(events[i].first, events[i].second)) >= 0 )
+      {
+        ::ioctl(p_descriptors[i], PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  /* Stops counting, stores the counts and closes the counters; those that couldn't be opened stay at Stats::UNAVAILABLE. */
+  static void stop(int* p_descriptors, Stats::Counters& p_counters)
+  {
+    std::uint64_t* values[COUNTER_COUNT] =
+    {
+      &p_counters.cycles, &p_counters.instructions, &p_counters.cache_misses, &p_counters.page_faults, &p_counters.context_switches
+    };
+
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+      std::uint64_t value = 0;
+
+      if (p_descriptors[i] < 0)
+      {
+        continue;
+      }
+
+      ::ioctl(p_descriptors[i], PERF_EVENT_IOC_DISABLE, 0);
+
+      if (::read(p_descriptors[i], &value, sizeof(value)) == sizeof(value))
+      {
+        *values[i] = value;
+      }
+
+      ::close(p_descriptors[i]);
+      p_descriptors[i] = -1;
+    }
+  }
+
+  /* Installs start() and stop() as the Counter_Hooks, once per program. */
+  static bool hook()
+  {
+    get_counter_hooks().start = start;
+    get_counter_hooks().stop = stop;
+    return true;
+  }
+};
+
+inline const bool performance_counters_hooked = Performance_Counters::hook();
+#endif
+
+/* Counts events from construction to destruction into Options::stats, with Options::performance_counters set. */
+class Counter_Scope
+{
+  private:
+  Stats* stats = nullptr;
+  int descriptors[COUNTER_COUNT] = {-1, -1, -1, -1, -1};
+
+  public:
+  Counter_Scope(const Options& p_options)
+  {
+    if (p_options.performance_counters && p_options.stats != nullptr)
+    {
+      this->stats = p_options.stats;
+      this->stats->counters = Stats::Counters();
+
+      if (get_counter_hooks().start != nullptr)
+      {
+        get_counter_hooks().start(this->descriptors);
+      }
+    }
+  }
+
+  Counter_Scope(const Counter_Scope&) = delete;
+  Counter_Scope& operator=(const Counter_Scope&) = delete;
+
+  ~Counter_Scope()
+  {
+    if (this->stats != nullptr && get_counter_hooks().stop != nullptr)
+    {
+      get_counter_hooks().stop(this->descriptors, this->stats->counters);
+    }
+  }
+};
+
+/* Whether Options::io_priority or Options::nice ask for anything, see run_prioritized(). */
+inline bool has_priority(const Options& p_options)
+{
+#ifdef __linux__
+  return p_options.io_priority != IO_PRIORITY::UNCHANGED || p_options.nice != 0;
+#else
+  static_cast<void>(p_options);
+  return false;
+#endif
+}
+
+/* Runs p_run(options) on a thread of its own with Options::io_priority and Options::nice applied to it, and returns
+ * its result. Both are per thread on Linux and inherited by the threads it starts (the workers), so the whole run
+ * is deprioritised and the calling thread, which couldn't raise its priorities back unprivileged, is not.
+ * The options p_run gets have both cleared. Exceptions thrown by p_run (std::bad_alloc) are rethrown to the caller
+ * once the thread is joined, as if it had run on the calling thread.
+ */
+template <typename Run>
+auto run_prioritized(const Options& p_options, Run&& p_run) -> decltype(p_run(p_options))
+{
+  decltype(p_run(p_options)) result;
+  std::exception_ptr exception;
+  Options options = p_options;
+
+  options.io_priority = IO_PRIORITY::UNCHANGED;
+  options.nice = 0;
+
+  std::thread thread([&]()
+  {
+#ifdef __linux__
+    auto thread_id = static_cast<id_t>(::syscall(SYS_gettid));
+
+    if (p_options.io_priority != IO_PRIORITY::UNCHANGED)
+    {
+      /* IOPRIO_PRIO_VALUE() of linux/ioprio.h, which not every libc exposes. */
+      int level = std::min(std::max(p_options.io_priority_level, 0), 7);
+      ::syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, static_cast<int>(thread_id), (p_options.io_priority << 13) | level);
+    }
+
+    if (p_options.nice != 0)
+    {
+      errno = 0;
+      int current = ::getpriority(PRIO_PROCESS, thread_id);
+
+      if (errno == 0)
+      {
+        ::setpriority(PRIO_PROCESS, thread_id, std::min(std::max(current + p_options.nice, -20), 19));
+      }
+    }
+#endif
+
+    try
+    {
+      result = p_run(options);
+    }
+    catch (...)
+    {
+      exception = std::current_exception();
+    }
+  });
+
+  thread.join();
+
+  if (exception)
+  {
+    std::rethrow_exception(exception);
+  }
+
+  return result;
+}
+
+/* Resolves Options::thread_count. */
+inline std::uint64_t get_thread_count(const Options& p_options)
+{
+  if (p_options.thread_count != 0)
+  {
+    return p_options.thread_count;
+  }
+
+  return std::max<std::uint64_t>(1, std::thread::hardware_concurrency());
+}
+
+/* Resolves Options::chunk_size. */
+inline std::uint64_t get_chunk_size(const Options& p_options)
+{
+  return p_options.chunk_size != 0 ? p_options.chunk_size : COPY_CHUNK_SIZE;
+}
+
+/* CPUs of each NUMA node. Machines (or platforms) without NUMA information get a single node with no CPUs listed. */
+struct Topology
+{
+  std::vector<std::vector<int>> node_cpus;
+};
+
+/* Parses a sysfs CPU list such as "0-3,8-11". */
+inline std::vector<int> parse_cpu_list(const std::string& p_list)
+{
+  std::vector<int> cpus;
+  std::size_t position = 0;
+
+  while (position < p_list.size())
+  {
+    auto end = p_list.find(',', position);
+    auto range = p_list.substr(position, end == std::string::npos ? std::string::npos : end - position);
+    auto dash = range.find('-');
+
+    if (!range.empty() && std::isdigit(static_cast<unsigned char>(range[0])))
+    {
+      int first = std::stoi(range);
+      int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+      for (int cpu = first; cpu <= last; cpu++)
+      {
+        cpus.push_back(cpu);
+      }
+    }
+
+    if (end == std::string::npos)
+    {
+      break;
+    }
+
+    position = end + 1;
+  }
+
+  return cpus;
+}
+
+inline Topology get_topology()
+{
+  Topology topology;
+
+#ifdef __linux__
+  for (int node = 0; ; node++)
+  {
+    std::ifstream cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+
+    if (!cpu_list || !std::getline(cpu_list, list))
+    {
+      break;
+    }
+
+    topology.node_cpus.push_back(parse_cpu_list(list));
+  }
+#endif
+
+  if (topology.node_cpus.empty())
+  {
+    topology.node_cpus.emplace_back();
+  }
+
+  return topology;
+}
+
+/* Restricts the calling thread to p_cpus, returns false where unsupported. */
+inline bool pin_thread(const std::vector<int>& p_cpus)
+{
+#ifdef __linux__
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+
+  for (int cpu : p_cpus)
+  {
+    if (cpu < CPU_SETSIZE)
+    {
+      CPU_SET(cpu, &cpu_set);
+    }
+  }
+
+  return !p_cpus.empty() && ::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+  (void)p_cpus;
+  return false;
+#endif
+}
+
+/* Runs a fixed set of tasks on a number of workers, the calling thread being worker 0.
+ * Tasks are dealt round-robin in the order given, so handing them over largest first gives every worker
+ * a similar share. Each worker runs its own queue front to back and, once it runs dry, steals from the
+ * back of the others (their smallest tasks), which keeps the tail of the run flat.
+ *
+ * With a topology set, workers are spread evenly over the NUMA nodes and pinned there, every task is
+ * dealt to the workers of its own node, and stealing tries workers of the same node first.
+ * Buffers a worker allocates after it has started are first touched on its own node.
+ */
+class Scheduler
+{
+  private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<std::uint64_t> tasks;
+  };
+
+  std::unique_ptr<Queue[]> queues;
+  std::uint64_t worker_count = 0;
+  std::atomic<bool> stopped{false};
+
+  const Topology* topology = nullptr;
+  std::vector<std::uint64_t> worker_nodes;
+  std::vector<double> worker_seconds;
+  Tracer* tracer = nullptr;
+
+  /* Workers of the same node, starting with p_worker itself, then everyone else. */
+  std::vector<std::uint64_t> get_victims(std::uint64_t p_worker)
+  {
+    std::vector<std::uint64_t> victims;
+
+    for (int same_node = 1; same_node >= 0; same_node--)
+    {
+      for (std::uint64_t i = 0; i < this->worker_count; i++)
+      {
+        auto worker = (p_worker + i) % this->worker_count;
+
+        if ( (this->worker_nodes[worker] == this->worker_nodes[p_worker]) == static_cast<bool>(same_node) )
+        {
+          victims.push_back(worker);
+        }
+      }
+    }
+
+    return victims;
+  }
+
+  /* Own queue from the front, then everyone else's from the back. */
+  bool next(std::uint64_t p_worker, const std::vector<std::uint64_t>& p_victims, std::uint64_t& p_task)
+  {
+    for (auto victim : p_victims)
+    {
+      auto& queue = this->queues[victim];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+
+      if (queue.tasks.empty())
+      {
+        continue;
+      }
+
+      if (victim == p_worker)
+      {
+        p_task = queue.tasks.front();
+        queue.tasks.pop_front();
+      }
+      else
+      {
+        p_task = queue.tasks.back();
+        queue.tasks.pop_back();
+      }
+
+      return true;
+    }
+
+    return false;
+  }
+
+  public:
+  /* Makes the next run NUMA aware, p_topology must outlive it. */
+  void set_topology(const Topology* p_topology)
+  {
+    this->topology = p_topology;
+  }
+
+  /* Records the time each worker spends taking a task off the queues as a "wait" span. */
+  void set_tracer(Tracer* p_tracer)
+  {
+    this->tracer = p_tracer;
+  }
+
+  std::uint64_t get_worker_count()
+  {
+    return this->worker_count;
+  }
+
+  std::uint64_t get_worker_node(std::uint64_t p_worker)
+  {
+    return this->worker_nodes[p_worker];
+  }
+
+  /* Time from the start of the last run until p_worker ran out of tasks. */
+  double get_worker_seconds(std::uint64_t p_worker)
+  {
+    return this->worker_seconds[p_worker];
+  }
+
+  /* Calls p_function(task, worker) for tasks 0 to p_task_count - 1 on up to p_worker_count threads.
+   * p_task_node(task) names the NUMA node a task's data belongs to, it is only consulted with a topology set.
+   * Returning false from p_function stops every worker after its current task.
+   */
+  template <typename Function, typename Node_Function>
+  void run(std::uint64_t p_task_count, std::uint64_t p_worker_count, Function p_function, Node_Function p_task_node)
+  {
+    std::uint64_t node_count = this->topology == nullptr ? 1 : this->topology->node_cpus.size();
+
+    this->worker_count = std::max<std::uint64_t>(1, std::min(p_worker_count, p_task_count));
+    this->queues = std::make_unique<Queue[]>(this->worker_count);
+    this->worker_nodes.assign(this->worker_count, 0);
+    this->worker_seconds.assign(this->worker_count, 0);
+    this->stopped = false;
+
+    /* Workers of each node, interleaved so that fewer workers than nodes still cover distinct nodes. */
+    std::vector<std::vector<std::uint64_t>> node_workers(node_count);
+
+    for (std::uint64_t worker = 0; worker < this->worker_count; worker++)
+    {
+      this->worker_nodes[worker] = worker % node_count;
+      node_workers[worker % node_count].push_back(worker);
+    }
+
+    std::vector<std::uint64_t> dealt(node_count, 0);
+
+    for (std::uint64_t task = 0; task < p_task_count; task++)
+    {
+      std::uint64_t node = node_count == 1 ? 0 : static_cast<std::uint64_t>(p_task_node(task)) % node_count;
+      auto& workers = node_workers[node].empty() ? node_workers[0] : node_workers[node];
+
+      this->queues[workers[dealt[node]++ % workers.size()]].tasks.push_back(task);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto work = [&](std::uint64_t p_worker)
+    {
+      if (this->topology != nullptr)
+      {
+        pin_thread(this->topology->node_cpus[this->worker_nodes[p_worker]]);
+      }
+
+      auto victims = get_victims(p_worker);
+      std::uint64_t task = 0;
+
+      while (!this->stopped)
+      {
+        {
+          Trace_Span span(this->tracer, "wait");
+
+          if (!next(p_worker, victims, task))
+          {
+            break;
+          }
+        }
+
+        if (!p_function(task, p_worker))
+        {
+          this->stopped = true;
+        }
+      }
+
+      this->worker_seconds[p_worker] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+#ifdef __linux__
+    /* The calling thread is a worker too, give it back its own affinity afterwards. */
+    cpu_set_t caller_affinity;
+    bool restore_affinity = this->topology != nullptr && ::pthread_getaffinity_np(::pthread_self(), sizeof(caller_affinity), &caller_affinity) == 0;
+#endif
+
+    std::vector<std::thread> threads;
+
+    for (std::uint64_t worker = 1; worker < this->worker_count; worker++)
+    {
+      threads.emplace_back(work, worker);
+    }
+
+    work(0);
+
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+
+#ifdef __linux__
+    if (restore_affinity)
+    {
+      ::pthread_setaffinity_np(::pthread_self(), sizeof(caller_affinity), &caller_affinity);
+    }
+#endif
+  }
+
+  template <typename Function>
+  void run(std::uint64_t p_task_count, std::uint64_t p_worker_count, Function p_function)
+  {
+    run(p_task_count, p_worker_count, p_function, [](std::uint64_t) { return 0; });
+  }
+};
+
+/* Work units of parallel bundling and extraction are sized so scheduling stays cheap next to the work itself:
+ * files over twice PARALLEL_RANGE_SIZE are split into ranges, files under PARALLEL_BATCH_SIZE are grouped
+ * into batches of about PARALLEL_BATCH_SIZE. Opening a file counts as FILE_COST bytes of work.
+ */
+constexpr std::uint64_t PARALLEL_RANGE_SIZE = 64 << 20;
+constexpr std::uint64_t PARALLEL_BATCH_SIZE = 4 << 20;
+constexpr std::uint64_t FILE_COST = 64 << 10;
+
+/* Either a batch of whole files or a single range of a split file. */
+struct Task
+{
+  /* Batch: files order[first] to order[first + count - 1]. */
+  std::uint64_t first = 0;
+  std::uint64_t count = 0;
+
+  /* Range (count == 0): 'size' bytes at 'offset' into the file at index 'file'. */
+  std::uint64_t file = 0;
+  std::uint64_t offset = 0;
+  std::uint64_t size = 0;
+
+  /* NUMA node whose workers get this task. */
+  std::uint64_t node = 0;
+};
+
+/* Orders files p_first to p_last - 1 largest first and cuts them into tasks for p_node, see PARALLEL_RANGE_SIZE.
+ * Appends to p_order and p_tasks so several nodes can be planned into the same lists.
+ */
+inline void plan_tasks(const std::vector<std::uint64_t>& p_sizes, std::uint64_t p_first, std::uint64_t p_last, std::uint64_t p_node, bool p_split,
+                std::vector<std::uint64_t>& p_order, std::vector<Task>& p_tasks)
+{
+  auto order_begin = p_order.size();
+  p_order.resize(order_begin + (p_last - p_first));
+  std::iota(p_order.begin() + order_begin, p_order.end(), p_first);
+  std::stable_sort(p_order.begin() + order_begin, p_order.end(), [&](std::uint64_t p_left, std::uint64_t p_right) { return p_sizes[p_left] > p_sizes[p_right]; });
+
+  Task batch;
+  std::uint64_t batch_cost = 0;
+
+  for (std::uint64_t i = order_begin; i < p_order.size(); i++)
+  {
+    auto file_size = p_sizes[p_order[i]];
+    auto file_cost = file_size + FILE_COST;
+
+    if (p_split && file_size > 2 * PARALLEL_RANGE_SIZE)
+    {
+      for (std::uint64_t offset = 0; offset < file_size; offset += PARALLEL_RANGE_SIZE)
+      {
+        p_tasks.push_back({0, 0, p_order[i], offset, std::min(PARALLEL_RANGE_SIZE, file_size - offset), p_node});
+      }
+    }
+    else if (file_cost >= PARALLEL_BATCH_SIZE)
+    {
+      p_tasks.push_back({i, 1, 0, 0, 0, p_node});
+    }
+    else
+    {
+      /* Files are sorted, so every file from here on ends up in a batch and batches stay contiguous. */
+      if (batch.count++ == 0)
+      {
+        batch.first = i;
+        batch.node = p_node;
+      }
+
+      if ( (batch_cost += file_cost) >= PARALLEL_BATCH_SIZE )
+      {
+        p_tasks.push_back(batch);
+        batch = {};
+        batch_cost = 0;
+      }
+    }
+  }
+
+  if (batch.count != 0)
+  {
+    p_tasks.push_back(batch);
+  }
+}
+
+/* Plans all files for p_node_count nodes.
+ * The payload is cut into p_node_count contiguous byte ranges and each node gets the files starting in its range.
+ */
+inline void plan_tasks(const std::vector<std::uint64_t>& p_sizes, std::uint64_t p_node_count, bool p_split, std::vector<std::uint64_t>& p_order, std::vector<Task>& p_tasks)
+{
+  std::uint64_t total_size = 0;
+
+  for (auto file_size : p_sizes)
+  {
+    total_size += file_size;
+  }
+
+  std::uint64_t first = 0;
+  std::uint64_t offset = 0;
+
+  for (std::uint64_t node = 0; node < p_node_count; node++)
+  {
+    /* Written this way so that node * total_size can't overflow. */
+    std::uint64_t node_end = node + 1 == p_node_count ? total_size : total_size / p_node_count * (node + 1);
+    std::uint64_t last = first;
+
+    while (last < p_sizes.size() && (offset < node_end || node + 1 == p_node_count))
+    {
+      offset += p_sizes[last++];
+    }
+
+    plan_tasks(p_sizes, first, last, node, p_split, p_order, p_tasks);
+    first = last;
+  }
+}
+
+/* Single threaded runs count as one worker on one node. */
+inline void record_stats(Stats* p_stats, std::uint64_t p_bytes, double p_seconds)
+{
+  if (p_stats != nullptr)
+  {
+    p_stats->bytes = p_bytes;
+    p_stats->seconds = p_seconds;
+    p_stats->nodes.assign(1, {1, p_bytes, p_seconds});
+  }
+}
+
+/* Fills p_stats with the bytes each worker copied, grouped by NUMA node. */
+inline void record_stats(Stats* p_stats, Scheduler& p_scheduler, const std::vector<std::uint64_t>& p_worker_bytes, std::uint64_t p_node_count)
+{
+  if (p_stats == nullptr)
+  {
+    return;
+  }
+
+  p_stats->bytes = 0;
+  p_stats->seconds = 0;
+  p_stats->nodes.assign(p_node_count, {});
+
+  for (std::uint64_t worker = 0; worker < p_scheduler.get_worker_count(); worker++)
+  {
+    auto& node = p_stats->nodes[p_scheduler.get_worker_node(worker)];
+
+    node.worker_count++;
+    node.bytes += p_worker_bytes[worker];
+    node.seconds = std::max(node.seconds, p_scheduler.get_worker_seconds(worker));
+
+    p_stats->bytes += p_worker_bytes[worker];
+    p_stats->seconds = std::max(p_stats->seconds, p_scheduler.get_worker_seconds(worker));
+  }
+}
+
+/* Auto-tuning, see tune().
+ * Sequential reads are sampled at every candidate chunk size, each over its own PROBE_SAMPLE_SIZE region
+ * so the page cache can't favour a later candidate. The samples are taken from a private file written next to the
+ * file being tuned for, whose pages are dropped from the cache first (where the platform allows) so that the disk
+ * rather than memory is measured without evicting anything of the caller's.
+ */
+constexpr std::uint64_t PROBE_SAMPLE_SIZE = 4 << 20;
+constexpr std::uint64_t PROBE_READ_SIZE = 4 << 10;
+constexpr std::uint64_t PROBE_READ_COUNT = 64;
+constexpr std::uint64_t PROBE_CHUNK_SIZES[] = {64 << 10, 256 << 10, 1 << 20, 4 << 20};
+
+#ifdef FILE_BUNDLER_POSIX
+/* Asks the kernel to forget cached pages of a range, so the next read goes to the device. */
+inline void drop_cache(Descriptor_Stream& p_stream, std::uint64_t p_offset, std::uint64_t p_size)
+{
+#ifdef POSIX_FADV_DONTNEED
+  ::posix_fadvise(p_stream.get_descriptor(), p_offset, p_size, POSIX_FADV_DONTNEED);
+#else
+  (void)p_stream;
+  (void)p_offset;
+  (void)p_size;
+#endif
+}
+#endif
+
+/* Seconds taken by p_function. */
+template <typename Function>
+double measure(Function p_function)
+{
+  auto start = std::chrono::steady_clock::now();
+  p_function();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Measures the file at p_path, which should be large enough to hold a few samples.
+ * Chunk size: the smallest candidate within 10% of the best sequential throughput.
+ * Thread count: one per hardware thread if random reads scale with concurrency (SSDs, network storage), one otherwise (spinning disks).
+ * Backend: mmap if it reads a sample at least 10% faster than pread.
+ * Sampled ranges are dropped from the page cache before being read with p_drop_cache, only set for files of our own.
+ */
+inline Tuning probe(const std::string& p_path, bool p_drop_cache)
+{
+  Tuning tuning;
+  tuning.probed = true;
+
+#ifdef FILE_BUNDLER_POSIX
+  Descriptor_Stream stream(p_path, std::ios::in | std::ios::binary);
+  std::uint64_t file_size = stream.get_size();
+  std::uint64_t candidate_count = sizeof(PROBE_CHUNK_SIZES) / sizeof(PROBE_CHUNK_SIZES[0]);
+
+  /* One region per chunk size candidate, plus one for the mmap comparison. */
+  if (!stream.is_open() || file_size < (candidate_count + 1) * PROBE_SAMPLE_SIZE)
+  {
+    tuning.probed = false;
+    return tuning;
+  }
+
+  std::uint64_t region_size = file_size / (candidate_count + 1) / PROBE_SAMPLE_SIZE * PROBE_SAMPLE_SIZE;
+  std::vector<std::uint8_t> buffer(PROBE_CHUNK_SIZES[candidate_count - 1]);
+  std::vector<double> throughputs;
+
+  /* Reads PROBE_SAMPLE_SIZE bytes at p_offset through a source, in p_chunk_size pieces. */
+  auto sample = [&](auto& p_source, std::uint64_t p_offset, std::uint64_t p_chunk_size)
+  {
+    if (p_drop_cache)
+    {
+      drop_cache(stream, p_offset, PROBE_SAMPLE_SIZE);
+    }
+
+    return PROBE_SAMPLE_SIZE / measure([&]
+    {
+      for (std::uint64_t offset = 0; offset < PROBE_SAMPLE_SIZE; offset += p_chunk_size)
+      {
+        p_source.read_at(p_offset + offset, buffer.data(), p_chunk_size);
+      }
+    });
+  };
+
+  for (std::uint64_t i = 0; i < candidate_count; i++)
+  {
+    throughputs.push_back(sample(stream, i * region_size, PROBE_CHUNK_SIZES[i]));
+  }
+
+  auto best = *std::max_element(throughputs.begin(), throughputs.end());
+
+  for (std::uint64_t i = 0; i < candidate_count; i++)
+  {
+    if (throughputs[i] >= best * 0.9)
+    {
+      tuning.chunk_size = PROBE_CHUNK_SIZES[i];
+      break;
+    }
+  }
+
+  /* Random reads, first one at a time, then PROBE_READ_COUNT at once spread over several threads. */
+  std::uint64_t hardware_threads = std::max<std::uint64_t>(1, std::thread::hardware_concurrency());
+  std::uint64_t probe_threads = std::min<std::uint64_t>(hardware_threads, 8);
+  std::uint64_t page_count = file_size / PROBE_READ_SIZE;
+
+  auto random_reads = [&](std::uint64_t p_seed, std::uint64_t p_count)
+  {
+    std::vector<std::uint8_t> page(PROBE_READ_SIZE);
+
+    for (std::uint64_t i = 0; i < p_count; i++)
+    {
+      /* Linear congruential steps, good enough to defeat read-ahead. */
+      p_seed = p_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      std::uint64_t offset = (p_seed >> 16) % page_count * PROBE_READ_SIZE;
+
+      if (p_drop_cache)
+      {
+        drop_cache(stream, offset, PROBE_READ_SIZE);
+      }
+
+      stream.read_at(offset, page.data(), PROBE_READ_SIZE);
+    }
+  };
+
+  if (probe_threads > 1)
+  {
+    double serial = measure([&] { random_reads(1, PROBE_READ_COUNT); });
+    double parallel = measure([&]
+    {
+      std::vector<std::thread> threads;
+
+      for (std::uint64_t thread = 0; thread < probe_threads; thread++)
+      {
+        threads.emplace_back(random_reads, thread + 2, PROBE_READ_COUNT / probe_threads);
+      }
+
+      for (auto& thread : threads)
+      {
+        thread.join();
+      }
+    });
+
+    tuning.thread_count = parallel * 1.5 < serial ? hardware_threads : 1;
+  }
+
+  /* The last region is read once through pread() and once more through a mapping. */
+  Mapped_Stream mapped(p_path);
+
+  if (mapped.get_data() != nullptr)
+  {
+    auto offset = candidate_count * region_size;
+    auto descriptor_throughput = sample(stream, offset, tuning.chunk_size);
+    auto mapped_throughput = sample(mapped, offset, tuning.chunk_size);
+
+    tuning.backend = mapped_throughput > descriptor_throughput * 1.1 ? BACKEND::MAPPED : BACKEND::DESCRIPTOR;
+  }
+#else
+  (void)p_path;
+  (void)p_drop_cache;
+  tuning.probed = false;
+#endif
+
+  return tuning;
+}
+
+#ifdef FILE_BUNDLER_POSIX
+/* Writes a private file of p_size bytes next to p_path (so on the same file system) and syncs it to the disk, for probe().
+ * Returns its path, empty if the directory isn't writable. The caller removes it.
+ */
+inline std::string create_probe_file(const std::string& p_path, std::uint64_t p_size)
+{
+  std::error_code error;
+  std::string path = fs::absolute(p_path, error).parent_path().string() + "/.file_bundler_probe_XXXXXX";
+  int descriptor = error ? -1 : ::mkstemp(&path[0]);
+
+  if (descriptor < 0)
+  {
+    return std::string();
+  }
+
+  Descriptor_Stream stream(descriptor);
+  std::vector<std::uint8_t> block(PROBE_SAMPLE_SIZE);
+  std::uint64_t seed = 1;
+  bool written = true;
+
+  /* Incompressible, so compressing file systems store (and read back) all of it. */
+  for (std::uint64_t offset = 0; offset < p_size && written; offset += block.size())
+  {
+    for (auto& byte : block)
+    {
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      byte = static_cast<std::uint8_t>(seed >> 56);
+    }
+
+    written = stream.write(block.data(), std::min<std::uint64_t>(block.size(), p_size - offset)) == STATUS::OK;
+  }
+
+  if (!written || ::fsync(descriptor) != 0)
+  {
+    ::unlink(path.c_str());
+    return std::string();
+  }
+
+  return path;
+}
+
+/* Mount point of the file system holding p_path: the topmost directory above it on the same device. Empty if p_path doesn't exist. */
+inline std::string get_mount_point(const std::string& p_path)
+{
+  std::error_code error;
+  fs::path path = fs::canonical(p_path, error);
+  struct stat file_status;
+
+  if (error || ::stat(path.c_str(), &file_status) != 0)
+  {
+    return std::string();
+  }
+
+  while (path.has_relative_path())
+  {
+    struct stat parent_status;
+
+    if (::stat(path.parent_path().c_str(), &parent_status) != 0 || parent_status.st_dev != file_status.st_dev)
+    {
+      break;
+    }
+
+    path = path.parent_path();
+  }
+
+  return path.string();
+}
+#endif
+
+/* File the probe results of every mount point are kept in across processes:
+ * $XDG_CACHE_HOME/file_bundler/tuning, or ~/.cache/file_bundler/tuning. Empty if neither variable is set.
+ * One line per mount point: chunk size, thread count, backend and the mount point's path.
+ */
+inline std::string get_tuning_cache_path()
+{
+  const char* cache_home = std::getenv("XDG_CACHE_HOME");
+  const char* home = std::getenv("HOME");
+
+  if (cache_home != nullptr && cache_home[0] != '\0')
+  {
+    return std::string(cache_home) + "/file_bundler/tuning";
+  }
+
+  return home != nullptr && home[0] != '\0' ? std::string(home) + "/.cache/file_bundler/tuning" : std::string();
+}
+
+/* Adds the entries of the tuning cache file to p_tunings. */
+inline void load_tunings(std::unordered_map<std::string, Tuning>& p_tunings)
+{
+  std::ifstream file(get_tuning_cache_path());
+  std::string mount_point;
+  Tuning tuning;
+
+  while (file >> tuning.chunk_size >> tuning.thread_count >> tuning.backend && file.get() == ' ' && std::getline(file, mount_point))
+  {
+    tuning.probed = true;
+    p_tunings[mount_point] = tuning;
+  }
+}
+
+/* Adds (or replaces) the entry of p_mount_point in the tuning cache file, keeping the entries other processes stored. */
+inline void store_tuning(const std::string& p_mount_point, const Tuning& p_tuning)
+{
+  std::unordered_map<std::string, Tuning> tunings;
+  std::string path = get_tuning_cache_path();
+  std::string temporary_path = path + '.' + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  std::error_code error;
+
+  if (path.empty() || p_mount_point.find('\n') != std::string::npos || (fs::create_directories(fs::path(path).parent_path(), error), error))
+  {
+    return;
+  }
+
+  load_tunings(tunings);
+  tunings[p_mount_point] = p_tuning;
+
+  {
+    std::ofstream file(temporary_path, std::ios::out | std::ios::trunc);
+
+    for (const auto& tuning : tunings)
+    {
+      file << tuning.second.chunk_size << ' ' << tuning.second.thread_count << ' ' << tuning.second.backend << ' ' << tuning.first << '\n';
+    }
+
+    if (!file.flush())
+    {
+      file.close();
+      fs::remove(temporary_path, error);
+      return;
+    }
+  }
+
+  /* Readers see either the old or the new file, never a partial one. */
+  fs::rename(temporary_path, path, error);
+}
+
+/* Probe results by mount point, shared by every bundle and debundle call of the process and loaded from the tuning cache file. */
+struct Tuning_Cache
+{
+  std::mutex mutex;
+  std::unordered_map<std::string, Tuning> tunings;
+
+  Tuning_Cache()
+  {
+    load_tunings(this->tunings);
+  }
+};
+
+inline Tuning_Cache& get_tuning_cache()
+{
+  static Tuning_Cache cache;
+  return cache;
+}
+
+/* See file_bundler::tune(). */
+inline Tuning get_tuning(const std::string& p_path, bool p_use_cache)
+{
+#ifdef FILE_BUNDLER_POSIX
+  std::string mount_point = get_mount_point(p_path);
+
+  if (mount_point.empty())
+  {
+    return Tuning();
+  }
+#else
+  /* No portable way to find the mount point, cache per root name (drive) instead. */
+  std::error_code error;
+  std::string mount_point = fs::absolute(p_path, error).root_name().string();
+#endif
+
+  auto& cache = get_tuning_cache();
+
+  if (p_use_cache)
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto tuning = cache.tunings.find(mount_point);
+
+    if (tuning != cache.tunings.end())
+    {
+      auto cached = tuning->second;
+      cached.cached = true;
+      return cached;
+    }
+  }
+
+  Tuning tuning;
+
+#ifdef FILE_BUNDLER_POSIX
+  /* Probe a file of our own if the directory allows, the caller's file otherwise (with its cache left alone). */
+  std::uint64_t candidate_count = sizeof(PROBE_CHUNK_SIZES) / sizeof(PROBE_CHUNK_SIZES[0]);
+  std::string probe_path = create_probe_file(p_path, (candidate_count + 1) * PROBE_SAMPLE_SIZE);
+
+  tuning = probe(probe_path.empty() ? p_path : probe_path, !probe_path.empty());
+
+  if (!probe_path.empty())
+  {
+    ::unlink(probe_path.c_str());
+  }
+#else
+  tuning = probe(p_path, false);
+#endif
+
+  /* Files too small to sample say nothing about the device. */
+  if (tuning.probed)
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.tunings[mount_point] = tuning;
+    store_tuning(mount_point, tuning);
+  }
+
+  return tuning;
+}
+
+/* Applies Options::auto_tune, probing the disk holding p_path. Returns the options to run with. */
+inline Options apply_tuning(const Options& p_options, const std::string& p_path)
+{
+  Options options = p_options;
+
+  if (!options.auto_tune || p_path.empty())
+  {
+    return options;
+  }
+
+  auto tuning = get_tuning(p_path, true);
+
+  options.chunk_size = tuning.chunk_size;
+  options.thread_count = tuning.thread_count;
+  options.backend = tuning.backend;
+
+  if (options.stats != nullptr)
+  {
+    options.stats->tuning = tuning;
+  }
+
+  return options;
+}
+
+/* We use this header to parse and debundle our bundled files.
+ * This way there is no need to use magic numbers to separate each section.
+ * Adding offsets would make parsing easier but the trade off is a slight increase in size of the final bundle.
+ */
+struct Header
+{
+  std::uint64_t paths_section_size = 0;
+  std::uint64_t sizes_section_size = 0;
+  std::uint64_t files_section_size = 0;
+};
+
+/* Flags kept in the low bits of Header::sizes_section_size, which is otherwise a multiple of 8.
+ * Readers that predate a flag see a size that isn't and reject the bundle as corrupt rather than misread it.
+ */
+constexpr std::uint64_t HEADER_FLAGS = 7;
+
+/* The files section holds Chunk_References into a chunk store instead of file contents, see Options::chunk_store. */
+constexpr std::uint64_t CHUNK_REFERENCES = 1;
+
+/* A chunk of file contents kept in a chunk store, named by its content hash. Each file's chunks follow each other
+ * in the files section in bundle order, and add up to the file's size.
+ */
+struct Chunk_Reference
+{
+  std::uint64_t hash[2] = {};
+  std::uint64_t size = 0;
+};
+
+static_assert(sizeof(Chunk_Reference) == 24, "Chunk_Reference must not be padded");
+
+/* An index section follows the files section, padded to start at a multiple of 8 bytes from the start of the bundle,
+ * and runs to the end of the bundle: an Index_Header, an Index_Entry per file in bundle order and an open addressing
+ * hash table of Index_Slots. Everything in it is a fixed size integer and every position is an offset from the start
+ * of the bundle, so a mapped bundle is searched in place, with nothing to parse or fix up, see Basic_Indexed_Reader.
+ */
+constexpr std::uint64_t INDEX = 2;
+
+struct Index_Header
+{
+  std::uint64_t file_count = 0;
+  std::uint64_t slot_count = 0; // A power of two, at least twice the file count.
+};
+
+struct Index_Entry
+{
+  std::uint64_t path_offset = 0;
+  std::uint64_t path_size = 0; // Without the null-terminator.
+  std::uint64_t offset = 0;
+  std::uint64_t size = 0;
+};
+
+/* Slots are probed linearly from hash_path() & (slot_count - 1) up to the first empty one (index 0). */
+struct Index_Slot
+{
+  std::uint64_t hash = 0;
+  std::uint64_t index = 0; // Index of the file + 1, 0 for an empty slot.
+};
+
+static_assert(sizeof(Index_Header) == 16 && sizeof(Index_Entry) == 32 && sizeof(Index_Slot) == 16, "Index structures must not be padded");
+
+/* Paths, sizes and offsets of the bundled files, in bundle order. */
+struct Metadata
+{
+  Header header;
+
+  /* HEADER_FLAGS bits of the bundle, masked out of header.sizes_section_size. */
+  std::uint64_t flags = 0;
+
+  /* Starting offset in bytes of each section from the beginning of the bundle. */
+  std::uint64_t paths_section_offset = 0;
+  std::uint64_t sizes_section_offset = 0;
+  std::uint64_t files_section_offset = 0;
+
+  std::vector<std::string> paths;
+  std::vector<std::uint64_t> sizes;
+
+  /* Absolute offset of each file's contents.
+   * With CHUNK_REFERENCES these are offsets into the plain bundle a Chunk_Source presents.
+   */
+  std::vector<std::uint64_t> offsets;
+};
+
+/* Reads and validates the metadata of a bundle.
+ * Every header field is checked against the size of the source before anything is allocated,
+ * so a corrupt or malicious header can't trigger allocations larger than the bundle itself.
+ * Runs in O(metadata), the files section is never touched.
+ * Sections are located by offset rather than read back to back, the stream position is left as is.
+ */
+template <typename Source>
+int parse_metadata(Source& p_source, Metadata& p_metadata)
+{
+  int status = STATUS::OK;
+  Header& header = p_metadata.header;
+  std::uint64_t source_size = p_source.get_size();
+
+  if (source_size < sizeof(Header))
+  {
+    return STATUS::TRUNCATED;
+  }
+
+  if ( (status = p_source.read_at(0, reinterpret_cast<std::uint8_t*>(&header), sizeof(Header))) != STATUS::OK )
+  {
+    return status;
+  }
+
+  p_metadata.flags = header.sizes_section_size & HEADER_FLAGS;
+  header.sizes_section_size -= p_metadata.flags;
+
+  if ( (p_metadata.flags & ~(CHUNK_REFERENCES | INDEX)) != 0 )
+  {
+    return STATUS::CORRUPT;
+  }
+
+  /* Each section must fit in what is left of the source.
+   * Subtracting instead of adding keeps corrupt sizes from overflowing.
+   */
+  std::uint64_t remaining = source_size - sizeof(Header);
+
+  if (header.paths_section_size > remaining)
+  {
+    return STATUS::TRUNCATED;
+  }
+
+  remaining -= header.paths_section_size;
+
+  if (header.sizes_section_size > remaining)
+  {
+    return STATUS::TRUNCATED;
+  }
+
+  remaining -= header.sizes_section_size;
+
+  if (header.files_section_size > remaining)
+  {
+    return STATUS::TRUNCATED;
+  }
+
+  std::uint64_t number_of_files = header.sizes_section_size / sizeof(std::uint64_t);
+
+  /* Every path takes at least its null-terminator. */
+  if (header.sizes_section_size % sizeof(std::uint64_t) != 0 || number_of_files > header.paths_section_size)
+  {
+    return STATUS::CORRUPT;
+  }
+
+  /* All sections are now known to be backed by the source, so none of these can overflow. */
+  p_metadata.paths_section_offset = sizeof(Header);
+  p_metadata.sizes_section_offset = p_metadata.paths_section_offset + header.paths_section_size;
+  p_metadata.files_section_offset = p_metadata.sizes_section_offset + header.sizes_section_size;
+
+  /* Reading the metadata sections whole is safe as well. */
+  std::vector<char> paths_section(header.paths_section_size);
+
+  if ( (status = p_source.read_at(p_metadata.paths_section_offset, reinterpret_cast<std::uint8_t*>(paths_section.data()), paths_section.size())) != STATUS::OK )
+  {
+    return status;
+  }
+
+  /* Path count must match size count and the last path must be terminated. */
+  if (static_cast<std::uint64_t>(std::count(paths_section.begin(), paths_section.end(), '\0')) != number_of_files ||
+      (!paths_section.empty() && paths_section.back() != '\0'))
+  {
+    return STATUS::CORRUPT;
+  }
+
+  p_metadata.sizes.resize(number_of_files);
+
+  if ( (status = p_source.read_at(p_metadata.sizes_section_offset, reinterpret_cast<std::uint8_t*>(p_metadata.sizes.data()), header.sizes_section_size)) != STATUS::OK )
+  {
+    return status;
+  }
+
+  /* Sizes must add up to the files section, without overflowing on the way.
+   * Chunk references are checked against the sizes once they are read, see read_chunk_references().
+   */
+  bool chunked = (p_metadata.flags & CHUNK_REFERENCES) != 0;
+  std::uint64_t files_left = chunked ? UINT64_MAX - p_metadata.files_section_offset : header.files_section_size;
+  std::uint64_t file_offset = p_metadata.files_section_offset;
+
+  if (chunked && header.files_section_size % sizeof(Chunk_Reference) != 0)
+  {
+    return STATUS::CORRUPT;
+  }
+
+  p_metadata.offsets.reserve(number_of_files);
+
+  for (auto file_size : p_metadata.sizes)
+  {
+    if (file_size > files_left)
+    {
+      return STATUS::CORRUPT;
+    }
+
+    p_metadata.offsets.push_back(file_offset);
+    file_offset += file_size;
+    files_left -= file_size;
+  }
+
+  if (files_left != 0 && !chunked)
+  {
+    return STATUS::CORRUPT;
+  }
+
+  p_metadata.paths.reserve(number_of_files);
+
+  for (const char* path = paths_section.data(); path != paths_section.data() + paths_section.size(); path += p_metadata.paths.back().size() + 1)
+  {
+    p_metadata.paths.emplace_back(path);
+  }
+
+  return STATUS::OK;
+}
+
+/* Splits a bundled path on both separator styles, bundles may come from any platform.
+ * Returns false if the path is empty, absolute or would escape the directory it is extracted to.
+ */
+inline bool split_path(const std::string& p_path, std::vector<std::string>& p_components)
+{
+  p_components.clear();
+
+  if (p_path.empty() || p_path[0] == '/' || p_path[0] == '\\')
+  {
+    return false;
+  }
+
+  /* Drive letter, e.g. "C:" */
+  if (p_path.size() >= 2 && p_path[1] == ':')
+  {
+    return false;
+  }
+
+  std::string component;
+
+  for (std::size_t i = 0; i <= p_path.size(); i++)
+  {
+    if (i < p_path.size() && p_path[i] != '/' && p_path[i] != '\\')
+    {
+      component += p_path[i];
+      continue;
+    }
+
+    if (component == "..")
+    {
+      return false;
+    }
+
+    /* Skip empty and "." components. */
+    if (!component.empty() && component != ".")
+    {
+      p_components.push_back(std::move(component));
+    }
+
+    component.clear();
+  }
+
+  return !p_components.empty();
+}
+
+/* Creates files below an output directory.
+ * On POSIX the output root is opened once and every file is created with openat() relative to a cached
+ * descriptor of its parent directory, so the kernel never re-walks the full path and symlinks planted
+ * inside the tree can't redirect writes outside of it.
+ */
+class Output_Directory
+{
+  private:
+  std::string root_path;
+
+  /* Guards the directory cache, files themselves are opened outside of it. */
+  std::mutex directories_mutex;
+
+  Tracer* tracer = nullptr;
+
+#ifdef FILE_BUNDLER_POSIX
+  int root = -1;
+
+  /* Relative directory path -> open descriptor. */
+  std::unordered_map<std::string, int> directories;
+
+  int open_directory(int p_parent, const std::string& p_name)
+  {
+    Trace_Span span(this->tracer, "create directory", p_name);
+
+    if (::mkdirat(p_parent, p_name.c_str(), 0777) != 0 && errno != EEXIST)
+    {
+      return -1;
+    }
+
+    return ::openat(p_parent, p_name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  }
+
+  /* Descriptor of the directory holding the last of p_components, created as needed. -1 on failure. */
+  int open_parent(const std::vector<std::string>& p_components)
+  {
+    int parent = this->root;
+    std::string directory_path;
+    std::lock_guard<std::mutex> lock(this->directories_mutex);
+
+    for (std::size_t i = 0; i + 1 < p_components.size(); i++)
+    {
+      directory_path += p_components[i];
+      directory_path += '/';
+
+      auto cached = this->directories.find(directory_path);
+
+      if (cached != this->directories.end())
+      {
+        parent = cached->second;
+        continue;
+      }
+
+      if ( (parent = open_directory(parent, p_components[i])) < 0 )
+      {
+        return -1;
+      }
+
+      this->directories.emplace(directory_path, parent);
+    }
+
+    return parent;
+  }
+
+  /* Cleared once the output file system turns down a reflink, so it isn't retried for every file. */
+  std::atomic<bool> reflinks{true};
+#else
+  fs::path create_parent(const std::vector<std::string>& p_components)
+  {
+    fs::path file_path = this->root_path;
+
+    for (const auto& component : p_components)
+    {
+      file_path /= component;
+    }
+
+    std::error_code error;
+    Trace_Span span(this->tracer, "create directory", file_path.parent_path().string());
+    fs::create_directories(file_path.parent_path(), error);
+    return file_path;
+  }
+#endif
+
+  public:
+  /* Returns false if the output directory can't be created or opened. */
+  bool open(const std::string& p_root_path)
+  {
+    this->root_path = p_root_path.empty() ? "." : p_root_path;
+
+    std::error_code error;
+    fs::create_directories(this->root_path, error);
+
+#ifdef FILE_BUNDLER_POSIX
+    this->root = ::open(this->root_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return this->root >= 0;
+#else
+    return fs::is_directory(this->root_path, error);
+#endif
+  }
+
+  /* Records a "create directory" span for every directory looked up or created. */
+  void set_tracer(Tracer* p_tracer)
+  {
+    this->tracer = p_tracer;
+  }
+
+  /* Stream type files are created as. */
+  using File_Sink = Disk_Stream;
+
+  /* Opens p_stream for writing at p_path (relative to the output directory), creating parent directories as needed.
+   * Without p_truncate an existing file is kept as is, for writing parts of it with write_at().
+   * Safe to call from several threads at once.
+   */
+  int open_file(const std::string& p_path, File_Sink& p_stream, bool p_truncate = true)
+  {
+    std::vector<std::string> components;
+
+    if (!split_path(p_path, components))
+    {
+      return STATUS::UNSAFE_PATH;
+    }
+
+#ifdef FILE_BUNDLER_POSIX
+    int parent = open_parent(components);
+    int descriptor = parent < 0 ? -1 : ::openat(parent, components.back().c_str(), O_WRONLY | O_CREAT | (p_truncate ? O_TRUNC : 0) | O_NOFOLLOW | O_CLOEXEC, 0666);
+
+    if (descriptor < 0)
+    {
+      return STATUS::IO_ERROR;
+    }
+
+    p_stream.open(descriptor);
+#else
+    auto file_path = create_parent(components);
+    p_stream.open(file_path.string(), p_truncate ? std::ios::out | std::ios::binary | std::ios::trunc : std::ios::in | std::ios::out | std::ios::binary);
+#endif
+
+    return STATUS::OK;
+  }
+
+  /* Makes p_path (relative to the output directory) a copy of the file at p_source_path, without copying data
+   * where the file system supports reflinks (copy-on-write clones). Otherwise a hard link with p_hard_link, which
+   * shares the file itself, and a plain copy when that doesn't work either (e.g. across file systems).
+   * Replaces an existing file at p_path. Safe to call from several threads at once.
+   */
+  int link_file(const std::string& p_path, const std::string& p_source_path, bool p_hard_link = false)
+  {
+    std::vector<std::string> components;
+
+    if (!split_path(p_path, components))
+    {
+      return STATUS::UNSAFE_PATH;
+    }
+
+#ifdef FILE_BUNDLER_POSIX
+    int parent = open_parent(components);
+    const char* name = components.back().c_str();
+
+    if (parent < 0 || (::unlinkat(parent, name, 0) != 0 && errno != ENOENT))
+    {
+      return STATUS::IO_ERROR;
+    }
+
+#ifdef FICLONE
+    if (this->reflinks)
+    {
+      Descriptor_Stream source(p_source_path, std::ios::in | std::ios::binary);
+      int descriptor = ::openat(parent, name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0666);
+
+      bool cloned = descriptor >= 0 && source.is_open() && ::ioctl(descriptor, FICLONE, source.get_descriptor()) == 0;
+
+      if (descriptor >= 0)
+      {
+        ::close(descriptor);
+      }
+
+      if (cloned)
+      {
+        return STATUS::OK;
+      }
+
+      if (descriptor >= 0)
+      {
+        ::unlinkat(parent, name, 0);
+        this->reflinks = !source.is_open();
+      }
+    }
+#endif
+
+    if (p_hard_link && ::linkat(AT_FDCWD, p_source_path.c_str(), parent, name, 0) == 0)
+    {
+      return STATUS::OK;
+    }
+#else
+    std::error_code error;
+    auto file_path = create_parent(components);
+    fs::remove(file_path, error);
+
+    if (p_hard_link && (fs::create_hard_link(p_source_path, file_path, error), !error))
+    {
+      return STATUS::OK;
+    }
+#endif
+
+    Disk_Stream source(p_source_path, std::ios::in | std::ios::binary);
+    File_Sink sink;
+    std::vector<std::uint8_t> chunk;
+    int status = STATUS::OK;
+
+    if ( (status = open_file(p_path, sink)) != STATUS::OK || (status = copy(source, 0, source.get_size(), sink, chunk)) != STATUS::OK )
+    {
+      return status;
+    }
+
+    return flush(sink);
+  }
+
+  Output_Directory() {}
+
+  Output_Directory(const Output_Directory&) = delete;
+  Output_Directory& operator=(const Output_Directory&) = delete;
+
+  ~Output_Directory()
+  {
+#ifdef FILE_BUNDLER_POSIX
+    for (auto& directory : this->directories)
+    {
+      ::close(directory.second);
+    }
+
+    if (this->root >= 0)
+    {
+      ::close(this->root);
+    }
+#endif
+  }
+};
+
+/* 128-bit content hash (MurmurHash3 x64_128), fed incrementally.
+ * Fast enough to hash at disk speed, but not cryptographic: content hashes identify data from trusted producers,
+ * a crafted bundle could collide with another bundle's entries. The chunk store compares contents before reusing
+ * a chunk; the extraction cache, which takes bundles from anywhere, keys its objects with Sha256 instead.
+ */
+class Hasher
+{
+  private:
+  std::uint64_t h1 = 0;
+  std::uint64_t h2 = 0;
+  std::uint64_t length = 0;
+
+  /* Bytes of an incomplete 16-byte block carried over to the next update(). */
+  std::uint8_t tail[16] = {};
+  std::uint64_t tail_size = 0;
+
+  static constexpr std::uint64_t C1 = 0x87c37b91114253d5ULL;
+  static constexpr std::uint64_t C2 = 0x4cf5ad432745937fULL;
+
+  static std::uint64_t rotate(std::uint64_t p_value, int p_bits)
+  {
+    return (p_value << p_bits) | (p_value >> (64 - p_bits));
+  }
+
+  static std::uint64_t mix(std::uint64_t p_value)
+  {
+    p_value ^= p_value >> 33;
+    p_value *= 0xff51afd7ed558ccdULL;
+    p_value ^= p_value >> 33;
+    p_value *= 0xc4ceb9fe1a85ec53ULL;
+    p_value ^= p_value >> 33;
+    return p_value;
+  }
+
+  void block(const std::uint8_t* p_address)
+  {
+    std::uint64_t k1 = 0;
+    std::uint64_t k2 = 0;
+    std::memcpy(&k1, p_address, sizeof(k1));
+    std::memcpy(&k2, p_address + 8, sizeof(k2));
+
+    this->h1 ^= rotate(k1 * C1, 31) * C2;
+    this->h1 = (rotate(this->h1, 27) + this->h2) * 5 + 0x52dce729;
+    this->h2 ^= rotate(k2 * C2, 33) * C1;
+    this->h2 = (rotate(this->h2, 31) + this->h1) * 5 + 0x38495ab5;
+  }
+
+  public:
+  void update(const std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    /* p_address may be null then, which memcpy() doesn't allow even for 0 bytes. */
+    if (p_size == 0)
+    {
+      return;
+    }
+
+    this->length += p_size;
+
+    if (this->tail_size != 0)
+    {
+      auto size = std::min(p_size, 16 - this->tail_size);
+      std::memcpy(this->tail + this->tail_size, p_address, size);
+      this->tail_size += size;
+      p_address += size;
+      p_size -= size;
+
+      if (this->tail_size < 16)
+      {
+        return;
+      }
+
+      block(this->tail);
+      this->tail_size = 0;
+    }
+
+    for (; p_size >= 16; p_address += 16, p_size -= 16)
+    {
+      block(p_address);
+    }
+
+    if (p_size != 0)
+    {
+      std::memcpy(this->tail, p_address, p_size);
+    }
+
+    this->tail_size = p_size;
+  }
+
+  /* Hash of everything passed to update() so far. */
+  void finish(std::uint64_t (&p_digest)[2])
+  {
+    std::uint64_t k1 = 0;
+    std::uint64_t k2 = 0;
+    auto h1 = this->h1;
+    auto h2 = this->h2;
+
+    for (std::uint64_t i = this->tail_size; i > 8; i--)
+    {
+      k2 = (k2 << 8) | this->tail[i - 1];
+    }
+
+    for (std::uint64_t i = std::min<std::uint64_t>(this->tail_size, 8); i > 0; i--)
+    {
+      k1 = (k1 << 8) | this->tail[i - 1];
+    }
+
+    if (this->tail_size > 8)
+    {
+      h2 ^= rotate(k2 * C2, 33) * C1;
+    }
+
+    if (this->tail_size > 0)
+    {
+      h1 ^= rotate(k1 * C1, 31) * C2;
+    }
+
+    h1 ^= this->length;
+    h2 ^= this->length;
+    h1 += h2;
+    h2 += h1;
+    h1 = mix(h1);
+    h2 = mix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    p_digest[0] = h1;
+    p_digest[1] = h2;
+  }
+
+  /* Same as 32 hex digits. */
+  std::string finish()
+  {
+    std::uint64_t digest[2];
+    finish(digest);
+    return to_hex(digest);
+  }
+
+  static std::string to_hex(const std::uint64_t (&p_digest)[2])
+  {
+    char digits[33];
+    std::snprintf(digits, sizeof(digits), "%016llx%016llx", static_cast<unsigned long long>(p_digest[0]), static_cast<unsigned long long>(p_digest[1]));
+    return digits;
+  }
+};
+
+/* SHA-256 (FIPS 180-4), fed incrementally. Slower than Hasher, but collisions can't be crafted. */
+class Sha256
+{
+  private:
+  std::uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  std::uint64_t length = 0;
+
+  /* Bytes of an incomplete 64-byte block carried over to the next update(). */
+  std::uint8_t tail[64] = {};
+  std::uint64_t tail_size = 0;
+
+  static constexpr std::uint32_t K[64] =
+  {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+  static std::uint32_t rotate(std::uint32_t p_value, int p_bits)
+  {
+    return (p_value >> p_bits) | (p_value << (32 - p_bits));
+  }
+
+  void block(const std::uint8_t* p_address)
+  {
+    std::uint32_t w[64];
+
+    for (int i = 0; i < 16; i++)
+    {
+      w[i] = (static_cast<std::uint32_t>(p_address[4 * i]) << 24) | (static_cast<std::uint32_t>(p_address[4 * i + 1]) << 16) |
+             (static_cast<std::uint32_t>(p_address[4 * i + 2]) << 8) | static_cast<std::uint32_t>(p_address[4 * i + 3]);
+    }
+
+    for (int i = 16; i < 64; i++)
+    {
+      std::uint32_t s0 = rotate(w[i - 15], 7) ^ rotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      std::uint32_t s1 = rotate(w[i - 2], 17) ^ rotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    std::uint32_t a = this->state[0], b = this->state[1], c = this->state[2], d = this->state[3];
+    std::uint32_t e = this->state[4], f = this->state[5], g = this->state[6], h = this->state[7];
+
+    for (int i = 0; i < 64; i++)
+    {
+      std::uint32_t t1 = h + (rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+      std::uint32_t t2 = (rotate(a, 2) ^ rotate(a, 13) ^ rotate(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+
+    this->state[0] += a;
+    this->state[1] += b;
+    this->state[2] += c;
+    this->state[3] += d;
+    this->state[4] += e;
+    this->state[5] += f;
+    this->state[6] += g;
+    this->state[7] += h;
+  }
+
+  public:
+  void update(const std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    /* p_address may be null then, which memcpy() doesn't allow even for 0 bytes. */
+    if (p_size == 0)
+    {
+      return;
+    }
+
+    this->length += p_size;
+
+    if (this->tail_size != 0)
+    {
+      auto size = std::min(p_size, 64 - this->tail_size);
+      std::memcpy(this->tail + this->tail_size, p_address, size);
+      this->tail_size += size;
+      p_address += size;
+      p_size -= size;
+
+      if (this->tail_size < 64)
+      {
+        return;
+      }
+
+      block(this->tail);
+      this->tail_size = 0;
+    }
+
+    for (; p_size >= 64; p_address += 64, p_size -= 64)
+    {
+      block(p_address);
+    }
+
+    if (p_size != 0)
+    {
+      std::memcpy(this->tail, p_address, p_size);
+    }
+
+    this->tail_size = p_size;
+  }
+
+  /* Hash of everything passed to update() so far, as 64 hex digits. Leaves the hasher spent. */
+  std::string finish()
+  {
+    std::uint64_t bits = this->length * 8;
+    std::uint8_t padding[72] = {0x80};
+    std::uint64_t padding_size = (this->tail_size < 56 ? 56 : 120) - this->tail_size;
+
+    for (int i = 0; i < 8; i++)
+    {
+      padding[padding_size + i] = static_cast<std::uint8_t>(bits >> (56 - 8 * i));
+    }
+
+    update(padding, padding_size + 8);
+
+    char digits[65];
+
+    for (int i = 0; i < 8; i++)
+    {
+      std::snprintf(digits + 8 * i, 9, "%08lx", static_cast<unsigned long>(this->state[i]));
+    }
+
+    return std::string(digits, 64);
+  }
+};
+
+/* Hash of a bundled path in an index, see INDEX. */
+inline std::uint64_t hash_path(const char* p_path, std::uint64_t p_size)
+{
+  Hasher hasher;
+  std::uint64_t digest[2];
+
+  hasher.update(reinterpret_cast<const std::uint8_t*>(p_path), p_size);
+  hasher.finish(digest);
+  return digest[0];
+}
+
+/* Builds the index section of a bundle from its metadata block (header, paths and sizes sections, as written),
+ * p_header being its header without flags. p_index starts with the padding that follows the files section.
+ */
+inline void build_index(const std::uint8_t* p_metadata, const Header& p_header, std::vector<std::uint8_t>& p_index)
+{
+  Index_Header index_header;
+  index_header.file_count = p_header.sizes_section_size / sizeof(std::uint64_t);
+  index_header.slot_count = 2;
+
+  while (index_header.slot_count < 2 * index_header.file_count)
+  {
+    index_header.slot_count *= 2;
+  }
+
+  std::uint64_t files_end = sizeof(Header) + p_header.paths_section_size + p_header.sizes_section_size + p_header.files_section_size;
+  std::uint64_t padding = (8 - files_end % 8) % 8;
+
+  p_index.assign(padding + sizeof(Index_Header) + index_header.file_count * sizeof(Index_Entry) + index_header.slot_count * sizeof(Index_Slot), 0);
+  std::memcpy(p_index.data() + padding, &index_header, sizeof(Index_Header));
+
+  auto entries = p_index.data() + padding + sizeof(Index_Header);
+  auto slots = entries + index_header.file_count * sizeof(Index_Entry);
+  auto path = reinterpret_cast<const char*>(p_metadata + sizeof(Header));
+  auto sizes = p_metadata + sizeof(Header) + p_header.paths_section_size;
+  std::uint64_t offset = sizeof(Header) + p_header.paths_section_size + p_header.sizes_section_size;
+
+  for (std::uint64_t i = 0; i < index_header.file_count; i++)
+  {
+    Index_Entry entry;
+    entry.path_offset = path - reinterpret_cast<const char*>(p_metadata);
+    entry.path_size = std::strlen(path);
+    entry.offset = offset;
+    std::memcpy(&entry.size, sizes + i * sizeof(std::uint64_t), sizeof(std::uint64_t));
+    std::memcpy(entries + i * sizeof(Index_Entry), &entry, sizeof(Index_Entry));
+
+    Index_Slot slot;
+    slot.hash = hash_path(path, entry.path_size);
+    slot.index = i + 1;
+
+    for (std::uint64_t position = slot.hash & (index_header.slot_count - 1); ; position = (position + 1) & (index_header.slot_count - 1))
+    {
+      Index_Slot existing;
+      std::memcpy(&existing, slots + position * sizeof(Index_Slot), sizeof(Index_Slot));
+
+      if (existing.index == 0)
+      {
+        std::memcpy(slots + position * sizeof(Index_Slot), &slot, sizeof(Index_Slot));
+        break;
+      }
+
+      /* Duplicate paths find the first one, as with Basic_Reader. */
+      if (existing.hash == slot.hash)
+      {
+        Index_Entry other;
+        std::memcpy(&other, entries + (existing.index - 1) * sizeof(Index_Entry), sizeof(Index_Entry));
+
+        if (other.path_size == entry.path_size && std::memcmp(p_metadata + other.path_offset, path, entry.path_size) == 0)
+        {
+          break;
+        }
+      }
+    }
+
+    offset += entry.size;
+    path += entry.path_size + 1;
+  }
+}
+
+/* Lists the files at p_paths with their current sizes into p_files (File objects).
+ * Returns STATUS::IO_ERROR if any of them can't be sized (missing, unreadable, not a regular file).
+ */
+template <typename Files>
+int list_files(const std::vector<std::string>& p_paths, Files& p_files)
+{
+  std::error_code error;
+
+  p_files.reserve(p_paths.size());
+
+  for (const auto& path : p_paths)
+  {
+    auto size = fs::file_size(path, error);
+
+    if (error)
+    {
+      return STATUS::IO_ERROR;
+    }
+
+    p_files.push_back({path, size});
+  }
+
+  return STATUS::OK;
+}
+
+/* Size of a bundle of p_files (File objects), so bundles built in memory take a single allocation.
+ * Chunk store bundles are counted without their references, which are much smaller than the contents they replace.
+ */
+template <typename Files>
+std::uint64_t get_bundle_size(const Files& p_files, const Options& p_options)
+{
+  std::uint64_t size = sizeof(Header);
+
+  for (const auto& file : p_files)
+  {
+    size += file.get_path().size() + 1 + sizeof(std::uint64_t) + (p_options.chunk_store.empty() ? file.get_size() : 0);
+  }
+
+  if (p_options.index && p_options.chunk_store.empty())
+  {
+    std::uint64_t slot_count = 2;
+
+    while (slot_count < 2 * p_files.size())
+    {
+      slot_count *= 2;
+    }
+
+    size += 7 + sizeof(Index_Header) + p_files.size() * sizeof(Index_Entry) + slot_count * sizeof(Index_Slot);
+  }
+
+  return size;
+}
+
+/* Content-defined chunking for the chunk store, see Options::chunk_store.
+ * Cut points are picked by a rolling gear hash of the last 64 bytes rather than by position, so an insertion
+ * or deletion only changes the chunks around it and the rest of a file still matches the previous version's chunks.
+ * Chunks are CHUNK_MIN_SIZE to CHUNK_MAX_SIZE bytes, CHUNK_MIN_SIZE + 64 KiB on average; a file's last chunk may be shorter.
+ */
+constexpr std::uint64_t CHUNK_MIN_SIZE = 16 << 10;
+constexpr std::uint64_t CHUNK_MAX_SIZE = 256 << 10;
+constexpr std::uint64_t CHUNK_MASK = (1 << 16) - 1;
+
+class Chunker
+{
+  private:
+  std::vector<std::uint8_t> buffer;
+  std::uint64_t hash = 0;
+  std::uint64_t length = 0;
+
+  /* 256 pseudo-random words (splitmix64), fixed forever since they decide where chunks are cut. */
+  static const std::uint64_t* get_gear()
+  {
+    static const auto gear = []
+    {
+      std::vector<std::uint64_t> words(256);
+      std::uint64_t state = 0;
+
+      for (auto& word : words)
+      {
+        std::uint64_t value = (state += 0x9e3779b97f4a7c15ULL);
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        word = value ^ (value >> 31);
+      }
+
+      return words;
+    }();
+
+    return gear.data();
+  }
+
+  public:
+  /* Feeds the next p_size bytes of a file, calling p_emit(address, size) -> status for every chunk completed. */
+  template <typename Function>
+  int update(const std::uint8_t* p_address, std::uint64_t p_size, Function p_emit)
+  {
+    const std::uint64_t* gear = get_gear();
+    std::uint64_t start = 0;
+    int status = STATUS::OK;
+
+    for (std::uint64_t i = 0; i < p_size; i++)
+    {
+      /* Bytes before the last 64 of the minimum size can't influence a cut, skip them. */
+      if (this->length + 64 < CHUNK_MIN_SIZE)
+      {
+        auto skip = std::min(CHUNK_MIN_SIZE - 64 - this->length, p_size - i);
+        this->length += skip;
+        i += skip - 1;
+        continue;
+      }
+
+      this->hash = (this->hash << 1) + gear[p_address[i]];
+      this->length++;
+
+      if ( (this->length >= CHUNK_MIN_SIZE && (this->hash & CHUNK_MASK) == 0) || this->length >= CHUNK_MAX_SIZE )
+      {
+        if (this->buffer.empty())
+        {
+          status = p_emit(p_address + start, i + 1 - start);
+        }
+        else
+        {
+          this->buffer.insert(this->buffer.end(), p_address + start, p_address + i + 1);
+          status = p_emit(this->buffer.data(), this->buffer.size());
+          this->buffer.clear();
+        }
+
+        if (status != STATUS::OK)
+        {
+          return status;
+        }
+
+        start = i + 1;
+        this->hash = 0;
+        this->length = 0;
+      }
+    }
+
+    this->buffer.insert(this->buffer.end(), p_address + start, p_address + p_size);
+    return STATUS::OK;
+  }
+
+  /* Emits what is left of the file as its last chunk and resets for the next file. */
+  template <typename Function>
+  int finish(Function p_emit)
+  {
+    int status = this->buffer.empty() ? STATUS::OK : p_emit(this->buffer.data(), this->buffer.size());
+
+    this->buffer.clear();
+    this->hash = 0;
+    this->length = 0;
+    return status;
+  }
+};
+
+/* Sampling limits of analyze(): at most ANALYSIS_FILES_PER_EXTENSION files of each extension are read, taking
+ * ANALYSIS_SAMPLE_SIZE bytes from the start, middle and end of each. Duplicate candidates (files of equal size)
+ * are compared by hashing the same three samples, for about ANALYSIS_DUPLICATE_CANDIDATES files at most.
+ * Reading grows with the number of extensions, not with the number or size of files.
+ */
+constexpr std::uint64_t ANALYSIS_SAMPLE_SIZE = 4 << 10;
+constexpr std::uint64_t ANALYSIS_FILES_PER_EXTENSION = 256;
+constexpr std::uint64_t ANALYSIS_DUPLICATE_CANDIDATES = 4096;
+
+/* Lower-cased extension of p_path including the dot, empty if there is none. */
+inline std::string get_extension(const std::string& p_path)
+{
+  auto name = p_path.find_last_of("/\\");
+  auto dot = p_path.find_last_of('.');
+
+  if (dot == std::string::npos || (name != std::string::npos && dot < name) || dot == (name == std::string::npos ? 0 : name + 1))
+  {
+    return std::string();
+  }
+
+  std::string extension = p_path.substr(dot);
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char p_character) { return static_cast<char>(std::tolower(p_character)); });
+  return extension;
+}
+
+/* Analyses p_paths / p_sizes, reading samples through p_read(index, offset, address, size) -> status. */
+template <typename Read_Function>
+Analysis analyze(const std::vector<std::string>& p_paths, const std::vector<std::uint64_t>& p_sizes, Read_Function p_read)
+{
+  Analysis analysis;
+  std::vector<std::uint8_t> sample;
+
+  /* Up to three samples of a file, fewer for small files. */
+  auto read_samples = [&](std::uint64_t p_index) -> bool
+  {
+    auto size = p_sizes[p_index];
+    auto sample_size = std::min(size, ANALYSIS_SAMPLE_SIZE);
+    std::uint64_t offsets[] = {0, size / 2 - std::min(size / 2, sample_size / 2), size - sample_size};
+    std::uint64_t sample_count = size <= ANALYSIS_SAMPLE_SIZE ? 1 : size <= 3 * ANALYSIS_SAMPLE_SIZE ? 2 : 3;
+
+    if (sample_count == 2)
+    {
+      offsets[1] = offsets[2];
+    }
+
+    sample.resize(sample_count * sample_size);
+
+    for (std::uint64_t i = 0; i < sample_count; i++)
+    {
+      if (p_read(p_index, offsets[i], sample.data() + i * sample_size, sample_size) != STATUS::OK)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  };
+
+  analysis.file_count = p_paths.size();
+  analysis.metadata_size = 3 * sizeof(std::uint64_t);
+
+  std::unordered_map<std::string, Analysis::Extension> extensions;
+  std::unordered_map<std::string, std::vector<std::uint64_t>> extension_files;
+  std::unordered_map<std::uint64_t, std::vector<std::uint64_t>> files_by_size;
+
+  for (std::uint64_t i = 0; i < p_paths.size(); i++)
+  {
+    auto size = p_sizes[i];
+    std::uint64_t size_class = 0;
+
+    while (size_class < 64 && (size >> size_class) != 0)
+    {
+      size_class++;
+    }
+
+    if (analysis.size_histogram.size() <= size_class)
+    {
+      analysis.size_histogram.resize(size_class + 1);
+      analysis.size_histogram_bytes.resize(size_class + 1);
+    }
+
+    analysis.size_histogram[size_class]++;
+    analysis.size_histogram_bytes[size_class] += size;
+    analysis.total_size += size;
+    analysis.metadata_size += p_paths[i].size() + 1 + sizeof(std::uint64_t);
+
+    auto extension = get_extension(p_paths[i]);
+    auto& entry = extensions[extension];
+    entry.extension = extension;
+    entry.file_count++;
+    entry.total_size += size;
+    extension_files[extension].push_back(i);
+
+    if (size != 0)
+    {
+      files_by_size[size].push_back(i);
+    }
+  }
+
+  /* Entropy per extension, from evenly spread files. */
+  for (auto& files : extension_files)
+  {
+    auto& entry = extensions[files.first];
+    auto stride = std::max<std::uint64_t>(1, (files.second.size() + ANALYSIS_FILES_PER_EXTENSION - 1) / ANALYSIS_FILES_PER_EXTENSION);
+    std::uint64_t counts[256] = {};
+
+    for (std::uint64_t i = 0; i < files.second.size(); i += stride)
+    {
+      if (!read_samples(files.second[i]))
+      {
+        continue;
+      }
+
+      for (auto byte : sample)
+      {
+        counts[byte]++;
+      }
+
+      entry.sampled_bytes += sample.size();
+    }
+
+    for (auto count : counts)
+    {
+      if (count != 0)
+      {
+        double probability = static_cast<double>(count) / entry.sampled_bytes;
+        entry.entropy -= probability * std::log2(probability);
+      }
+    }
+
+    entry.compressibility = entry.sampled_bytes == 0 ? 0 : 1 - entry.entropy / 8;
+    analysis.extensions.push_back(entry);
+  }
+
+  std::sort(analysis.extensions.begin(), analysis.extensions.end(), [](const Analysis::Extension& p_left, const Analysis::Extension& p_right)
+  {
+    return p_left.total_size != p_right.total_size ? p_left.total_size > p_right.total_size : p_left.extension < p_right.extension;
+  });
+
+  /* Likely duplicates: files of equal size whose samples hash the same.
+   * Groups of equal size are compared whole, in no particular order, until ANALYSIS_DUPLICATE_CANDIDATES files have been
+   * read; the groups reached stand for the rest. Only the first ANALYSIS_DUPLICATE_CANDIDATES files of a larger group are
+   * compared, and what they show is scaled up to the group, which undercounts duplicates spread across it.
+   */
+  std::uint64_t candidate_bytes = 0;
+
+  for (auto& files : files_by_size)
+  {
+    if (files.second.size() >= 2)
+    {
+      candidate_bytes += files.second.size() * files.first;
+    }
+  }
+
+  std::uint64_t sampled_count = 0;
+  std::uint64_t reached_bytes = 0;
+  double duplicate_bytes = 0;
+
+  for (auto& files : files_by_size)
+  {
+    if (files.second.size() < 2)
+    {
+      continue;
+    }
+
+    if (sampled_count >= ANALYSIS_DUPLICATE_CANDIDATES)
+    {
+      break;
+    }
+
+    auto compared_count = std::min(files.second.size(), static_cast<std::size_t>(ANALYSIS_DUPLICATE_CANDIDATES));
+    std::unordered_set<std::string> seen;
+    std::uint64_t group_sampled = 0;
+    std::uint64_t group_duplicates = 0;
+
+    for (std::uint64_t i = 0; i < compared_count; i++)
+    {
+      sampled_count++;
+
+      if (!read_samples(files.second[i]))
+      {
+        continue;
+      }
+
+      Hasher hasher;
+      hasher.update(sample.data(), sample.size());
+      group_sampled++;
+      group_duplicates += seen.insert(hasher.finish()).second ? 0 : 1;
+    }
+
+    reached_bytes += files.second.size() * files.first;
+
+    if (group_sampled != 0)
+    {
+      duplicate_bytes += static_cast<double>(group_duplicates) * files.first * files.second.size() / group_sampled;
+    }
+  }
+
+  if (reached_bytes != 0)
+  {
+    duplicate_bytes = duplicate_bytes * candidate_bytes / reached_bytes;
+  }
+
+  /* Prefix sharing between neighbours in sorted order, which is what front coding of the paths section would save. */
+  std::vector<const std::string*> sorted_paths;
+  std::uint64_t path_bytes = 0;
+  std::uint64_t shared_bytes = 0;
+
+  for (const auto& path : p_paths)
+  {
+    sorted_paths.push_back(&path);
+    path_bytes += path.size();
+  }
+
+  std::sort(sorted_paths.begin(), sorted_paths.end(), [](const std::string* p_left, const std::string* p_right) { return *p_left < *p_right; });
+
+  for (std::size_t i = 1; i < sorted_paths.size(); i++)
+  {
+    auto& previous = *sorted_paths[i - 1];
+    auto& path = *sorted_paths[i];
+    shared_bytes += std::mismatch(previous.begin(), previous.begin() + std::min(previous.size(), path.size()), path.begin()).first - previous.begin();
+  }
+
+  analysis.duplicate_ratio = analysis.total_size == 0 ? 0 : duplicate_bytes / analysis.total_size;
+  analysis.prefix_sharing = path_bytes == 0 ? 0 : static_cast<double>(shared_bytes) / path_bytes;
+  analysis.metadata_overhead = static_cast<double>(analysis.metadata_size) / (analysis.metadata_size + analysis.total_size);
+
+  /* Recommendations. */
+  double weighted_compressibility = 0;
+  std::uint64_t large_bytes = 0;
+  std::uint64_t small_count = 0;
+  std::uint64_t page_padding = 0;
+
+  for (const auto& extension : analysis.extensions)
+  {
+    weighted_compressibility += extension.compressibility * extension.total_size;
+  }
+
+  weighted_compressibility = analysis.total_size == 0 ? 0 : weighted_compressibility / analysis.total_size;
+
+  for (auto size : p_sizes)
+  {
+    large_bytes += size >= (1 << 20) ? size : 0;
+    small_count += size < (64 << 10);
+    page_padding += (4096 - size % 4096) % 4096;
+  }
+
+  auto percent = [](double p_ratio) { return std::to_string(static_cast<int>(p_ratio * 100 + 0.5)) + "%"; };
+
+  if (weighted_compressibility >= 0.4)
+  {
+    analysis.codec = "zstd";
+    analysis.notes.push_back("Sampled contents look " + percent(weighted_compressibility) + " compressible, a strong codec pays off.");
+  }
+  else if (weighted_compressibility >= 0.1)
+  {
+    analysis.codec = "lz4";
+    analysis.notes.push_back("Sampled contents look " + percent(weighted_compressibility) + " compressible, a fast codec keeps extraction at disk speed.");
+  }
+  else
+  {
+    analysis.notes.push_back("Sampled contents look incompressible (" + percent(weighted_compressibility) + "), store them as they are.");
+  }
+
+  if (analysis.codec != "none" && analysis.file_count != 0 && small_count * 2 > analysis.file_count)
+  {
+    analysis.solid_block_size = 4 << 20;
+    analysis.notes.push_back(percent(static_cast<double>(small_count) / analysis.file_count) + " of files are under 64 KiB, compress them together in 4 MiB blocks.");
+  }
+
+  if (analysis.total_size != 0 && large_bytes * 2 > analysis.total_size && page_padding * 100 < analysis.total_size)
+  {
+    analysis.alignment = 4096;
+    analysis.notes.push_back("Most bytes are in files of 1 MiB or more and page alignment costs under 1%, align files to 4096 bytes for mmap and direct I/O.");
+  }
+
+  if (analysis.duplicate_ratio >= 0.1)
+  {
+    analysis.deduplicate = true;
+    analysis.notes.push_back(percent(analysis.duplicate_ratio) + " of bytes look duplicated, use a chunk store or an extraction cache.");
+  }
+
+  if (analysis.metadata_overhead >= 0.01)
+  {
+    analysis.notes.push_back("Metadata is " + percent(analysis.metadata_overhead) + " of the bundle; " + percent(analysis.prefix_sharing) +
+                             " of path bytes repeat the previous path and could be front coded.");
+  }
+
+  return analysis;
+}
+
+/* Directory of files named by the hash of their content. Layout:
+ *   objects/<hash>   one file per distinct content, read-only
+ *   tmp/             files being written, renamed into place once complete
+ * Everything is written to tmp/ first and renamed, so several processes can share a store.
+ */
+class Object_Store
+{
+  protected:
+  std::string root_path;
+  std::atomic<std::uint64_t> temporary_count{0};
+
+  /* Unique within the cache directory across threads and processes. */
+  std::string get_temporary_path()
+  {
+#ifdef FILE_BUNDLER_POSIX
+    auto process = static_cast<std::uint64_t>(::getpid());
+#else
+    auto process = static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    return this->root_path + "/tmp/" + std::to_string(process) + '-' + std::to_string(this->temporary_count++);
+  }
+
+  /* Writes p_size bytes to p_path via tmp/, read-only with p_read_only. */
+  bool store(const std::string& p_path, const std::uint8_t* p_address, std::uint64_t p_size, bool p_read_only = false)
+  {
+    auto temporary_path = get_temporary_path();
+    std::error_code error;
+
+    {
+      Disk_Stream stream(temporary_path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+      if (stream.write(p_address, p_size) != STATUS::OK || flush(stream) != STATUS::OK)
+      {
+        fs::remove(temporary_path, error);
+        return false;
+      }
+    }
+
+    return p_read_only ? store_object_file(temporary_path, p_path) : (fs::rename(temporary_path, p_path, error), !error);
+  }
+
+  /* Makes the complete file at p_temporary_path read-only and renames it to p_path. Objects are never written
+   * to in place, so nothing that links or maps one (see Options::cache_hard_links) can change it by accident.
+   * Another thread or process may have stored the same object meanwhile; rename() replaces it with identical content.
+   */
+  static bool store_object_file(const std::string& p_temporary_path, const std::string& p_path)
+  {
+    std::error_code error;
+    fs::permissions(p_temporary_path, fs::perms::owner_read | fs::perms::group_read | fs::perms::others_read, error);
+
+    if (!error)
+    {
+      fs::rename(p_temporary_path, p_path, error);
+    }
+
+    if (error)
+    {
+      fs::remove(p_temporary_path, error);
+      return false;
+    }
+
+    return true;
+  }
+
+  public:
+  /* Returns false if the store directory can't be created. Without p_create the store is only read from. */
+  bool open(const std::string& p_root_path, bool p_create = true)
+  {
+    std::error_code error;
+    this->root_path = p_root_path;
+
+    if (!p_create)
+    {
+      return true;
+    }
+
+    for (const char* directory : {"/objects", "/tmp"})
+    {
+      fs::create_directories(this->root_path + directory, error);
+
+      if (error)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  std::string get_object_path(const std::string& p_hash)
+  {
+    return this->root_path + "/objects/" + p_hash;
+  }
+
+  /* True if the object is stored with the expected size. */
+  bool has_object(const std::string& p_hash, std::uint64_t p_size)
+  {
+    std::error_code error;
+    return fs::file_size(get_object_path(p_hash), error) == p_size && !error;
+  }
+
+  /* Reads object p_hash into p_bytes, false if it isn't stored with p_size bytes. */
+  bool load_object(const std::string& p_hash, std::uint64_t p_size, std::vector<std::uint8_t>& p_bytes)
+  {
+    if (!has_object(p_hash, p_size))
+    {
+      return false;
+    }
+
+    Disk_Stream stream(get_object_path(p_hash), std::ios::in | std::ios::binary);
+    p_bytes.resize(p_size);
+    return stream.get_size() == p_size && stream.read_at(0, p_bytes.data(), p_size) == STATUS::OK;
+  }
+
+  /* Stores p_size bytes at p_address as object p_hash, replacing any object of that name. */
+  int store_object(const std::string& p_hash, const std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    return store(get_object_path(p_hash), p_address, p_size, true) ? STATUS::OK : STATUS::IO_ERROR;
+  }
+};
+
+/* Reads the chunk references of a bundle with CHUNK_REFERENCES set, checking that each file's chunks add up to its size. */
+template <typename Source>
+int read_chunk_references(Source& p_source, const Metadata& p_metadata, std::vector<Chunk_Reference>& p_references)
+{
+  int status = STATUS::OK;
+
+  p_references.resize(p_metadata.header.files_section_size / sizeof(Chunk_Reference));
+
+  if ( (status = p_source.read_at(p_metadata.files_section_offset, reinterpret_cast<std::uint8_t*>(p_references.data()), p_metadata.header.files_section_size)) != STATUS::OK )
+  {
+    return status;
+  }
+
+  std::uint64_t reference = 0;
+
+  for (auto file_size : p_metadata.sizes)
+  {
+    for (std::uint64_t file_left = file_size; file_left != 0; file_left -= p_references[reference++].size)
+    {
+      if (reference == p_references.size() || p_references[reference].size == 0 || p_references[reference].size > file_left)
+      {
+        return STATUS::CORRUPT;
+      }
+    }
+  }
+
+  return reference == p_references.size() ? STATUS::OK : STATUS::CORRUPT;
+}
+
+/* Chunk files a Chunk_Source keeps open between reads. */
+constexpr std::uint64_t CHUNK_SOURCE_OPEN_FILES = 16;
+
+/* Presents a bundle with CHUNK_REFERENCES set as the plain bundle it stands for: the header and metadata sections
+ * come from the bundle itself (with the flag cleared and the files section sized for the contents), the files section
+ * is assembled from the chunk store. Anything that reads bundles can read through it, see is_source.
+ * The bundle itself is only read by open(), so it doesn't have to outlive the Chunk_Source.
+ */
+class Chunk_Source
+{
+  private:
+  Object_Store store;
+
+  /* Header, paths and sizes sections of the plain bundle. */
+  std::vector<std::uint8_t> metadata;
+
+  std::vector<Chunk_Reference> references;
+
+  /* Offset of each chunk within the plain bundle. */
+  std::vector<std::uint64_t> offsets;
+
+  std::uint64_t size = 0;
+
+  /* Recently read chunk files, so reads within a chunk don't each open, stat and close it. */
+  struct Open_Chunk
+  {
+    std::uint64_t hash[2] = {};
+    std::unique_ptr<Disk_Stream> stream;
+    std::uint64_t last_use = 0;
+  };
+
+  std::mutex mutex;
+  std::vector<Open_Chunk> open_chunks;
+  std::uint64_t clock = 0;
+
+  /* Takes the open file of p_reference's chunk out of the cache, or opens it; nullptr if it is missing or has the wrong size.
+   * A reader owns the stream until it gives it back, so streams that can't be read by several threads at once aren't shared.
+   */
+  std::unique_ptr<Disk_Stream> take_chunk(const Chunk_Reference& p_reference)
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+
+      for (auto open_chunk = this->open_chunks.begin(); open_chunk != this->open_chunks.end(); open_chunk++)
+      {
+        if (open_chunk->hash[0] == p_reference.hash[0] && open_chunk->hash[1] == p_reference.hash[1])
+        {
+          auto stream = std::move(open_chunk->stream);
+          this->open_chunks.erase(open_chunk);
+          return stream;
+        }
+      }
+    }
+
+    auto stream = std::make_unique<Disk_Stream>(this->store.get_object_path(Hasher::to_hex(p_reference.hash)), std::ios::in | std::ios::binary);
+    return stream->get_size() == p_reference.size ? std::move(stream) : nullptr;
+  }
+
+  /* Gives back a stream from take_chunk(), closing the least recently used one beyond CHUNK_SOURCE_OPEN_FILES. */
+  void give_back_chunk(const Chunk_Reference& p_reference, std::unique_ptr<Disk_Stream> p_stream)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    for (const auto& open_chunk : this->open_chunks)
+    {
+      /* Another reader opened the same chunk meanwhile. */
+      if (open_chunk.hash[0] == p_reference.hash[0] && open_chunk.hash[1] == p_reference.hash[1])
+      {
+        return;
+      }
+    }
+
+    this->open_chunks.push_back({{p_reference.hash[0], p_reference.hash[1]}, std::move(p_stream), ++this->clock});
+
+    if (this->open_chunks.size() > CHUNK_SOURCE_OPEN_FILES)
+    {
+      this->open_chunks.erase(std::min_element(this->open_chunks.begin(), this->open_chunks.end(),
+                                               [](const Open_Chunk& p_left, const Open_Chunk& p_right) { return p_left.last_use < p_right.last_use; }));
+    }
+  }
+
+  public:
+  /* p_metadata is the metadata of the bundle in p_source, as parsed by parse_metadata(). */
+  template <typename Source>
+  int open(Source& p_source, const Metadata& p_metadata, const std::string& p_store_path)
+  {
+    int status = STATUS::OK;
+
+    this->store.open(p_store_path, false);
+
+    if ( (status = read_chunk_references(p_source, p_metadata, this->references)) != STATUS::OK )
+    {
+      return status;
+    }
+
+    this->metadata.resize(p_metadata.files_section_offset);
+
+    if ( (status = p_source.read_at(0, this->metadata.data(), this->metadata.size())) != STATUS::OK )
+    {
+      return status;
+    }
+
+    Header header = p_metadata.header;
+    header.files_section_size = 0;
+
+    this->offsets.reserve(this->references.size());
+    this->size = this->metadata.size();
+
+    for (const auto& reference : this->references)
+    {
+      this->offsets.push_back(this->size);
+      this->size += reference.size;
+      header.files_section_size += reference.size;
+    }
+
+    std::memcpy(this->metadata.data(), &header, sizeof(Header));
+    return STATUS::OK;
+  }
+
+  std::uint64_t get_size()
+  {
+    return this->size;
+  }
+
+  int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_offset > this->size || p_size > this->size - p_offset)
+    {
+      return STATUS::TRUNCATED;
+    }
+
+    /* Metadata part. */
+    if (p_offset < this->metadata.size())
+    {
+      auto size = std::min<std::uint64_t>(p_size, this->metadata.size() - p_offset);
+      std::memcpy(p_address, this->metadata.data() + p_offset, size);
+      p_offset += size;
+      p_address += size;
+      p_size -= size;
+    }
+
+    /* Chunk holding p_offset, then the ones after it. */
+    auto chunk = std::upper_bound(this->offsets.begin(), this->offsets.end(), p_offset) - this->offsets.begin();
+
+    for (std::uint64_t index = chunk - 1; p_size != 0; index++)
+    {
+      const auto& reference = this->references[index];
+      auto chunk_offset = p_offset - this->offsets[index];
+      auto size = std::min(p_size, reference.size - chunk_offset);
+      auto chunk_stream = take_chunk(reference);
+
+      if (chunk_stream == nullptr)
+      {
+        return STATUS::MISSING_CHUNK;
+      }
+
+      int status = chunk_stream->read_at(chunk_offset, p_address, size);
+
+      if (status != STATUS::OK)
+      {
+        return status;
+      }
+
+      give_back_chunk(reference, std::move(chunk_stream));
+
+      p_offset += size;
+      p_address += size;
+      p_size -= size;
+    }
+
+    return STATUS::OK;
+  }
+};
+
+/* Extraction cache, see Options::cache_directory. Objects are named by the SHA-256 of their content. Besides them it keeps:
+ *   bundles/<key>    manifest of a bundle file: SHA-256 and size of each entry, in bundle order, keyed by the
+ *                    identity of the file (device, inode, size, times) and its metadata, see get_manifest_key()
+ */
+class Extraction_Cache : public Object_Store
+{
+  private:
+  /* Bytes per manifest record: the hash in hex, then the size. */
+  static constexpr std::uint64_t RECORD_SIZE = 64 + sizeof(std::uint64_t);
+
+  public:
+  /* One entry of a manifest. */
+  struct Entry
+  {
+    std::string hash;
+    std::uint64_t size = 0;
+  };
+
+  /* Returns false if the cache directory can't be created. */
+  bool open(const std::string& p_root_path)
+  {
+    std::error_code error;
+    return Object_Store::open(p_root_path) && (fs::create_directories(this->root_path + "/bundles", error), !error);
+  }
+
+  /* Reads the manifest stored under p_key, false if there is none or it doesn't hold p_count entries. */
+  bool load_manifest(const std::string& p_key, std::uint64_t p_count, std::vector<Entry>& p_entries)
+  {
+    Disk_Stream stream(this->root_path + "/bundles/" + p_key, std::ios::in | std::ios::binary);
+
+    if (stream.get_size() != p_count * RECORD_SIZE)
+    {
+      return false;
+    }
+
+    std::vector<std::uint8_t> records(stream.get_size());
+
+    if (stream.read_at(0, records.data(), records.size()) != STATUS::OK)
+    {
+      return false;
+    }
+
+    p_entries.resize(p_count);
+
+    for (std::uint64_t i = 0; i < p_count; i++)
+    {
+      p_entries[i].hash.assign(reinterpret_cast<const char*>(records.data() + i * RECORD_SIZE), 64);
+      std::memcpy(&p_entries[i].size, records.data() + i * RECORD_SIZE + 64, sizeof(std::uint64_t));
+    }
+
+    return true;
+  }
+
+  /* Stores p_entries as manifest under p_key. */
+  bool store_manifest(const std::string& p_key, const std::vector<Entry>& p_entries)
+  {
+    std::vector<std::uint8_t> records;
+    records.reserve(p_entries.size() * RECORD_SIZE);
+
+    for (const auto& entry : p_entries)
+    {
+      if (entry.hash.size() != 64)
+      {
+        return false;
+      }
+
+      records.insert(records.end(), entry.hash.begin(), entry.hash.end());
+      records.insert(records.end(), reinterpret_cast<const std::uint8_t*>(&entry.size), reinterpret_cast<const std::uint8_t*>(&entry.size) + sizeof(std::uint64_t));
+    }
+
+    return store(this->root_path + "/bundles/" + p_key, records.data(), records.size());
+  }
+
+  /* Manifest key of the bundle file behind p_source: its identity (device, inode, size, times) and metadata,
+   * so a bundle seen before is recognised without reading its payload. A file changed in place gets new times,
+   * hence a new key. Empty where the identity can't be told (sources other than files on POSIX).
+   */
+  template <typename Source>
+  static std::string get_manifest_key(Source& p_source, const std::vector<std::string>& p_paths, const std::vector<std::uint64_t>& p_sizes)
+  {
+#ifdef FILE_BUNDLER_POSIX
+    if constexpr (std::is_same<std::remove_cv_t<Source>, Descriptor_Stream>::value)
+    {
+      struct stat file_status;
+
+      if (::fstat(p_source.get_descriptor(), &file_status) != 0)
+      {
+        return std::string();
+      }
+
+      std::uint64_t identity[] = {static_cast<std::uint64_t>(file_status.st_dev), static_cast<std::uint64_t>(file_status.st_ino),
+                                  static_cast<std::uint64_t>(file_status.st_size), static_cast<std::uint64_t>(file_status.st_mtime),
+                                  static_cast<std::uint64_t>(file_status.st_ctime),
+#ifdef __linux__
+                                  static_cast<std::uint64_t>(file_status.st_mtim.tv_nsec), static_cast<std::uint64_t>(file_status.st_ctim.tv_nsec)
+#else
+                                  0, 0
+#endif
+                                 };
+      Sha256 hasher;
+      hasher.update(reinterpret_cast<const std::uint8_t*>(identity), sizeof(identity));
+
+      /* Paths are length-prefixed, so no two lists of paths hash alike. */
+      for (std::uint64_t i = 0; i < p_paths.size(); i++)
+      {
+        std::uint64_t fields[] = {p_paths[i].size(), p_sizes[i]};
+        hasher.update(reinterpret_cast<const std::uint8_t*>(fields), sizeof(fields));
+        hasher.update(reinterpret_cast<const std::uint8_t*>(p_paths[i].data()), p_paths[i].size());
+      }
+
+      return hasher.finish();
+    }
+#endif
+
+    (void)p_source;
+    (void)p_paths;
+    (void)p_sizes;
+    return std::string();
+  }
+
+  /* Copies p_size bytes at p_offset in p_source into the cache in a single pass, hashing them on the way.
+   * Sets p_hash to their SHA-256 and p_stored to whether they were new; if an object with that hash was already
+   * there the copy is dropped and the object kept.
+   */
+  template <typename Source>
+  int store_entry(Source& p_source, std::uint64_t p_offset, std::uint64_t p_size, std::vector<std::uint8_t>& p_chunk, std::uint64_t p_chunk_size,
+                  std::string& p_hash, bool& p_stored, Throttle* p_throttle = nullptr)
+  {
+    auto temporary_path = get_temporary_path();
+    Sha256 hasher;
+    int status = STATUS::OK;
+    std::error_code error;
+
+    if (p_chunk.size() < std::min(p_chunk_size, p_size))
+    {
+      p_chunk.resize(std::min(p_chunk_size, p_size));
+    }
+
+    {
+      Disk_Stream stream(temporary_path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+      for (std::uint64_t offset = 0; offset < p_size && status == STATUS::OK; offset += p_chunk.size())
+      {
+        auto chunk_size = std::min<std::uint64_t>(p_chunk.size(), p_size - offset);
+
+        if (p_throttle != nullptr)
+        {
+          p_throttle->acquire(chunk_size);
+        }
+
+        if ( (status = p_source.read_at(p_offset + offset, p_chunk.data(), chunk_size)) == STATUS::OK )
+        {
+          hasher.update(p_chunk.data(), chunk_size);
+          status = stream.write(p_chunk.data(), chunk_size);
+        }
+      }
+
+      if (status != STATUS::OK || (status = flush(stream)) != STATUS::OK)
+      {
+        fs::remove(temporary_path, error);
+        return status;
+      }
+    }
+
+    p_hash = hasher.finish();
+    p_stored = !has_object(p_hash, p_size);
+
+    if (!p_stored)
+    {
+      fs::remove(temporary_path, error);
+      return STATUS::OK;
+    }
+
+    return store_object_file(temporary_path, get_object_path(p_hash)) ? STATUS::OK : STATUS::IO_ERROR;
+  }
+};
+
+#ifdef FILE_BUNDLER_POSIX
+/* Wire format between Daemon and Client: every request is a Request followed by 'size' bytes of path,
+ * every reply a Response, with the bundle's descriptor attached (SCM_RIGHTS) to replies to OPEN.
+ * Both ends run on the same host, so fields are in host byte order.
+ */
+namespace REQUEST
+{
+  enum
+  {
+    OPEN,  // Path of a bundle, relative to the daemon's root. Reply: bundle id, file count, descriptor.
+    FIND,  // Path of a file in bundle 'bundle'. Reply: index, offset, size.
+    CLOSE  // The client is done with bundle 'bundle'. Reply: nothing but the status.
+  };
+}
+
+struct Request
+{
+  std::uint32_t type = 0;
+  std::uint32_t bundle = 0;
+  std::uint64_t size = 0;
+};
+
+struct Response
+{
+  std::int32_t status = STATUS::OK;
+  std::uint32_t bundle = 0;
+  std::uint64_t values[3] = {};
+};
+
+/* Longest path a request may carry. */
+constexpr std::uint64_t MAX_REQUEST_PATH = 4096;
+
+/* Connections a Daemon serves at once by default, each on a thread of its own; see Daemon::set_connection_limit(). */
+constexpr std::uint64_t DAEMON_CONNECTION_LIMIT = 256;
+
+/* Sends p_size bytes, with p_descriptor attached to the first byte if it isn't -1. */
+inline bool send_message(int p_socket, const void* p_address, std::uint64_t p_size, int p_descriptor = -1)
+{
+  auto address = static_cast<const char*>(p_address);
+
+  while (p_size != 0)
+  {
+    iovec vector = {const_cast<char*>(address), p_size};
+    msghdr message = {};
+    char control[CMSG_SPACE(sizeof(int))] = {};
+
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+
+    if (p_descriptor >= 0)
+    {
+      message.msg_control = control;
+      message.msg_controllen = sizeof(control);
+
+      cmsghdr* header = CMSG_FIRSTHDR(&message);
+      header->cmsg_level = SOL_SOCKET;
+      header->cmsg_type = SCM_RIGHTS;
+      header->cmsg_len = CMSG_LEN(sizeof(int));
+      std::memcpy(CMSG_DATA(header), &p_descriptor, sizeof(int));
+    }
+
+#ifdef MSG_NOSIGNAL
+    auto sent = ::sendmsg(p_socket, &message, MSG_NOSIGNAL);
+#else
+    auto sent = ::sendmsg(p_socket, &message, 0);
+#endif
+
+    if (sent < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (sent <= 0)
+    {
+      return false;
+    }
+
+    address += sent;
+    p_size -= sent;
+    p_descriptor = -1;
+  }
+
+  return true;
+}
+
+/* Receives exactly p_size bytes. A descriptor that comes along is stored in p_descriptor (if given) or closed. */
+inline bool receive_message(int p_socket, void* p_address, std::uint64_t p_size, int* p_descriptor = nullptr)
+{
+  auto address = static_cast<char*>(p_address);
+
+  while (p_size != 0)
+  {
+    iovec vector = {address, p_size};
+    msghdr message = {};
+    char control[CMSG_SPACE(sizeof(int))] = {};
+
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+#ifdef MSG_CMSG_CLOEXEC
+    auto received = ::recvmsg(p_socket, &message, MSG_CMSG_CLOEXEC);
+#else
+    auto received = ::recvmsg(p_socket, &message, 0);
+#endif
+
+    if (received < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (received <= 0)
+    {
+      return false;
+    }
+
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+    {
+      if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+      {
+        int descriptor = -1;
+        std::memcpy(&descriptor, CMSG_DATA(header), sizeof(int));
+
+        if (p_descriptor != nullptr && *p_descriptor < 0)
+        {
+          *p_descriptor = descriptor;
+        }
+        else
+        {
+          ::close(descriptor);
+        }
+      }
+    }
+
+    address += received;
+    p_size -= received;
+  }
+
+  return true;
+}
+
+/* Unix domain socket address for p_path, false if the path doesn't fit. */
+inline bool get_socket_address(const std::string& p_path, sockaddr_un& p_address)
+{
+  p_address = {};
+  p_address.sun_family = AF_UNIX;
+
+  if (p_path.size() >= sizeof(p_address.sun_path))
+  {
+    return false;
+  }
+
+  std::memcpy(p_address.sun_path, p_path.c_str(), p_path.size() + 1);
+  return true;
+}
+#endif
+
+} // namespace file_bundler::_
+
+class File
+{
+  private:
+  std::string path;
+  std::uint64_t size = 0;
+  std::vector<std::uint8_t> bytes;
+
+  public:
+  std::uint64_t& get_size()
+  {
+    return this->size;
+  }
+
+  const std::uint64_t& get_size() const
+  {
+    return this->size;
+  }
+
+  void set_size(std::uint64_t p_file_size)
+  {
+    this->size = p_file_size;
+  }
+
+  std::string& get_path()
+  {
+    return this->path;
+  }
+
+  const std::string& get_path() const
+  {
+    return this->path;
+  }
+
+  void set_path(const std::string& p_file_path)
+  {
+    this->path = p_file_path;
+  }
+
+  std::vector<std::uint8_t>& get_bytes()
+  {
+    return this->bytes;
+  }
+
+  const std::vector<std::uint8_t>& get_bytes() const
+  {
+    return this->bytes;
+  }
+
+  void set_bytes(std::vector<std::uint8_t> p_bytes)
+  {
+    this->bytes = std::move(p_bytes);
+  }
+
+  /* Helper (overload) for easier transfer of bytes from memory block to member vector.
+   * Just use this instead of bothering with memcpy and std::vector's methods.
+   * NOTE: Only deallocate if memory block is on the heap.
+   */
+  void set_bytes(std::uint8_t* p_address, std::uint64_t p_size, bool p_deallocate = false)
+  {
+    this->size = p_size;
+    this->bytes.assign(p_address, p_address + p_size);
+
+    if (p_deallocate)
+    {
+      delete p_address;
+    }
+  }
+
+  File(const std::string& p_file_path, std::uint8_t* p_address, std::uint64_t p_size, bool p_deallocate = false)
+  {
+    this->path = p_file_path;
+    this->set_bytes(p_address, p_size, p_deallocate);
+  }
+
+  File(std::string p_file_path, std::vector<std::uint8_t> p_bytes)
+  {
+    this->path = std::move(p_file_path);
+    this->size = p_bytes.size();
+    this->bytes = std::move(p_bytes);
+  }
+
+  File(std::string p_file_path, std::uint64_t p_size)
+  {
+    this->path = std::move(p_file_path);
+    this->size = p_size;
+  }
+
+  File() {}
+};
+
+/* Random access to the files of a bundle without extracting it.
+ * Metadata is parsed once on open; after that every read goes straight to the file's offset,
+ * so files (or parts of them) can be read in any order, and from several threads at once.
+ * Instantiated per source type; use the Reader, Memory_Reader and Mapped_Reader aliases below,
+ * or any type meeting is_source. Source may also be a reference to read through an existing object.
+ */
+template <typename Source>
+class Basic_Reader
+{
+  static_assert(is_source<std::remove_reference_t<Source>>::value, "Basic_Reader requires a source type, see is_source");
+
+  private:
+  Source source;
+  _::Metadata metadata;
+  std::unordered_map<std::string, std::uint64_t> indices;
+  int status = STATUS::IO_ERROR;
+
+  /* Set for bundles with CHUNK_REFERENCES, see set_chunk_store(). */
+  std::shared_ptr<_::Chunk_Source> chunks;
+
+  void parse()
+  {
+    if ( (this->status = _::parse_metadata(this->source, this->metadata)) != STATUS::OK )
+    {
+      return;
+    }
+
+    /* Listing works right away, reading needs the chunk store. */
+    if ( (this->metadata.flags & _::CHUNK_REFERENCES) != 0 )
+    {
+      this->status = STATUS::MISSING_CHUNK;
+    }
+
+    this->indices.reserve(this->metadata.paths.size());
+
+    for (std::uint64_t i = 0; i < this->metadata.paths.size(); i++)
+    {
+      this->indices.emplace(this->metadata.paths[i], i);
+    }
+  }
+
+  public:
+  /* STATUS::OK if the bundle was opened and its metadata is valid.
+   * STATUS::MISSING_CHUNK for bundles written to a chunk store until set_chunk_store() is called.
+   */
+  int get_status()
+  {
+    return this->status;
+  }
+
+  /* Resolves the chunk references of a bundle written with Options::chunk_store from the store at p_path. */
+  int set_chunk_store(const std::string& p_path)
+  {
+    if ( (this->metadata.flags & _::CHUNK_REFERENCES) == 0 || (this->status != STATUS::OK && this->status != STATUS::MISSING_CHUNK) )
+    {
+      return this->status;
+    }
+
+    auto chunks = std::make_shared<_::Chunk_Source>();
+
+    if ( (this->status = chunks->open(this->source, this->metadata, p_path)) == STATUS::OK )
+    {
+      this->chunks = std::move(chunks);
+    }
+
+    return this->status;
+  }
+
+  std::uint64_t get_file_count()
+  {
+    return this->metadata.paths.size();
+  }
+
+  const std::string& get_path(std::uint64_t p_index)
+  {
+    return this->metadata.paths[p_index];
+  }
+
+  std::uint64_t get_size(std::uint64_t p_index)
+  {
+    return this->metadata.sizes[p_index];
+  }
+
+  /* Absolute offset of the file's contents within the bundle. */
+  std::uint64_t get_offset(std::uint64_t p_index)
+  {
+    return this->metadata.offsets[p_index];
+  }
+
+  /* Returns the index of the file bundled as p_path, or -1 if there is none. */
+  std::int64_t find(const std::string& p_path)
+  {
+    auto index = this->indices.find(p_path);
+    return index == this->indices.end() ? -1 : static_cast<std::int64_t>(index->second);
+  }
+
+  /* Reads p_size bytes starting p_offset bytes into the file at p_index. */
+  int read(std::uint64_t p_index, std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_index >= this->metadata.paths.size())
+    {
+      return STATUS::OUT_OF_RANGE;
+    }
+
+    auto file_size = this->metadata.sizes[p_index];
+
+    if (p_offset > file_size || p_size > file_size - p_offset)
+    {
+      return STATUS::OUT_OF_RANGE;
+    }
+
+    if ( (this->metadata.flags & _::CHUNK_REFERENCES) != 0 )
+    {
+      return this->chunks == nullptr ? STATUS::MISSING_CHUNK : this->chunks->read_at(this->metadata.offsets[p_index] + p_offset, p_address, p_size);
+    }
+
+    return this->source.read_at(this->metadata.offsets[p_index] + p_offset, p_address, p_size);
+  }
+
+  /* Reads the whole file at p_index into memory. */
+  File read(std::uint64_t p_index, int* p_status = nullptr)
+  {
+    int status = STATUS::OUT_OF_RANGE;
+    File file;
+
+    /* A file larger than the address space (32-bit targets) can only be read in parts. */
+    if (p_index < this->metadata.paths.size() && this->metadata.sizes[p_index] <= file.get_bytes().max_size())
+    {
+      file = {this->metadata.paths[p_index], this->metadata.sizes[p_index]};
+      file.get_bytes().resize(file.get_size());
+      status = read(p_index, 0, file.get_bytes().data(), file.get_size());
+    }
+
+    if (p_status != nullptr)
+    {
+      *p_status = status;
+    }
+
+    /* Returned without a copy either way. */
+    if (status != STATUS::OK)
+    {
+      file = File();
+    }
+
+    return file;
+  }
+
+  /* True for bundles written to a chunk store, see set_chunk_store(). */
+  bool is_chunked()
+  {
+    return (this->metadata.flags & _::CHUNK_REFERENCES) != 0;
+  }
+
+  std::remove_reference_t<Source>& get_source()
+  {
+    return this->source;
+  }
+
+  /* Arguments are passed on to the source's constructor. */
+  template <typename... Arguments>
+  Basic_Reader(Arguments&&... p_arguments) : source(std::forward<Arguments>(p_arguments)...)
+  {
+    parse();
+  }
+};
+
+/* Bundle on disk, read with pread() on POSIX and std::fstream elsewhere. */
+using Reader = Basic_Reader<_::Disk_Stream>;
+
+/* Bundle in memory, the memory block must outlive the reader. */
+using Memory_Reader = Basic_Reader<_::Memory_Stream>;
+
+#ifdef FILE_BUNDLER_POSIX
+/* Bundle on disk, mapped into memory. */
+using Mapped_Reader = Basic_Reader<_::Mapped_Stream>;
+#endif
+
+/* Bundle read through range requests of a transport, with a block cache, see _::Remote_Stream. */
+template <typename Transport>
+using Remote_Reader = Basic_Reader<_::Remote_Stream<Transport>>;
+
+#ifdef FILE_BUNDLER_POSIX
+/* Bundle on a plain HTTP server that answers range requests. */
+using Http_Reader = Remote_Reader<_::Http_Transport>;
+#endif
+
+/* Reads bundles written with Options::index straight from the index in the bundle's memory.
+ * Opening checks the header and the index layout in constant time and keeps no per-file state, so opening cost
+ * and memory use don't grow with the number of files, and processes that map the same bundle share one copy
+ * of its metadata in the page cache. Entries are checked when they are used.
+ * The source must hold the whole bundle in memory, see has_data.
+ */
+template <typename Source>
+class Basic_Indexed_Reader
+{
+  static_assert(_::has_data<std::remove_reference_t<Source>>::value, "Basic_Indexed_Reader requires a source with get_data()");
+
+  private:
+  Source source;
+  const std::uint8_t* data = nullptr;
+  _::Index_Header index;
+
+  /* Absolute offsets of the paths and files sections (begin, end), and of the entries and slots of the index. */
+  std::uint64_t paths_offset = 0;
+  std::uint64_t paths_end = 0;
+  std::uint64_t files_offset = 0;
+  std::uint64_t files_end = 0;
+  std::uint64_t entries_offset = 0;
+  std::uint64_t slots_offset = 0;
+  int status = STATUS::IO_ERROR;
+
+  void open()
+  {
+    _::Header header;
+    std::uint64_t size = this->source.get_size();
+
+    if ( (this->data = this->source.get_data()) == nullptr )
+    {
+      return;
+    }
+
+    if (size < sizeof(_::Header))
+    {
+      this->status = STATUS::TRUNCATED;
+      return;
+    }
+
+    std::memcpy(&header, this->data, sizeof(_::Header));
+    std::uint64_t flags = header.sizes_section_size & _::HEADER_FLAGS;
+    header.sizes_section_size -= flags;
+
+    if ( (flags & ~(_::CHUNK_REFERENCES | _::INDEX)) != 0 )
+    {
+      this->status = STATUS::CORRUPT;
+      return;
+    }
+
+    if ( (flags & _::INDEX) == 0 )
+    {
+      this->status = STATUS::MISSING_INDEX;
+      return;
+    }
+
+    /* Same bounds as parse_metadata(), subtracting so corrupt sizes can't overflow. */
+    std::uint64_t remaining = size - sizeof(_::Header);
+
+    if (header.paths_section_size > remaining || header.sizes_section_size > remaining - header.paths_section_size ||
+        header.files_section_size > remaining - header.paths_section_size - header.sizes_section_size)
+    {
+      this->status = STATUS::TRUNCATED;
+      return;
+    }
+
+    this->paths_offset = sizeof(_::Header);
+    this->paths_end = this->paths_offset + header.paths_section_size;
+    this->files_offset = this->paths_end + header.sizes_section_size;
+    this->files_end = this->files_offset + header.files_section_size;
+    remaining = size - this->files_end;
+
+    /* Padding up to the index, then the index runs to the end of the bundle. */
+    std::uint64_t padding = (8 - this->files_end % 8) % 8;
+
+    if (padding + sizeof(_::Index_Header) > remaining)
+    {
+      this->status = STATUS::TRUNCATED;
+      return;
+    }
+
+    std::memcpy(&this->index, this->data + this->files_end + padding, sizeof(_::Index_Header));
+    remaining -= padding + sizeof(_::Index_Header);
+
+    /* Chunk references are never indexed, their offsets aren't into this bundle. */
+    bool valid = (flags & _::CHUNK_REFERENCES) == 0 && header.sizes_section_size % sizeof(std::uint64_t) == 0 &&
+                 this->index.file_count == header.sizes_section_size / sizeof(std::uint64_t) &&
+                 this->index.slot_count != 0 && (this->index.slot_count & (this->index.slot_count - 1)) == 0 &&
+                 this->index.slot_count / 2 >= this->index.file_count &&
+                 this->index.file_count <= remaining / sizeof(_::Index_Entry) &&
+                 this->index.slot_count == (remaining - this->index.file_count * sizeof(_::Index_Entry)) / sizeof(_::Index_Slot) &&
+                 (remaining - this->index.file_count * sizeof(_::Index_Entry)) % sizeof(_::Index_Slot) == 0;
+
+    if (!valid)
+    {
+      this->status = STATUS::CORRUPT;
+      return;
+    }
+
+    this->entries_offset = this->files_end + padding + sizeof(_::Index_Header);
+    this->slots_offset = this->entries_offset + this->index.file_count * sizeof(_::Index_Entry);
+    this->status = STATUS::OK;
+  }
+
+  /* Entry of the file at p_index, false if there is none or it points outside of its sections. */
+  bool get_entry(std::uint64_t p_index, _::Index_Entry& p_entry)
+  {
+    if (this->status != STATUS::OK || p_index >= this->index.file_count)
+    {
+      return false;
+    }
+
+    std::memcpy(&p_entry, this->data + this->entries_offset + p_index * sizeof(_::Index_Entry), sizeof(_::Index_Entry));
+
+    return p_entry.path_offset >= this->paths_offset && p_entry.path_offset < this->paths_end &&
+           p_entry.path_size < this->paths_end - p_entry.path_offset && this->data[p_entry.path_offset + p_entry.path_size] == '\0' &&
+           p_entry.offset >= this->files_offset && p_entry.offset <= this->files_end && p_entry.size <= this->files_end - p_entry.offset;
+  }
+
+  public:
+  /* STATUS::OK if the bundle was opened and its index is sound, STATUS::MISSING_INDEX if it was written without one. */
+  int get_status()
+  {
+    return this->status;
+  }
+
+  std::uint64_t get_file_count()
+  {
+    return this->status == STATUS::OK ? this->index.file_count : 0;
+  }
+
+  /* Path of the file at p_index, in the bundle's memory. Empty for a corrupt entry. */
+  std::string_view get_path(std::uint64_t p_index)
+  {
+    _::Index_Entry entry;
+    return get_entry(p_index, entry) ? std::string_view(reinterpret_cast<const char*>(this->data + entry.path_offset), entry.path_size) : std::string_view();
+  }
+
+  std::uint64_t get_size(std::uint64_t p_index)
+  {
+    _::Index_Entry entry;
+    return get_entry(p_index, entry) ? entry.size : 0;
+  }
+
+  /* Absolute offset of the file's contents within the bundle. */
+  std::uint64_t get_offset(std::uint64_t p_index)
+  {
+    _::Index_Entry entry;
+    return get_entry(p_index, entry) ? entry.offset : 0;
+  }
+
+  /* Contents of the file at p_index in the bundle's memory, nullptr if there is no such file. */
+  const std::uint8_t* get_data(std::uint64_t p_index)
+  {
+    _::Index_Entry entry;
+    return get_entry(p_index, entry) ? this->data + entry.offset : nullptr;
+  }
+
+  /* Returns the index of the file bundled as p_path, or -1 if there is none. */
+  std::int64_t find(std::string_view p_path)
+  {
+    if (this->status != STATUS::OK)
+    {
+      return -1;
+    }
+
+    std::uint64_t hash = _::hash_path(p_path.data(), p_path.size());
+    std::uint64_t mask = this->index.slot_count - 1;
+
+    /* Bounded by the slot count in case a corrupt table has no empty slot. */
+    for (std::uint64_t i = 0, position = hash & mask; i < this->index.slot_count; i++, position = (position + 1) & mask)
+    {
+      _::Index_Slot slot;
+      std::memcpy(&slot, this->data + this->slots_offset + position * sizeof(_::Index_Slot), sizeof(_::Index_Slot));
+
+      if (slot.index == 0)
+      {
+        break;
+      }
+
+      if (slot.hash == hash && get_path(slot.index - 1) == p_path)
+      {
+        return static_cast<std::int64_t>(slot.index - 1);
+      }
+    }
+
+    return -1;
+  }
+
+  /* Reads p_size bytes starting p_offset bytes into the file at p_index. */
+  int read(std::uint64_t p_index, std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    _::Index_Entry entry;
+
+    if (!get_entry(p_index, entry))
+    {
+      return p_index < get_file_count() ? STATUS::CORRUPT : STATUS::OUT_OF_RANGE;
+    }
+
+    if (p_offset > entry.size || p_size > entry.size - p_offset)
+    {
+      return STATUS::OUT_OF_RANGE;
+    }
+
+    if (p_size != 0)
+    {
+      std::memcpy(p_address, this->data + entry.offset + p_offset, p_size);
+    }
+
+    return STATUS::OK;
+  }
+
+  std::remove_reference_t<Source>& get_source()
+  {
+    return this->source;
+  }
+
+  /* Arguments are passed on to the source's constructor. */
+  template <typename... Arguments>
+  Basic_Indexed_Reader(Arguments&&... p_arguments) : source(std::forward<Arguments>(p_arguments)...)
+  {
+    open();
+  }
+};
+
+/* Indexed bundle in memory, the memory block must outlive the reader. */
+using Indexed_Memory_Reader = Basic_Indexed_Reader<_::Memory_Stream>;
+
+#ifdef FILE_BUNDLER_POSIX
+/* Indexed bundle on disk, mapped into memory. */
+using Indexed_Reader = Basic_Indexed_Reader<_::Mapped_Stream>;
+#endif
+
+/* Probes the disk holding p_path (see Options::auto_tune) and returns the I/O parameters that suit it.
+ * Results are cached per mount point, in the process and in a per user file shared by all processes
+ * (see _::get_tuning_cache_path()); p_use_cache false probes again and replaces the cached result.
+ * The disk is sampled through a temporary file next to p_path, or through p_path itself (without evicting its pages
+ * from the cache) where that directory isn't writable. Files too small to sample then, and platforms without pread(),
+ * get the defaults with 'probed' unset.
+ */
+inline Tuning tune(const std::string& p_path, bool p_use_cache = true)
+{
+  return _::get_tuning(p_path, p_use_cache);
+}
+
+/* Analyses the files at p_file_paths (as bundle() would take them) and recommends settings, see Analysis.
+ * Files that can't be read count towards sizes and paths only.
+ */
+inline Analysis analyze(const std::vector<std::string>& p_file_paths)
+{
+  std::vector<std::uint64_t> sizes;
+
+  for (const auto& file_path : p_file_paths)
+  {
+    std::error_code error;
+    auto size = fs::file_size(file_path, error);
+    sizes.push_back(error ? 0 : size);
+  }
+
+  /* Samples of a file are read one after another, so the file stays open until the next one is read. */
+  std::unique_ptr<_::Disk_Stream> file_stream;
+  std::uint64_t open_index = p_file_paths.size();
+
+  return _::analyze(p_file_paths, sizes, [&](std::uint64_t p_index, std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_index != open_index)
+    {
+      file_stream = std::make_unique<_::Disk_Stream>(p_file_paths[p_index], std::ios::in | std::ios::binary);
+      open_index = p_index;
+    }
+
+    return file_stream->read_at(p_offset, p_address, p_size);
+  });
+}
+
+/* Analyses the files of an open bundle. */
+template <typename Source>
+Analysis analyze(Basic_Reader<Source>& p_reader)
+{
+  std::vector<std::string> paths;
+  std::vector<std::uint64_t> sizes;
+
+  for (std::uint64_t i = 0; i < p_reader.get_file_count(); i++)
+  {
+    paths.push_back(p_reader.get_path(i));
+    sizes.push_back(p_reader.get_size(i));
+  }
+
+  return _::analyze(paths, sizes, [&](std::uint64_t p_index, std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    return p_reader.read(p_index, p_offset, p_address, p_size);
+  });
+}
+
+/* Analyses the bundle at p_bundle_path. */
+inline Analysis analyze(const std::string& p_bundle_path)
+{
+  Reader reader(p_bundle_path);
+  return analyze(reader);
+}
+
+#ifdef FILE_BUNDLER_POSIX
+/* Part of a bundled file, see send_entry(). */
+struct Range
+{
+  std::uint64_t offset = 0;
+
+  /* UINT64_MAX to go to the end of the file. */
+  std::uint64_t size = UINT64_MAX;
+};
+
+/* Writes the file at p_index (or the p_range part of it) to the socket or pipe p_descriptor.
+ * Bundles read with pread() are sent with sendfile() (Linux, macOS), straight from the page cache without
+ * passing through user space; memory and mapped bundles are sent from their memory; anything else (chunk stores,
+ * custom sources) goes through a buffer. Non-blocking descriptors are waited on with poll().
+ * Writing to a closed socket raises SIGPIPE unless it is ignored, as with any write to a socket.
+ * The number of bytes sent is stored in p_sent (if given), also when sending fails part way.
+ */
+template <typename Source>
+int send_entry(Basic_Reader<Source>& p_reader, std::uint64_t p_index, int p_descriptor, Range p_range = Range(), std::uint64_t* p_sent = nullptr)
+{
+  using Source_Type = std::remove_reference_t<Source>;
+  std::uint64_t sent = 0;
+  int status = STATUS::OK;
+
+  auto result = [&](int p_status)
+  {
+    if (p_sent != nullptr)
+    {
+      *p_sent = sent;
+    }
+
+    return p_status;
+  };
+
+  if (p_reader.get_status() != STATUS::OK || p_index >= p_reader.get_file_count() || p_range.offset > p_reader.get_size(p_index))
+  {
+    return result(p_reader.get_status() != STATUS::OK ? p_reader.get_status() : STATUS::OUT_OF_RANGE);
+  }
+
+  auto size = std::min(p_range.size, p_reader.get_size(p_index) - p_range.offset);
+  auto offset = p_reader.get_offset(p_index) + p_range.offset;
+
+  /* Writes from memory until done, returns false on errors other than a full non-blocking descriptor. */
+  auto write_all = [&](const std::uint8_t* p_address, std::uint64_t p_size) -> bool
+  {
+    for (std::uint64_t done = 0; done < p_size; )
+    {
+      auto written = ::write(p_descriptor, p_address + done, std::min(p_size - done, _::MAX_IO_SIZE));
+
+      if (written < 0 && !_::wait_writable(p_descriptor))
+      {
+        return false;
+      }
+
+      if (written > 0)
+      {
+        done += written;
+        sent += written;
+      }
+    }
+
+    return true;
+  };
+
+  if (p_reader.is_chunked())
+  {
+    /* Resolved chunk by chunk, see the buffered path below. */
+  }
+  else if constexpr (std::is_same<Source_Type, _::Descriptor_Stream>::value)
+  {
+    int input = p_reader.get_source().get_descriptor();
+
+    while (sent < size)
+    {
+      auto count = std::min(size - sent, _::MAX_IO_SIZE);
+#if defined(__linux__)
+      off_t position = offset + sent;
+      auto written = ::sendfile(p_descriptor, input, &position, count);
+#elif defined(__APPLE__)
+      off_t length = count;
+      auto written = ::sendfile(input, p_descriptor, offset + sent, &length, nullptr, 0) == 0 || length > 0 ? length : -1;
+#else
+      ssize_t written = -1;
+      errno = ENOSYS;
+#endif
+
+      if (written > 0)
+      {
+        sent += written;
+        continue;
+      }
+
+      if (written == 0)
+      {
+        /* The bundle shrank under us. */
+        return result(STATUS::TRUNCATED);
+      }
+
+      if (errno == EINVAL || errno == ENOSYS || errno == ENOTSUP || errno == EOPNOTSUPP)
+      {
+        /* Descriptors sendfile() doesn't handle, carry on through a buffer. */
+        break;
+      }
+
+      if (!_::wait_writable(p_descriptor))
+      {
+        return result(STATUS::IO_ERROR);
+      }
+    }
+  }
+  else if constexpr (_::has_data<Source_Type>::value)
+  {
+    return result(write_all(p_reader.get_source().get_data() + offset, size) ? STATUS::OK : STATUS::IO_ERROR);
+  }
+
+  std::vector<std::uint8_t> buffer(std::min(size - sent, _::COPY_CHUNK_SIZE));
+
+  while (sent < size)
+  {
+    auto count = std::min<std::uint64_t>(buffer.size(), size - sent);
+
+    if ( (status = p_reader.read(p_index, p_range.offset + sent, buffer.data(), count)) != STATUS::OK )
+    {
+      return result(status);
+    }
+
+    if (!write_all(buffer.data(), count))
+    {
+      return result(STATUS::IO_ERROR);
+    }
+  }
+
+  return result(STATUS::OK);
+}
+#endif
+
+#ifdef MFD_ALLOW_SEALING
+/* A bundled file extracted into an anonymous, sealed memory file (memfd), see debundle_to_memory_files().
+ * Owns its descriptor, which is closed with it unless release()d.
+ */
+class Memory_File
+{
+  private:
+  std::string path;
+  std::uint64_t size = 0;
+  int descriptor = -1;
+
+  public:
+  const std::string& get_path() const
+  {
+    return this->path;
+  }
+
+  std::uint64_t get_size() const
+  {
+    return this->size;
+  }
+
+  /* Read-only descriptor of the contents, -1 if extraction failed. Close-on-exec; clear FD_CLOEXEC to hand it to a child. */
+  int get_descriptor() const
+  {
+    return this->descriptor;
+  }
+
+  /* Path the contents can be opened by within this process, e.g. for dlopen(). */
+  std::string get_descriptor_path() const
+  {
+    return "/proc/self/fd/" + std::to_string(this->descriptor);
+  }
+
+  /* Gives up ownership of the descriptor. */
+  int release()
+  {
+    int descriptor = this->descriptor;
+    this->descriptor = -1;
+    return descriptor;
+  }
+
+  Memory_File(const std::string& p_path = std::string(), std::uint64_t p_size = 0, int p_descriptor = -1) :
+    path(p_path), size(p_size), descriptor(p_descriptor) {}
+
+  Memory_File(const Memory_File&) = delete;
+  Memory_File& operator=(const Memory_File&) = delete;
+
+  Memory_File(Memory_File&& p_other) : path(std::move(p_other.path)), size(p_other.size), descriptor(p_other.release()) {}
+
+  Memory_File& operator=(Memory_File&& p_other)
+  {
+    if (this != &p_other)
+    {
+      if (this->descriptor >= 0)
+      {
+        ::close(this->descriptor);
+      }
+
+      this->path = std::move(p_other.path);
+      this->size = p_other.size;
+      this->descriptor = p_other.release();
+    }
+
+    return *this;
+  }
+
+  ~Memory_File()
+  {
+    if (this->descriptor >= 0)
+    {
+      ::close(this->descriptor);
+    }
+  }
+};
+
+/* Extracts the file at p_index into a memfd, filled through a shared mapping (a single copy, nothing touches disk)
+ * and then sealed against writing, growing and shrinking, so whoever receives it can rely on its contents.
+ * With p_executable the memfd can be passed to fexecve(), otherwise kernels that support it refuse to execute it.
+ */
+template <typename Source>
+int extract_memory_file(Basic_Reader<Source>& p_reader, std::uint64_t p_index, Memory_File& p_file, bool p_executable = false)
+{
+  p_file = Memory_File();
+
+  if (p_reader.get_status() != STATUS::OK || p_index >= p_reader.get_file_count())
+  {
+    return p_reader.get_status() != STATUS::OK ? p_reader.get_status() : STATUS::OUT_OF_RANGE;
+  }
+
+  auto size = p_reader.get_size(p_index);
+
+  if (size > SIZE_MAX)
+  {
+    return STATUS::OUT_OF_RANGE;
+  }
+
+  /* Names show up in /proc/self/fd links and are limited to 249 bytes. */
+  std::string name = p_reader.get_path(p_index).substr(0, 249);
+  unsigned int flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+
+#if defined(MFD_EXEC) && defined(MFD_NOEXEC_SEAL)
+  int descriptor = ::memfd_create(name.c_str(), flags | (p_executable ? MFD_EXEC : MFD_NOEXEC_SEAL));
+
+  /* Kernels before 6.3 don't know these flags, and their memfds are all executable. */
+  if (descriptor < 0 && errno == EINVAL)
+  {
+    descriptor = ::memfd_create(name.c_str(), flags);
+  }
+#else
+  /* Headers from before 6.3: memfds are always executable. */
+  static_cast<void>(p_executable);
+  int descriptor = ::memfd_create(name.c_str(), flags);
+#endif
+
+  if (descriptor < 0)
+  {
+    return STATUS::IO_ERROR;
+  }
+
+  Memory_File file(p_reader.get_path(p_index), size, descriptor);
+  int status = STATUS::OK;
+
+  if (::ftruncate(descriptor, size) != 0)
+  {
+    return STATUS::IO_ERROR;
+  }
+
+  if (size != 0)
+  {
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+      return STATUS::IO_ERROR;
+    }
+
+    status = p_reader.read(p_index, 0, static_cast<std::uint8_t*>(mapping), size);
+
+    /* F_SEAL_WRITE is refused while a writable shared mapping exists. */
+    ::munmap(mapping, size);
+
+    if (status != STATUS::OK)
+    {
+      return status;
+    }
+  }
+
+  if (::fcntl(descriptor, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+  {
+    return STATUS::IO_ERROR;
+  }
+
+  p_file = std::move(file);
+  return STATUS::OK;
+}
+
+/* Extracts every file of the bundle into its own memfd, see extract_memory_file(). */
+template <typename Source>
+std::vector<Memory_File> debundle_to_memory_files(Basic_Reader<Source>& p_reader, int* p_status = nullptr, bool p_executable = false)
+{
+  std::vector<Memory_File> files;
+  int status = p_reader.get_status();
+
+  files.reserve(p_reader.get_file_count());
+
+  for (std::uint64_t i = 0; i < p_reader.get_file_count() && status == STATUS::OK; i++)
+  {
+    files.emplace_back();
+    status = extract_memory_file(p_reader, i, files.back(), p_executable);
+  }
+
+  if (p_status != nullptr)
+  {
+    *p_status = status;
+  }
+
+  if (status != STATUS::OK)
+  {
+    files.clear();
+  }
+
+  return files;
+}
+
+/* Extracts every file of the bundle at p_bundle_path into its own memfd. */
+inline std::vector<Memory_File> debundle_to_memory_files(const std::string& p_bundle_path, int* p_status = nullptr, bool p_executable = false)
+{
+  Reader reader(p_bundle_path);
+  return debundle_to_memory_files(reader, p_status, p_executable);
+}
+#endif
+
+#ifdef FILE_BUNDLER_POSIX
+/* Serves bundles to the processes of a host over a Unix domain socket, see Client.
+ * Each bundle is opened and its metadata parsed once, however many clients use it. Clients get the bundle's
+ * descriptor and map it themselves, so file contents are read straight from the shared page cache;
+ * only path lookups go through the daemon.
+ * Bundles are named relative to a root directory and can't be named outside of it, not even through symlinks.
+ * A bundle stays open while any client has it open, and is closed once the last one closes it or disconnects.
+ * Bundles written to a chunk store are not served (STATUS::MISSING_CHUNK).
+ * Clients past the connection limit wait in the listen backlog until another one disconnects.
+ */
+class Daemon
+{
+  private:
+  struct Bundle
+  {
+    Reader reader;
+    std::string path;
+
+    /* Connections that have the bundle open. */
+    std::uint64_t references = 0;
+
+    Bundle(int p_descriptor, const std::string& p_path) : reader(p_descriptor), path(p_path) {}
+  };
+
+  std::string socket_path;
+  int root = -1;
+  int listener = -1;
+  std::atomic<bool> stopped{false};
+
+  /* Normalised bundle path -> id, and the open bundles by id. Ids of closed bundles are reused. */
+  std::mutex bundles_mutex;
+  std::unordered_map<std::string, std::uint32_t> ids;
+  std::vector<std::shared_ptr<Bundle>> bundles;
+
+  /* Connections being served and their threads. Threads whose client has gone are joined by run(). */
+  std::mutex connections_mutex;
+  std::condition_variable connection_closed;
+  std::uint64_t connection_limit = _::DAEMON_CONNECTION_LIMIT;
+  std::vector<int> connections;
+  std::vector<std::thread> threads;
+  std::vector<std::thread::id> finished_threads;
+
+  /* Opens p_components below the root, one openat() at a time without following symlinks.
+   * Returns STATUS::UNSAFE_PATH for symlinks and anything but regular files.
+   */
+  int open_below_root(const std::vector<std::string>& p_components, int& p_descriptor)
+  {
+    int directory = this->root;
+    int status = STATUS::OK;
+
+    p_descriptor = -1;
+
+    for (std::size_t i = 0; i < p_components.size(); i++)
+    {
+      bool last = i + 1 == p_components.size();
+
+      /* O_NONBLOCK keeps a FIFO from blocking the open, regular files ignore it. */
+      int descriptor = ::openat(directory, p_components[i].c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC | (last ? O_NONBLOCK : O_DIRECTORY));
+
+      if (descriptor < 0)
+      {
+        status = errno == ELOOP || errno == ENOTDIR ? STATUS::UNSAFE_PATH : STATUS::IO_ERROR;
+      }
+
+      if (directory != this->root)
+      {
+        ::close(directory);
+      }
+
+      if (descriptor < 0)
+      {
+        return status;
+      }
+
+      if (last)
+      {
+        p_descriptor = descriptor;
+      }
+      else
+      {
+        directory = descriptor;
+      }
+    }
+
+    struct stat file_status;
+
+    if (::fstat(p_descriptor, &file_status) != 0 || !S_ISREG(file_status.st_mode))
+    {
+      ::close(p_descriptor);
+      p_descriptor = -1;
+      return STATUS::UNSAFE_PATH;
+    }
+
+    return STATUS::OK;
+  }
+
+  /* Opens the bundle at p_path once, however many connections ask for it, and takes a reference to it.
+   * Returns its id, or -1 with the status in p_status.
+   */
+  std::int64_t open_bundle(const std::string& p_path, int& p_status)
+  {
+    std::vector<std::string> components;
+    std::string key;
+    int descriptor = -1;
+
+    if (!_::split_path(p_path, components))
+    {
+      p_status = STATUS::UNSAFE_PATH;
+      return -1;
+    }
+
+    /* "a/./b" and "a/b" are the same bundle. */
+    for (const auto& component : components)
+    {
+      key += key.empty() ? component : '/' + component;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(this->bundles_mutex);
+      auto id = this->ids.find(key);
+
+      if (id != this->ids.end())
+      {
+        this->bundles[id->second]->references++;
+        p_status = STATUS::OK;
+        return id->second;
+      }
+    }
+
+    /* Opened and parsed without the lock, so a large bundle doesn't hold up the connections using others. */
+    if ( (p_status = open_below_root(components, descriptor)) != STATUS::OK )
+    {
+      return -1;
+    }
+
+    auto bundle = std::make_shared<Bundle>(descriptor, key);
+
+    if ( (p_status = bundle->reader.get_status()) != STATUS::OK )
+    {
+      return -1;
+    }
+
+    bundle->references = 1;
+
+    std::lock_guard<std::mutex> lock(this->bundles_mutex);
+    auto id = this->ids.find(key);
+
+    /* Another connection opened it meanwhile: use theirs, this one is closed once the lock is released. */
+    if (id != this->ids.end())
+    {
+      this->bundles[id->second]->references++;
+      return id->second;
+    }
+
+    auto slot = std::find(this->bundles.begin(), this->bundles.end(), nullptr);
+    auto new_id = static_cast<std::uint32_t>(slot - this->bundles.begin());
+
+    if (slot == this->bundles.end())
+    {
+      this->bundles.push_back(std::move(bundle));
+    }
+    else
+    {
+      *slot = std::move(bundle);
+    }
+
+    this->ids.emplace(key, new_id);
+    return new_id;
+  }
+
+  /* Drops a reference taken by open_bundle(), closing the bundle with the last one. */
+  void release_bundle(std::uint32_t p_id)
+  {
+    std::lock_guard<std::mutex> lock(this->bundles_mutex);
+
+    if (p_id < this->bundles.size() && this->bundles[p_id] != nullptr && --this->bundles[p_id]->references == 0)
+    {
+      this->ids.erase(this->bundles[p_id]->path);
+      this->bundles[p_id] = nullptr;
+    }
+  }
+
+  /* Shared, so a lookup in progress keeps the bundle alive while another connection closes it. */
+  std::shared_ptr<Bundle> get_bundle(std::uint32_t p_id)
+  {
+    std::lock_guard<std::mutex> lock(this->bundles_mutex);
+    return p_id < this->bundles.size() ? this->bundles[p_id] : nullptr;
+  }
+
+  void serve(int p_connection)
+  {
+    _::Request request;
+    std::string path;
+
+    /* Bundles this connection has open, it holds one reference to each. */
+    std::unordered_set<std::uint32_t> opened;
+
+    while (_::receive_message(p_connection, &request, sizeof(request)))
+    {
+      _::Response response;
+      int descriptor = -1;
+
+      if (request.size > _::MAX_REQUEST_PATH)
+      {
+        break;
+      }
+
+      path.resize(request.size);
+
+      if (!_::receive_message(p_connection, &path[0], path.size()))
+      {
+        break;
+      }
+
+      if (request.type == _::REQUEST::OPEN)
+      {
+        int status = STATUS::OK;
+        auto id = open_bundle(path, status);
+        response.status = status;
+
+        if (id >= 0)
+        {
+          /* Opening a bundle twice on one connection takes a single reference, like the client's single mapping. */
+          if (!opened.insert(static_cast<std::uint32_t>(id)).second)
+          {
+            release_bundle(static_cast<std::uint32_t>(id));
+          }
+
+          auto bundle = get_bundle(static_cast<std::uint32_t>(id));
+          response.bundle = static_cast<std::uint32_t>(id);
+          response.values[0] = bundle->reader.get_file_count();
+          response.values[1] = bundle->reader.get_source().get_size();
+          descriptor = bundle->reader.get_source().get_descriptor();
+        }
+      }
+      else if (request.type == _::REQUEST::FIND)
+      {
+        auto bundle = opened.count(request.bundle) == 0 ? nullptr : get_bundle(request.bundle);
+        auto index = bundle == nullptr ? -1 : bundle->reader.find(path);
+
+        response.bundle = request.bundle;
+        response.status = index < 0 ? STATUS::OUT_OF_RANGE : STATUS::OK;
+
+        if (index >= 0)
+        {
+          response.values[0] = index;
+          response.values[1] = bundle->reader.get_offset(index);
+          response.values[2] = bundle->reader.get_size(index);
+        }
+      }
+      else if (request.type == _::REQUEST::CLOSE)
+      {
+        response.bundle = request.bundle;
+
+        if (opened.erase(request.bundle) != 0)
+        {
+          release_bundle(request.bundle);
+        }
+        else
+        {
+          response.status = STATUS::OUT_OF_RANGE;
+        }
+      }
+      else
+      {
+        response.status = STATUS::CORRUPT;
+      }
+
+      if (!_::send_message(p_connection, &response, sizeof(response), descriptor))
+      {
+        break;
+      }
+    }
+
+    for (auto id : opened)
+    {
+      release_bundle(id);
+    }
+
+    /* Closed under the lock, so stop() never shuts down a descriptor number that has been reused meanwhile. */
+    std::lock_guard<std::mutex> lock(this->connections_mutex);
+    this->connections.erase(std::find(this->connections.begin(), this->connections.end(), p_connection));
+    ::close(p_connection);
+    this->finished_threads.push_back(std::this_thread::get_id());
+    this->connection_closed.notify_all();
+  }
+
+  /* Joins the threads of clients that have gone. Called with connections_mutex held. */
+  void join_finished_threads()
+  {
+    for (auto id : this->finished_threads)
+    {
+      auto thread = std::find_if(this->threads.begin(), this->threads.end(), [&](const std::thread& p_thread) { return p_thread.get_id() == id; });
+
+      if (thread != this->threads.end())
+      {
+        thread->join();
+        this->threads.erase(thread);
+      }
+    }
+
+    this->finished_threads.clear();
+  }
+
+  public:
+  /* Listens on a new socket at p_socket_path (replacing a stale one) and serves bundles below p_root_path. */
+  int open(const std::string& p_socket_path, const std::string& p_root_path)
+  {
+    sockaddr_un address;
+
+    if (!_::get_socket_address(p_socket_path, address))
+    {
+      return STATUS::OUT_OF_RANGE;
+    }
+
+    if ( (this->root = ::open(p_root_path.empty() ? "." : p_root_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 )
+    {
+      return STATUS::IO_ERROR;
+    }
+
+    this->socket_path = p_socket_path;
+    ::unlink(p_socket_path.c_str());
+
+    if ( (this->listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+         ::bind(this->listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+         ::listen(this->listener, SOMAXCONN) != 0 )
+    {
+      return STATUS::IO_ERROR;
+    }
+
+    return STATUS::OK;
+  }
+
+  /* Connections served at once, 0 for no limit. Set before run(). */
+  void set_connection_limit(std::uint64_t p_connection_limit)
+  {
+    this->connection_limit = p_connection_limit;
+  }
+
+  /* Accepts and serves clients, one thread each, until stop() is called. */
+  void run()
+  {
+    while (!this->stopped)
+    {
+      {
+        std::unique_lock<std::mutex> lock(this->connections_mutex);
+        this->connection_closed.wait(lock, [&]
+        {
+          return this->stopped || this->connection_limit == 0 || this->connections.size() < this->connection_limit;
+        });
+      }
+
+      int connection = ::accept(this->listener, nullptr, nullptr);
+
+      if (connection < 0)
+      {
+        if (errno == EINTR || errno == ECONNABORTED)
+        {
+          continue;
+        }
+
+        break;
+      }
+
+      std::lock_guard<std::mutex> lock(this->connections_mutex);
+
+      if (this->stopped)
+      {
+        ::close(connection);
+        break;
+      }
+
+      join_finished_threads();
+      this->connections.push_back(connection);
+      this->threads.emplace_back(&Daemon::serve, this, connection);
+    }
+  }
+
+  /* Makes run() return and disconnects every client. Safe to call from any thread. */
+  void stop()
+  {
+    std::lock_guard<std::mutex> lock(this->connections_mutex);
+    this->stopped = true;
+    this->connection_closed.notify_all();
+
+    if (this->listener >= 0)
+    {
+      ::shutdown(this->listener, SHUT_RDWR);
+    }
+
+    for (int connection : this->connections)
+    {
+      ::shutdown(connection, SHUT_RDWR);
+    }
+  }
+
+  Daemon() {}
+
+  Daemon(const Daemon&) = delete;
+  Daemon& operator=(const Daemon&) = delete;
+
+  ~Daemon()
+  {
+    stop();
+
+    for (auto& thread : this->threads)
+    {
+      thread.join();
+    }
+
+    if (this->listener >= 0)
+    {
+      ::close(this->listener);
+      ::unlink(this->socket_path.c_str());
+    }
+
+    if (this->root >= 0)
+    {
+      ::close(this->root);
+    }
+  }
+};
+
+/* Connection to a Daemon. Bundles opened through it are mapped into this process, so file contents are
+ * read without a round trip (and without a copy with get_address()); finding files asks the daemon.
+ * Not thread-safe; use one client per thread or guard it.
+ */
+class Client
+{
+  private:
+  int socket = -1;
+
+  struct Mapping
+  {
+    std::uint8_t* address = nullptr;
+    std::uint64_t size = 0;
+  };
+
+  /* Bundle id -> mapping. */
+  std::unordered_map<std::uint32_t, Mapping> mappings;
+
+  int request(std::uint32_t p_type, std::uint32_t p_bundle, const std::string& p_path, _::Response& p_response, int* p_descriptor = nullptr)
+  {
+    _::Request request;
+    request.type = p_type;
+    request.bundle = p_bundle;
+    request.size = p_path.size();
+
+    if (this->socket < 0 || p_path.size() > _::MAX_REQUEST_PATH ||
+        !_::send_message(this->socket, &request, sizeof(request)) || !_::send_message(this->socket, p_path.data(), p_path.size()) ||
+        !_::receive_message(this->socket, &p_response, sizeof(p_response), p_descriptor))
+    {
+      return STATUS::IO_ERROR;
+    }
+
+    return p_response.status;
+  }
+
+  public:
+  /* Location of a file within an opened bundle. */
+  struct Entry
+  {
+    std::uint64_t index = 0;
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+  };
+
+  int connect(const std::string& p_socket_path)
+  {
+    sockaddr_un address;
+
+    if (!_::get_socket_address(p_socket_path, address))
+    {
+      return STATUS::OUT_OF_RANGE;
+    }
+
+    close();
+
+    if ( (this->socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+         ::connect(this->socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 )
+    {
+      close();
+      return STATUS::IO_ERROR;
+    }
+
+    return STATUS::OK;
+  }
+
+  /* Opens the bundle at p_path (relative to the daemon's root) and stores its id in p_bundle. */
+  int open(const std::string& p_path, std::uint32_t& p_bundle, std::uint64_t* p_file_count = nullptr)
+  {
+    _::Response response;
+    int descriptor = -1;
+    int status = request(_::REQUEST::OPEN, 0, p_path, response, &descriptor);
+
+    if (status == STATUS::OK && this->mappings.count(response.bundle) == 0)
+    {
+      void* mapping = descriptor < 0 || response.values[1] == 0 ? MAP_FAILED : ::mmap(nullptr, response.values[1], PROT_READ, MAP_SHARED, descriptor, 0);
+
+      if (mapping == MAP_FAILED)
+      {
+        status = STATUS::IO_ERROR;
+      }
+      else
+      {
+        this->mappings[response.bundle] = {static_cast<std::uint8_t*>(mapping), response.values[1]};
+      }
+    }
+
+    if (descriptor >= 0)
+    {
+      ::close(descriptor);
+    }
+
+    p_bundle = response.bundle;
+
+    if (p_file_count != nullptr)
+    {
+      *p_file_count = response.values[0];
+    }
+
+    return status;
+  }
+
+  /* Looks up the file bundled as p_path, STATUS::OUT_OF_RANGE if there is none. */
+  int find(std::uint32_t p_bundle, const std::string& p_path, Entry& p_entry)
+  {
+    _::Response response;
+    int status = request(_::REQUEST::FIND, p_bundle, p_path, response);
+
+    p_entry = {response.values[0], response.values[1], response.values[2]};
+    return status;
+  }
+
+  /* Contents of a file found with find(), nullptr if the bundle isn't open. Valid until the bundle is closed. */
+  const std::uint8_t* get_address(std::uint32_t p_bundle, const Entry& p_entry)
+  {
+    auto mapping = this->mappings.find(p_bundle);
+
+    if (mapping == this->mappings.end() || p_entry.offset > mapping->second.size || p_entry.size > mapping->second.size - p_entry.offset)
+    {
+      return nullptr;
+    }
+
+    return mapping->second.address + p_entry.offset;
+  }
+
+  /* Copies p_size bytes, p_offset bytes into a file found with find(). */
+  int read(std::uint32_t p_bundle, const Entry& p_entry, std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    auto address = get_address(p_bundle, p_entry);
+
+    if (address == nullptr || p_offset > p_entry.size || p_size > p_entry.size - p_offset)
+    {
+      return STATUS::OUT_OF_RANGE;
+    }
+
+    if (p_size != 0)
+    {
+      std::memcpy(p_address, address + p_offset, p_size);
+    }
+
+    return STATUS::OK;
+  }
+
+  /* Unmaps the bundle. */
+  void close(std::uint32_t p_bundle)
+  {
+    auto mapping = this->mappings.find(p_bundle);
+
+    if (mapping != this->mappings.end())
+    {
+      _::Response response;
+      request(_::REQUEST::CLOSE, p_bundle, std::string(), response);
+      ::munmap(mapping->second.address, mapping->second.size);
+      this->mappings.erase(mapping);
+    }
+  }
+
+  /* Disconnects and unmaps every bundle. */
+  void close()
+  {
+    for (auto& mapping : this->mappings)
+    {
+      ::munmap(mapping.second.address, mapping.second.size);
+    }
+
+    this->mappings.clear();
+
+    if (this->socket >= 0)
+    {
+      ::close(this->socket);
+      this->socket = -1;
+    }
+  }
+
+  Client() {}
+
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  ~Client()
+  {
+    close();
+  }
+};
+#endif
+
+/* Removes chunks of the chunk store at p_chunk_store that none of the bundles at p_bundle_paths refer to.
+ * p_bundle_paths must list every bundle still in use; nothing is removed if any of them can't be read.
+ * Chunks (and leftovers of interrupted writes) younger than p_grace_seconds are kept, so bundles being written
+ * while this runs don't lose chunks they have just stored or reused.
+ * The number of chunks removed is stored in p_removed_count, if given.
+ */
+inline int collect_garbage(const std::string& p_chunk_store, const std::vector<std::string>& p_bundle_paths, std::uint64_t p_grace_seconds = 3600,
+                    std::uint64_t* p_removed_count = nullptr)
+{
+  std::unordered_set<std::string> referenced;
+  int status = STATUS::OK;
+
+  for (const auto& bundle_path : p_bundle_paths)
+  {
+    _::Disk_Stream bundle_stream(bundle_path, std::ios::in | std::ios::binary);
+    _::Metadata metadata;
+    std::vector<_::Chunk_Reference> references;
+
+    if ( (status = _::parse_metadata(bundle_stream, metadata)) != STATUS::OK )
+    {
+      return status;
+    }
+
+    if ( (metadata.flags & _::CHUNK_REFERENCES) != 0 && (status = _::read_chunk_references(bundle_stream, metadata, references)) != STATUS::OK )
+    {
+      return status;
+    }
+
+    for (const auto& reference : references)
+    {
+      referenced.insert(_::Hasher::to_hex(reference.hash));
+    }
+  }
+
+  std::error_code error;
+  std::uint64_t removed_count = 0;
+  auto cutoff = fs::file_time_type::clock::now() - std::chrono::seconds(p_grace_seconds);
+
+  /* Chunks go if nothing refers to them, anything in tmp/ is left over from an interrupted write. */
+  for (bool objects : {true, false})
+  {
+    for (fs::directory_iterator entry(p_chunk_store + (objects ? "/objects" : "/tmp"), error), end; !error && entry != end; entry.increment(error))
+    {
+      std::error_code entry_error;
+      bool unreferenced = !objects || referenced.count(entry->path().filename().string()) == 0;
+
+      if (unreferenced && fs::last_write_time(entry->path(), entry_error) < cutoff && !entry_error && fs::remove(entry->path(), entry_error))
+      {
+        removed_count += objects;
+      }
+    }
+
+    if (error)
+    {
+      return STATUS::IO_ERROR;
+    }
+  }
+
+  if (p_removed_count != nullptr)
+  {
+    *p_removed_count = removed_count;
+  }
+
+  return STATUS::OK;
+}
+
+/* Main bundler function.
+ * Instantiated per sink type, see the stream backends in file_bundler::_ for what a sink has to provide.
+ * With more than one thread and a positional sink, files are written in parallel with write_at(),
+ * at offsets counted from where the sink stood before the bundle was written.
+ * Stops at the first stream error; the error is stored in p_status (if given) and an empty File is returned.
+ */
+template <typename Sink, typename = std::enable_if_t<is_sink<Sink>::value>>
+File bundle(Sink& p_sink, const std::vector<File>& p_files, bool p_from_memory, int* p_status = nullptr, const Options& p_options = Options())
+{
+  if (_::has_priority(p_options))
+  {
+    return _::run_prioritized(p_options, [&](const Options& p_run_options) { return bundle(p_sink, p_files, p_from_memory, p_status, p_run_options); });
+  }
+
+  _::Header header;
+  int status = STATUS::OK;
+
+  /* Record the status for the caller and bail out. */
+  auto fail = [&](int p_error) -> File
+  {
+    if (p_status != nullptr)
+    {
+      *p_status = p_error;
+    }
+
+    return {std::string(), 0};
+  };
+
+  if (p_status != nullptr)
+  {
+    *p_status = STATUS::OK;
+  }
+
+  /* With Options::auto_tune, files from disk are tuned for by probing the largest one. */
+  auto largest = std::max_element(p_files.begin(), p_files.end(), [](const File& p_left, const File& p_right) { return p_left.get_size() < p_right.get_size(); });
+  Options options = _::apply_tuning(p_options, p_from_memory || largest == p_files.end() ? std::string() : largest->get_path());
+  _::Counter_Scope counter_scope(options);
+  _::Throttle throttle_state(options);
+  _::Throttle* throttle = throttle_state.get();
+
+  for (const auto& file : p_files)
+  {
+    /* The sizes section promises get_size() bytes, anything else would make a bundle that can't be read back. */
+    if (p_from_memory && file.get_bytes().size() != file.get_size())
+    {
+      return fail(STATUS::OUT_OF_RANGE);
+    }
+
+    header.paths_section_size += file.get_path().size() + 1; /* +1 for null-terminator */
+    header.sizes_section_size += sizeof(std::uint64_t);
+    header.files_section_size += file.get_size();
+  }
+
+  /* Assemble the header, paths and sizes sections into a single buffer
+   * so the whole metadata block reaches the output stream in one write instead of 1 + 2 * N small ones.
+   */
+  std::vector<std::uint8_t> metadata(sizeof(_::Header) + header.paths_section_size + header.sizes_section_size);
+  std::uint8_t* paths_cursor = metadata.data() + sizeof(_::Header);
+  std::uint8_t* sizes_cursor = paths_cursor + header.paths_section_size;
+
+  std::memcpy(metadata.data(), &header, sizeof(_::Header));
+
+  for (const auto& file : p_files)
+  {
+    std::uint64_t file_name_size = file.get_path().size() + 1; /* +1 for null-terminator */
+    std::memcpy(paths_cursor, file.get_path().c_str(), file_name_size);
+    paths_cursor += file_name_size;
+
+    std::memcpy(sizes_cursor, &file.get_size(), sizeof(std::uint64_t));
+    sizes_cursor += sizeof(std::uint64_t);
+  }
+
+  if (!options.chunk_store.empty())
+  {
+    /* Chunk store mode: contents go to the store, chunk by chunk, and the bundle only keeps references to them.
+     * Chunks already in the store (from earlier versions of the bundle) are not written again.
+     */
+    _::Object_Store store;
+    _::Chunker chunker;
+    std::vector<_::Chunk_Reference> references;
+    std::vector<std::uint8_t> chunk;
+    std::vector<std::uint8_t> stored_chunk;
+    std::uint64_t stored_bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    if (!store.open(options.chunk_store))
+    {
+      return fail(STATUS::IO_ERROR);
+    }
+
+    auto store_chunk = [&](const std::uint8_t* p_address, std::uint64_t p_size) -> int
+    {
+      _::Hasher hasher;
+      _::Chunk_Reference reference;
+
+      hasher.update(p_address, p_size);
+      hasher.finish(reference.hash);
+      reference.size = p_size;
+      references.push_back(reference);
+
+      auto hash = _::Hasher::to_hex(reference.hash);
+      std::error_code error;
+
+      if (store.load_object(hash, p_size, stored_chunk))
+      {
+        if (std::memcmp(stored_chunk.data(), p_address, p_size) == 0)
+        {
+          /* Keeps collect_garbage() from removing the chunk before this bundle is written, see its grace period.
+           * If the touch failed, or a collection got to the chunk before it, the chunk is stored again.
+           */
+          fs::last_write_time(store.get_object_path(hash), fs::file_time_type::clock::now(), error);
+
+          if (!error && store.has_object(hash, p_size))
+          {
+            return STATUS::OK;
+          }
+        }
+        else
+        {
+          /* Same name, other content: the stored chunk is damaged, or this chunk collides with it (Hasher isn't
+           * cryptographic). Only a damaged chunk is replaced, so bundles referring to it keep their contents.
+           */
+          _::Hasher stored_hasher;
+          std::uint64_t stored_hash[2];
+          stored_hasher.update(stored_chunk.data(), p_size);
+          stored_hasher.finish(stored_hash);
+
+          if (_::Hasher::to_hex(stored_hash) == hash)
+          {
+            return STATUS::IO_ERROR;
+          }
+        }
+      }
+
+      stored_bytes += p_size;
+      return store.store_object(hash, p_address, p_size);
+    };
+
+    for (const auto& file : p_files)
+    {
+      _::Trace_Span span(options.tracer, "chunk", file.get_path());
+      int status = STATUS::OK;
+
+      if (p_from_memory)
+      {
+        auto data = file.get_bytes().data();
+
+        status = _::pace(throttle, file.get_size(), _::get_chunk_size(options),
+                         [&](std::uint64_t p_offset, std::uint64_t p_size) { return chunker.update(data + p_offset, p_size, store_chunk); });
+      }
+      else
+      {
+        _::Disk_Stream file_stream(file.get_path(), std::ios::in | std::ios::binary);
+        chunk.resize(_::get_chunk_size(options));
+
+        for (std::uint64_t offset = 0; offset < file.get_size() && status == STATUS::OK; offset += chunk.size())
+        {
+          auto chunk_size = std::min<std::uint64_t>(chunk.size(), file.get_size() - offset);
+
+          if (throttle != nullptr)
+          {
+            throttle->acquire(chunk_size);
+          }
+
+          if ( (status = file_stream.read_at(offset, chunk.data(), chunk_size)) == STATUS::OK )
+          {
+            status = chunker.update(chunk.data(), chunk_size, store_chunk);
+          }
+        }
+      }
+
+      if (status != STATUS::OK || (status = chunker.finish(store_chunk)) != STATUS::OK)
+      {
+        return fail(status);
+      }
+    }
+
+    header.sizes_section_size |= _::CHUNK_REFERENCES;
+    header.files_section_size = references.size() * sizeof(_::Chunk_Reference);
+    std::memcpy(metadata.data(), &header, sizeof(_::Header));
+
+    if ( (status = p_sink.write(metadata.data(), metadata.size())) != STATUS::OK ||
+         (status = p_sink.write(reinterpret_cast<const std::uint8_t*>(references.data()), header.files_section_size)) != STATUS::OK ||
+         (status = _::flush(p_sink)) != STATUS::OK )
+    {
+      return fail(status);
+    }
+
+    if (options.stats != nullptr)
+    {
+      _::record_stats(options.stats, stored_bytes, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return {std::string(), p_sink.get_total_bytes_written()};
+  }
+
+  /* The index only depends on the metadata, it is written after the files. */
+  std::vector<std::uint8_t> index;
+
+  if (options.index)
+  {
+    _::Trace_Span span(options.tracer, "build index");
+    _::build_index(metadata.data(), header, index);
+    header.sizes_section_size |= _::INDEX;
+    std::memcpy(metadata.data(), &header, sizeof(_::Header));
+  }
+
+  /* Write metadata to bundle before anything else */
+  std::uint64_t bundle_offset = p_sink.get_total_bytes_written();
+
+  if ( (status = p_sink.write(metadata.data(), metadata.size())) != STATUS::OK )
+  {
+    return fail(status);
+  }
+
+  /* Where the bundle ends in the sink, returned by both paths below: positional writes don't move the sink's
+   * sequential position, so get_total_bytes_written() only tells once everything went through write().
+   */
+  std::uint64_t bundle_end = bundle_offset + metadata.size() + header.files_section_size + index.size();
+  std::uint64_t thread_count = _::get_thread_count(options);
+  std::uint64_t chunk_size = _::get_chunk_size(options);
+  auto start = std::chrono::steady_clock::now();
+
+  if (options.stats != nullptr)
+  {
+    /* Input files are always read through Disk_Stream. */
+    options.stats->tuning.chunk_size = chunk_size;
+    options.stats->tuning.thread_count = thread_count;
+    options.stats->tuning.backend = BACKEND::DESCRIPTOR;
+  }
+
+  if (!is_positional_sink<Sink>::value || thread_count <= 1 || (p_files.size() <= 1 && header.files_section_size <= 2 * _::PARALLEL_RANGE_SIZE))
+  {
+    /* Copy in the individual files, chunk by chunk when they come from disk. */
+    std::vector<std::uint8_t> chunk;
+
+    for (const auto& file : p_files)
+    {
+      _::Trace_Span span(options.tracer, "write", file.get_path());
+
+      if (p_from_memory)
+      {
+        auto data = file.get_bytes().data();
+        status = _::pace(throttle, file.get_size(), chunk_size, [&](std::uint64_t p_offset, std::uint64_t p_size) { return p_sink.write(data + p_offset, p_size); });
+      }
+      else
+      {
+        _::Disk_Stream file_stream(file.get_path(), std::ios::in | std::ios::binary);
+        status = _::copy(file_stream, 0, file.get_size(), p_sink, chunk, chunk_size, throttle);
+      }
+
+      if (status != STATUS::OK)
+      {
+        return fail(status);
+      }
+    }
+
+    if ( (!index.empty() && (status = p_sink.write(index.data(), index.size())) != STATUS::OK) || (status = _::flush(p_sink)) != STATUS::OK )
+    {
+      return fail(status);
+    }
+    _::record_stats(options.stats, header.files_section_size, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    return {std::string(), bundle_end};
+  }
+
+  if constexpr (is_positional_sink<Sink>::value)
+  {
+    /* Multi-threaded, planned and scheduled the same way as extraction, see _::plan_tasks(). */
+    if ( (status = _::flush(p_sink)) != STATUS::OK )
+    {
+      return fail(status);
+    }
+
+    std::vector<std::uint64_t> sizes;
+    std::vector<std::uint64_t> offsets;
+    std::uint64_t offset = bundle_offset + metadata.size();
+
+    sizes.reserve(p_files.size());
+    offsets.reserve(p_files.size());
+
+    for (const auto& file : p_files)
+    {
+      sizes.push_back(file.get_size());
+      offsets.push_back(offset);
+      offset += file.get_size();
+    }
+
+    _::Topology topology = options.numa ? _::get_topology() : _::Topology();
+
+    if (topology.node_cpus.empty())
+    {
+      topology.node_cpus.emplace_back();
+    }
+    std::vector<std::uint64_t> order;
+    std::vector<_::Task> tasks;
+    _::plan_tasks(sizes, topology.node_cpus.size(), true, order, tasks);
+
+    /* Writes p_size bytes found p_offset bytes into the file at p_index to its place in the bundle. */
+    auto write = [&](std::uint64_t p_index, std::uint64_t p_offset, std::uint64_t p_size, std::vector<std::uint8_t>& p_chunk) -> int
+    {
+      const auto& file = p_files[p_index];
+      _::Trace_Span span(options.tracer, "write", file.get_path());
+
+      if (p_from_memory)
+      {
+        return _::pace(throttle, p_size, chunk_size, [&](std::uint64_t p_step_offset, std::uint64_t p_step_size)
+        {
+          return p_sink.write_at(offsets[p_index] + p_offset + p_step_offset, file.get_bytes().data() + p_offset + p_step_offset, p_step_size);
+        });
+      }
+
+      _::Disk_Stream file_stream(file.get_path(), std::ios::in | std::ios::binary);
+      return _::copy_at(file_stream, p_offset, p_size, p_sink, offsets[p_index] + p_offset, p_chunk, chunk_size, throttle);
+    };
+
+    std::vector<std::vector<std::uint8_t>> chunks(thread_count);
+    std::vector<std::uint64_t> worker_bytes(thread_count);
+    std::atomic<int> first_error{STATUS::OK};
+    _::Scheduler scheduler;
+    scheduler.set_tracer(options.tracer);
+
+    if (options.numa)
+    {
+      scheduler.set_topology(&topology);
+    }
+
+    scheduler.run(tasks.size(), thread_count, [&](std::uint64_t p_task, std::uint64_t p_worker) -> bool
+    {
+      auto& task = tasks[p_task];
+      int status = STATUS::OK;
+
+      if (task.count == 0)
+      {
+        status = write(task.file, task.offset, task.size, chunks[p_worker]);
+        worker_bytes[p_worker] += task.size;
+      }
+
+      for (std::uint64_t i = task.first; i < task.first + task.count && status == STATUS::OK; i++)
+      {
+        status = write(order[i], 0, sizes[order[i]], chunks[p_worker]);
+        worker_bytes[p_worker] += sizes[order[i]];
+      }
+
+      if (status != STATUS::OK)
+      {
+        int expected = STATUS::OK;
+        first_error.compare_exchange_strong(expected, status);
+        return false;
+      }
+
+      return true;
+    }, [&](std::uint64_t p_task) { return tasks[p_task].node; });
+
+    _::record_stats(options.stats, scheduler, worker_bytes, topology.node_cpus.size());
+
+    if ( (status = first_error) != STATUS::OK || (!index.empty() && (status = p_sink.write_at(offset, index.data(), index.size())) != STATUS::OK) )
+    {
+      return fail(status);
+    }
+
+    return {std::string(), bundle_end};
+  }
+
+  return fail(STATUS::IO_ERROR);
+}
+
+/* Bundle files from memory to disk.
+ * The error of a failed bundle is stored in p_status (if given) and an empty File is returned.
+ */
+inline File bundle(const std::string& p_bundle_output_path, const std::vector<File>& p_files, int* p_status = nullptr, const Options& p_options = Options())
+{
+  _::Disk_Stream output_stream(p_bundle_output_path, std::ios::out | std::ios::binary | std::ios::trunc);
+  int status = output_stream.is_open() ? STATUS::OK : STATUS::IO_ERROR;
+
+#ifdef FILE_BUNDLER_POSIX
+  /* Coalesce the writes of small files. */
+  output_stream.set_buffer_size(_::COPY_CHUNK_SIZE);
+#endif
+
+  auto package = status == STATUS::OK ? bundle(output_stream, p_files, true, &status, p_options) : File();
+
+  if (status == STATUS::OK)
+  {
+    package.set_path(p_bundle_output_path);
+  }
+
+  if (p_status != nullptr)
+  {
+    *p_status = status;
+  }
+
+  return package;
+}
+
+/* Bundle files from disk to disk. */
+inline File bundle(const std::string& p_bundle_output_path, const std::vector<std::string>& p_file_paths, int* p_status = nullptr, const Options& p_options = Options())
+{
+  std::vector<File> files;
+  File package;
+
+  /* Inputs are sized before the output is created, so a missing one leaves no output behind. */
+  int status = _::list_files(p_file_paths, files);
+
+  if (status == STATUS::OK)
+  {
+    _::Disk_Stream output_stream(p_bundle_output_path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+#ifdef FILE_BUNDLER_POSIX
+    /* Coalesce the writes of small files. */
+    output_stream.set_buffer_size(_::COPY_CHUNK_SIZE);
+#endif
+
+    if (!output_stream.is_open())
+    {
+      status = STATUS::IO_ERROR;
+    }
+    else
+    {
+      package = bundle(output_stream, files, false, &status, p_options);
+    }
+  }
+
+  if (status == STATUS::OK)
+  {
+    package.set_path(p_bundle_output_path);
+  }
+
+  if (p_status != nullptr)
+  {
+    *p_status = status;
+  }
+
+  return package;
+}
+
+/* Bundle files from memory to memory. */
+inline File bundle(const std::vector<File>& p_files, int* p_status = nullptr, const Options& p_options = Options())
+{
+  std::vector<std::uint8_t> buffer;
+  _::Vector_Stream output_stream(&buffer);
+  int status = STATUS::OK;
+
+  buffer.reserve(_::get_bundle_size(p_files, p_options));
+
+  auto package = bundle(output_stream, p_files, true, &status, p_options);
+
+  if (status == STATUS::OK)
+  {
+    package.get_bytes() = std::move(buffer);
+  }
+
+  if (p_status != nullptr)
+  {
+    *p_status = status;
+  }
+
+  return package;
+}
+
+/* Bundle files from disk to memory. */
+inline File bundle(const std::vector<std::string>& p_file_paths, int* p_status = nullptr, const Options& p_options = Options())
+{
+  std::vector<std::uint8_t> buffer;
+  _::Vector_Stream output_stream(&buffer);
+  std::vector<File> files;
+  File package;
+  int status = _::list_files(p_file_paths, files);
+
+  if (status == STATUS::OK)
+  {
+    buffer.reserve(_::get_bundle_size(files, p_options));
+    package = bundle(output_stream, files, false, &status, p_options);
+  }
+
+  if (status == STATUS::OK)
+  {
+    package.get_bytes() = std::move(buffer);
+  }
+
+  if (p_status != nullptr)
+  {
+    *p_status = status;
+  }
+
+  return package;
+}
+
+/* Bundle files from memory to a custom sink (see is_sink). */
+template <typename Sink, typename = std::enable_if_t<is_sink<Sink>::value>>
+File bundle(Sink& p_sink, const std::vector<File>& p_files, int* p_status = nullptr, const Options& p_options = Options())
+{
+  return bundle(p_sink, p_files, true, p_status, p_options);
+}
+
+/* Bundle files from disk to a custom sink (see is_sink). */
+template <typename Sink, typename = std::enable_if_t<is_sink<Sink>::value>>
+File bundle(Sink& p_sink, const std::vector<std::string>& p_file_paths, int* p_status = nullptr, const Options& p_options = Options())
+{
+  std::vector<File> files;
+  int status = _::list_files(p_file_paths, files);
+
+  if (status != STATUS::OK)
+  {
+    if (p_status != nullptr)
+    {
+      *p_status = status;
+    }
+
+    return File();
+  }
+
+  return bundle(p_sink, files, false, p_status, p_options);
+}
+
+/* Main de-bundler function.
+ * Instantiated per source type, see the stream backends in file_bundler::_ for what a source has to provide.
+ * Stops at the first stream error; the error is stored in p_status (if given) and an empty list is returned.
+ */
+template <typename Source, typename = std::enable_if_t<is_source<Source>::value>>
+std::vector<File> debundle(Source& p_source, const std::string& p_output_directory, bool p_to_memory, int* p_status = nullptr, const Options& p_options = Options())
+{
+  if (_::has_priority(p_options))
+  {
+    return _::run_prioritized(p_options, [&](const Options& p_run_options) { return debundle(p_source, p_output_directory, p_to_memory, p_status, p_run_options); });
+  }
+
+  std::vector<File> debundled_files;
+  int status = STATUS::OK;
+  _::Counter_Scope counter_scope(p_options);
+
+  /* Record the status for the caller and bail out. */
+  auto fail = [&](int p_error) -> std::vector<File>
   {
-    open(p_vector, p_size);
-  }
+    if (p_status != nullptr)
+    {
+      *p_status = p_error;
+    }
 
-  Base_Stream(const std::string& p_file_path, std::ios_base::openmode p_openmode)
+    return {};
+  };
+
+  if (p_status != nullptr)
   {
-    open(p_file_path, p_openmode);
+    *p_status = STATUS::OK;
   }
 
-  Base_Stream() {}
-};
+  _::Metadata metadata;
 
-class Input_Stream : public Base_Stream
-{
-  public:
-  void read(std::uint8_t* p_address, std::uint64_t p_size)
+  /* Read and validate all metadata first, nothing is extracted from a bundle with a bad header. */
   {
-    if (this->memory != nullptr)
-    {
-      if ( (this->current_offset + p_size) >= this->memory_size )
-      {
-        /* Read chunk of the specified size (p_size) from the very end of the buffer. */
-        //std::memcpy(p_address, this->memory + this->memory_size - p_size, p_size);
-        return;
-      }
+    _::Trace_Span span(p_options.tracer, "parse metadata");
 
-      std::memcpy(p_address, this->memory + this->current_offset, p_size);
-      this->current_offset += p_size;
-      return;
+    if ( (status = _::parse_metadata(p_source, metadata)) != STATUS::OK )
+    {
+      return fail(status);
     }
-
-    this->file.read(reinterpret_cast<char*>(p_address), p_size);
   }
 
-  void seekg(std::uint64_t p_offset)
+  /* Contents live in a chunk store, read the bundle through it as if it were a plain one. */
+  if constexpr (!std::is_same<Source, _::Chunk_Source>::value)
   {
-    if (this->memory != nullptr)
+    if ( (metadata.flags & _::CHUNK_REFERENCES) != 0 )
     {
-      if (p_offset <= this->memory_size)
+      _::Chunk_Source chunk_source;
+
+      if (p_options.chunk_store.empty())
       {
-        this->current_offset = p_offset;
+        return fail(STATUS::MISSING_CHUNK);
       }
 
-      return;
-    }
+      if ( (status = chunk_source.open(p_source, metadata, p_options.chunk_store)) != STATUS::OK )
+      {
+        return fail(status);
+      }
 
-    this->file.seekg(p_offset);
+      return debundle(chunk_source, p_output_directory, p_to_memory, p_status, p_options);
+    }
   }
 
-  /* Inherit parent constructors */
-  using Base_Stream::Base_Stream;
-};
+  /* These hold the paths and sizes of each bundled file. */
+  std::vector<std::string>& paths_of_bundled_files = metadata.paths;
+  std::vector<std::uint64_t>& sizes_of_bundled_files = metadata.sizes;
 
-class Output_Stream : public Base_Stream
-{
-  private:
-  /* total_bytes_written is distinct from current_offset.
-   * The latter can be manipulated (with seekg) while the former is merely an incremental counter.
+  /* Now that we have the file names and sizes, we can prepare for extraction.
+   * Reject the whole bundle up front if any path would land outside of the output directory.
    */
-  std::uint64_t total_bytes_written = 0;
+  _::Output_Directory output_directory;
+  output_directory.set_tracer(p_options.tracer);
 
-  public:
-  std::uint64_t get_total_bytes_written()
+  if (!p_to_memory)
   {
-    return this->total_bytes_written;
-  }
+    std::vector<std::string> components;
 
-  void write(std::uint8_t* p_address, std::uint64_t p_size)
-  {
-    if (this->memory != nullptr)
+    for (const auto& file_path : paths_of_bundled_files)
     {
-      if (this->stream_object_type == STREAM_OBJECT_TYPE::VECTOR && ( (this->current_offset + p_size) > this->memory_size ) )
+      if (!_::split_path(file_path, components))
       {
-        this->vector->resize(this->memory_size + p_size);
-        this->memory_size = this->vector->size();
-        this->memory = this->vector->data(); // Reallocation occurred, cache internal pointer.
+        return fail(STATUS::UNSAFE_PATH);
       }
-
-      std::memcpy(this->memory + this->current_offset, p_address, p_size);
-      this->current_offset += p_size;
-      this->total_bytes_written += p_size;
-      return;
     }
 
-    this->file.write(reinterpret_cast<char*>(p_address), p_size);
-    this->total_bytes_written += p_size;
+    if (!output_directory.open(p_output_directory))
+    {
+      return fail(STATUS::IO_ERROR);
+    }
   }
 
-  /* Inherit parent constructors */
-  using Base_Stream::Base_Stream;
-};
-
-/* We use this header to parse and debundle our bundled files.
- * This way there is no need to use magic numbers to separate each section.
- * Adding offsets would make parsing easier but the trade off is a slight increase in size of the final bundle.
- */
-struct Header
-{
-  std::uint64_t paths_section_size = 0;
-  std::uint64_t sizes_section_size = 0;
-  std::uint64_t files_section_size = 0;
-};
+  /* List every file up front, so extraction only ever touches its own entries and can run on any number of threads.
+   * In memory mode buffers are allocated by whichever worker extracts the file, so their pages are first
+   * touched (and placed) on that worker's NUMA node.
+   */
+  debundled_files.reserve(paths_of_bundled_files.size());
 
-} // namespace file_bundler::_
+  for (std::size_t i = 0; i < paths_of_bundled_files.size(); i++)
+  {
+    auto& file_path = paths_of_bundled_files[i];
+    auto file_size = sizes_of_bundled_files[i];
 
-class File
-{
-  private:
-  std::string path;
-  std::uint64_t size = 0;
-  std::vector<std::uint8_t> bytes;
+    if (!p_to_memory)
+    {
+      /* Report where the file ends up. */
+      debundled_files.push_back({p_output_directory.empty() ? file_path : p_output_directory + '/' + file_path, file_size});
+      continue;
+    }
 
-  public:
-  std::uint64_t& get_size()
-  {
-    return this->size;
-  }
+    debundled_files.push_back({file_path, file_size});
 
-  void set_size(std::uint64_t p_file_size)
-  {
-    this->size = p_file_size;
+    /* A file larger than the address space (32-bit targets) can't be debundled to memory. */
+    if (file_size > debundled_files.back().get_bytes().max_size())
+    {
+      return fail(STATUS::OUT_OF_RANGE);
+    }
   }
 
-  std::string& get_path()
-  {
-    return this->path;
-  }
+  using File_Sink = _::Output_Directory::File_Sink;
+  std::uint64_t chunk_size = _::get_chunk_size(p_options);
+  _::Throttle throttle_state(p_options);
+  _::Throttle* throttle = throttle_state.get();
 
-  void set_path(const std::string& p_file_path)
-  {
-    this->path = p_file_path;
-  }
+  /* Extraction cache, see Options::cache_directory.
+   * A bundle file seen before (same identity and metadata) has a manifest naming the SHA-256 of every entry,
+   * so its files are linked from the cache without reading the bundle's payload at all.
+   * Other bundles have their entries hashed as they are copied into the cache, each read once, so entries shared
+   * with earlier bundles still end up as a single object.
+   */
+  _::Extraction_Cache cache;
+  std::vector<_::Extraction_Cache::Entry> cache_entries;
+  std::string manifest_key;
+  std::atomic<bool> manifest_changed{false};
+  std::atomic<std::uint64_t> cache_hits{0};
+  bool use_cache = !p_to_memory && !p_options.cache_directory.empty();
 
-  std::vector<std::uint8_t>& get_bytes()
+  if (use_cache)
   {
-    return this->bytes;
-  }
+    if (!cache.open(p_options.cache_directory))
+    {
+      return fail(STATUS::IO_ERROR);
+    }
 
-  void set_bytes(std::vector<std::uint8_t> p_bytes)
-  {
-    this->bytes = p_bytes;
-  }
+    auto file_count = paths_of_bundled_files.size();
+    manifest_key = cache.get_manifest_key(p_source, paths_of_bundled_files, sizes_of_bundled_files);
 
-  /* Helper (overload) for easier transfer of bytes from memory block to member vector.
-   * Just use this instead of bothering with memcpy and std::vector's methods.
-   * NOTE: Only deallocate if memory block is on the heap.
-   */
-  void set_bytes(std::uint8_t* p_address, std::uint64_t p_size, bool p_deallocate = false)
-  {
-    this->size = p_size;
-    this->bytes.resize(this->size);
-    std::memcpy(this->bytes.data(), p_address, p_size);
+    /* A manifest that doesn't match the metadata is ignored and rewritten. */
+    if (manifest_key.empty() || !cache.load_manifest(manifest_key, file_count, cache_entries))
+    {
+      cache_entries.clear();
+    }
 
-    if (p_deallocate)
+    for (std::uint64_t i = 0; i < cache_entries.size(); i++)
     {
-      delete p_address;
+      if (cache_entries[i].size != sizes_of_bundled_files[i])
+      {
+        cache_entries.clear();
+        break;
+      }
     }
-  }
 
-  File(const std::string& p_file_path, std::uint8_t* p_address, std::uint64_t p_size, bool p_deallocate = false)
-  {
-    this->path = p_file_path;
-    this->set_bytes(p_address, p_size, p_deallocate);
-  }
+    if (cache_entries.empty())
+    {
+      cache_entries.resize(file_count);
+      manifest_changed = true;
 
-  File(std::string p_file_path, std::vector<std::uint8_t> p_bytes)
-  {
-    this->path = p_file_path;
-    this->size = p_bytes.size();
-    this->bytes = p_bytes;
+      for (std::uint64_t i = 0; i < file_count; i++)
+      {
+        cache_entries[i].size = sizes_of_bundled_files[i];
+      }
+    }
   }
 
-  File(std::string p_file_path, std::uint64_t p_size)
+  /* Extracts the file at p_index through the cache: links the object the manifest names if it is there, otherwise
+   * copies the entry into the cache (hashing it on the way) and links that, then records its hash in the manifest.
+   */
+  auto extract_cached = [&](std::uint64_t p_index, std::vector<std::uint8_t>& p_chunk) -> int
   {
-    this->path = p_file_path;
-    this->size = p_size;
-  }
+    auto& entry = cache_entries[p_index];
+    int status = STATUS::OK;
+    _::Trace_Span span(p_options.tracer, "extract cached", paths_of_bundled_files[p_index]);
 
-  File() {}
-};
+    if (!entry.hash.empty() && cache.has_object(entry.hash, entry.size))
+    {
+      cache_hits++;
+    }
+    else
+    {
+      std::string hash;
+      bool stored = false;
 
-/* Main bundler function. */
-File bundle(_::Output_Stream& p_output_stream, const std::vector<File>& p_files, bool p_from_memory)
-{
-  _::Header header;
+      if ( (status = cache.store_entry(p_source, metadata.offsets[p_index], entry.size, p_chunk, chunk_size, hash, stored, throttle)) != STATUS::OK )
+      {
+        return status;
+      }
 
-  for (auto file : p_files)
-  {
-    header.paths_section_size += file.get_path().size() + 1; /* +1 for null-terminator */
-    header.sizes_section_size += sizeof(std::uint64_t);
-    header.files_section_size += file.get_size();
-  }
+      cache_hits += stored ? 0 : 1;
 
-  /* Write header to bundle before anything else */
-  p_output_stream.write(reinterpret_cast<std::uint8_t*>(&header), sizeof(_::Header));
+      if (hash != entry.hash)
+      {
+        entry.hash = std::move(hash);
+        manifest_changed = true;
+      }
+    }
 
-  for (auto file : p_files)
-  {
-    std::uint64_t file_name_size = file.get_path().size() + 1; /* +1 for null-terminator */
-    p_output_stream.write(reinterpret_cast<std::uint8_t*>(const_cast<char*>(file.get_path().c_str())), file_name_size);
-  }
+    return output_directory.link_file(paths_of_bundled_files[p_index], cache.get_object_path(entry.hash), p_options.cache_hard_links);
+  };
 
-  for (auto file : p_files)
+  /* Bookkeeping once every file is out. */
+  auto complete = [&]() -> std::vector<File>
   {
-    p_output_stream.write(reinterpret_cast<std::uint8_t*>(&file.get_size()), sizeof(std::uint64_t));
-  }
+    if (use_cache && manifest_changed && !manifest_key.empty())
+    {
+      cache.store_manifest(manifest_key, cache_entries);
+    }
 
-  /* Read in the individual files byte by byte */
-  for (auto file : p_files)
-  {
-    if (p_from_memory)
+    if (p_options.stats != nullptr)
     {
-      p_output_stream.write(reinterpret_cast<std::uint8_t*>(file.get_bytes().data()), file.get_bytes().size());
+      p_options.stats->cache_hits = cache_hits;
     }
-    else
+
+    return std::move(debundled_files);
+  };
+
+  /* Extracts p_size bytes found p_offset bytes into the file at p_index.
+   * Every file is read from its own offset, so extraction doesn't depend on where the stream was left.
+   * Whole files are (re)created on disk; parts of split files are written in place.
+   */
+  auto extract = [&](std::uint64_t p_index, std::uint64_t p_offset, std::uint64_t p_size, bool p_whole, std::vector<std::uint8_t>& p_chunk) -> int
+  {
+    auto file_offset = metadata.offsets[p_index] + p_offset;
+    int status = STATUS::OK;
+
+    if (p_to_memory)
     {
-      _::Input_Stream input_stream(file.get_path(), std::ios::in | std::ios::binary);
+      _::Trace_Span span(p_options.tracer, "read", paths_of_bundled_files[p_index]);
+      auto& bytes = debundled_files[p_index].get_bytes();
 
-      /* Could be more efficient but whatever... works fine with small to medium sized files. */
-      for (int offset = 0; offset < file.get_size(); offset++)
+      if (p_whole)
       {
-        char byte = CHAR_MAX;
-        input_stream.read(reinterpret_cast<std::uint8_t*>(&byte), sizeof(char));
-        p_output_stream.write(reinterpret_cast<std::uint8_t*>(&byte), sizeof(char));
+        bytes.resize(p_size);
       }
+
+      /* Read straight into the file's own buffer. */
+      return _::pace(throttle, p_size, chunk_size, [&](std::uint64_t p_step_offset, std::uint64_t p_step_size)
+      {
+        return p_source.read_at(file_offset + p_step_offset, bytes.data() + p_offset + p_step_offset, p_step_size);
+      });
     }
-  }
 
-  return {p_output_stream.get_file_path(), p_output_stream.get_total_bytes_written()};
-}
+    if (use_cache && p_whole)
+    {
+      return extract_cached(p_index, p_chunk);
+    }
 
-/* Bundle files from memory to disk. */
-File bundle(const std::string& p_bundle_output_path, const std::vector<File>& p_files)
-{
-  _::Output_Stream output_stream(p_bundle_output_path, std::ios::out | std::ios::binary | std::ios::app);
-  return bundle(output_stream, p_files, true);
-}
+    _::Trace_Span span(p_options.tracer, "extract", paths_of_bundled_files[p_index]);
+    File_Sink output_stream;
 
-/* Bundle files from disk to disk. */
-File bundle(const std::string& p_bundle_output_path, const std::vector<std::string>& p_file_paths)
-{
-  _::Output_Stream output_stream(p_bundle_output_path, std::ios::out | std::ios::binary | std::ios::app);
-  std::vector<File> files;
+    if ( (status = output_directory.open_file(paths_of_bundled_files[p_index], output_stream, p_whole)) != STATUS::OK )
+    {
+      return status;
+    }
 
-  for (const auto& file_path : p_file_paths)
-  {
-    files.push_back({file_path, fs::file_size(file_path)});
-  }
+    if (p_whole)
+    {
+      if ( (status = _::copy(p_source, file_offset, p_size, output_stream, p_chunk, chunk_size, throttle)) != STATUS::OK )
+      {
+        return status;
+      }
 
-  return bundle(output_stream, files, false);
-}
+      return _::flush(output_stream);
+    }
 
-/* Bundle files from memory to memory. */
-File bundle(const std::vector<File>& p_files)
-{
-  std::vector<std::uint8_t> buffer;
-  _::Output_Stream output_stream(&buffer, buffer.size());
+    if constexpr (is_positional_sink<File_Sink>::value)
+    {
+      return _::copy_at(p_source, file_offset, p_size, output_stream, p_offset, p_chunk, chunk_size, throttle);
+    }
 
-  auto package = bundle(output_stream, p_files, true);
-  package.get_bytes() = std::move(buffer);
-  return package;
-}
+    return STATUS::IO_ERROR;
+  };
 
-/* Bundle files from disk to memory. */
-File bundle(const std::vector<std::string>& p_file_paths)
-{
-  std::vector<std::uint8_t> buffer;
-  _::Output_Stream output_stream(&buffer, buffer.size());
-  std::vector<File> files;
+  /* Finally debundle files. */
+  std::uint64_t thread_count = _::get_thread_count(p_options);
+  auto start = std::chrono::steady_clock::now();
 
-  for (const auto& file_path : p_file_paths)
+  if (p_options.stats != nullptr)
   {
-    files.push_back({file_path, fs::file_size(file_path)});
+    p_options.stats->tuning.chunk_size = chunk_size;
+    p_options.stats->tuning.thread_count = thread_count;
   }
 
-  auto package = bundle(output_stream, files, false);
-  package.get_bytes() = std::move(buffer);
-  return package;
-}
-
-/* Main de-bundler function. */
-std::vector<File> debundle(_::Input_Stream& p_input_stream, const std::string& p_output_directory, bool p_to_memory)
-{
-  std::vector<File> debundled_files;
-
-  _::Header header;
-  auto metadata_size = sizeof(_::Header);
-
-  /* Read bundle header header first for info necessary for parsing */
-  p_input_stream.read(reinterpret_cast<std::uint8_t*>(&header), metadata_size);
+  if (thread_count <= 1 || (paths_of_bundled_files.size() <= 1 && metadata.header.files_section_size <= 2 * _::PARALLEL_RANGE_SIZE))
+  {
+    /* Single threaded, in bundle order so the source is read sequentially. */
+    std::vector<std::uint8_t> chunk;
 
-  /* Starting offset in bytes of each section from the beginning of the file. */
-  std::uint64_t paths_section_offset = metadata_size;
-  std::uint64_t sizes_section_offset = paths_section_offset + header.paths_section_size;
-  std::uint64_t files_section_offset = sizes_section_offset + header.paths_section_size + header.sizes_section_size;
+    for (std::size_t i = 0; i < paths_of_bundled_files.size(); i++)
+    {
+      if ( (status = extract(i, 0, sizes_of_bundled_files[i], true, chunk)) != STATUS::OK )
+      {
+        /* Abort right away instead of writing the rest of a corrupt bundle. */
+        return fail(status);
+      }
+    }
 
-  std::uint64_t number_of_bundled_files = header.sizes_section_size / sizeof(std::uint64_t);
+    _::record_stats(p_options.stats, metadata.header.files_section_size, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return complete();
+  }
 
-  /* These will be filled with the paths and sizes of each bundled file. */
-  std::vector<std::string> paths_of_bundled_files;
-  std::vector<std::uint64_t> sizes_of_bundled_files;
+  /* Multi-threaded, see _::plan_tasks() and _::Scheduler for how work is cut up and shared. */
+  _::Topology topology = p_options.numa ? _::get_topology() : _::Topology();
 
-  /* Reserve space for the array for efficiency (probably senseless),
-   * since we already know the size of the array because the size of an integer is static unlike a string (file names).
-   */
-  sizes_of_bundled_files.reserve(number_of_bundled_files);
+  if (topology.node_cpus.empty())
+  {
+    topology.node_cpus.emplace_back();
+  }
 
-  p_input_stream.seekg(paths_section_offset);
+  std::vector<std::uint64_t> order;
+  std::vector<_::Task> tasks;
+  /* Cached files are linked whole, they are never split. */
+  _::plan_tasks(sizes_of_bundled_files, topology.node_cpus.size(), p_to_memory || (is_positional_sink<File_Sink>::value && !use_cache), order, tasks);
 
-  /* Grab the file names from the header. */
-  for (int i = 0; i < number_of_bundled_files; i++)
+  /* Split files are created (or allocated) once here, their ranges are then written in place by whichever worker gets them. */
+  for (const auto& task : tasks)
   {
-    std::string file_path;
-    char current_char = CHAR_MAX;
+    if (task.count != 0 || task.offset != 0)
+    {
+      continue;
+    }
 
-    while (current_char != '\0')
+    if (p_to_memory)
     {
-      p_input_stream.read(reinterpret_cast<std::uint8_t*>(&current_char), sizeof(std::uint8_t));
-      file_path += current_char;
+      debundled_files[task.file].get_bytes().resize(sizes_of_bundled_files[task.file]);
+      continue;
     }
 
-    paths_of_bundled_files.push_back(file_path);
+    File_Sink output_stream;
+
+    if ( (status = output_directory.open_file(paths_of_bundled_files[task.file], output_stream)) != STATUS::OK )
+    {
+      return fail(status);
+    }
   }
 
-  //bundle_file.seekg(sizes_section_offset);
+  std::vector<std::vector<std::uint8_t>> chunks(thread_count);
+  std::vector<std::uint64_t> worker_bytes(thread_count);
+  std::atomic<int> first_error{STATUS::OK};
+  _::Scheduler scheduler;
+  scheduler.set_tracer(p_options.tracer);
 
-  /* Grab the file sizes from the header. */
-  for (int i = 0; i < number_of_bundled_files; i++)
+  if (p_options.numa)
   {
-    std::uint64_t file_size = 0;
-    p_input_stream.read(reinterpret_cast<std::uint8_t*>(&file_size), sizeof(std::uint64_t));
-
-    sizes_of_bundled_files.push_back(file_size);
+    scheduler.set_topology(&topology);
   }
 
-  /* Now that we have the file names and sizes, we can prepare for extraction.
-   * First create output directories if necessary.
-   */
-  for (auto& file_path : paths_of_bundled_files)
+  scheduler.run(tasks.size(), thread_count, [&](std::uint64_t p_task, std::uint64_t p_worker) -> bool
   {
-    /* Break instead of indenting with another outer if clause LOL. */
-    if (p_to_memory)
+    auto& task = tasks[p_task];
+    int status = STATUS::OK;
+
+    if (task.count == 0)
     {
-      break;
+      status = extract(task.file, task.offset, task.size, false, chunks[p_worker]);
+      worker_bytes[p_worker] += task.size;
     }
 
-    std::string original_tree;
-
-    for (int i = file_path.size() - 1; i > 0; i--)
+    for (std::uint64_t i = task.first; i < task.first + task.count && status == STATUS::OK; i++)
     {
-      if (file_path[i] == '/' || file_path[i] == '\\')
-      {
-        original_tree = file_path.substr(0, i);
-        break;
-      }
+      status = extract(order[i], 0, sizes_of_bundled_files[order[i]], true, chunks[p_worker]);
+      worker_bytes[p_worker] += sizes_of_bundled_files[order[i]];
     }
 
-    /* Create directory tree. */
-    if (!original_tree.empty())
+    if (status != STATUS::OK)
     {
-      std::string output_tree = original_tree;
+      /* Keep the first error, every worker stops after its current task. */
+      int expected = STATUS::OK;
+      first_error.compare_exchange_strong(expected, status);
+      return false;
+    }
 
-      if (!p_output_directory.empty())
-      {
-        /* Prepend */
-        output_tree = p_output_directory + '/' + std::move(output_tree);
-        file_path = p_output_directory + '/' + std::move(file_path);
-      }
+    return true;
+  }, [&](std::uint64_t p_task) { return tasks[p_task].node; });
 
-      fs::create_directories(output_tree);
-    }
+  _::record_stats(p_options.stats, scheduler, worker_bytes, topology.node_cpus.size());
+
+  if (first_error != STATUS::OK)
+  {
+    return fail(first_error);
   }
 
-  //bundle_file.seekg(files_section_offset);
+  return complete();
+}
 
-  /* Finally debundle files.
-   * Extract files byte by byte.
-   */
-  for (int i = 0; i < paths_of_bundled_files.size(); i++)
+/* Debundle files from disk, reading the bundle through the backend named by Options::backend. */
+inline std::vector<File> debundle(const std::string& p_bundle_path, const std::string& p_output_directory, bool p_to_memory, int* p_status, const Options& p_options)
+{
+  auto options = _::apply_tuning(p_options, p_bundle_path);
+
+  if (options.stats != nullptr)
   {
-    _::Output_Stream output_stream;
+    options.stats->tuning.backend = BACKEND::DESCRIPTOR;
+  }
 
-    auto file_path = paths_of_bundled_files[i];
-    auto file_size = sizes_of_bundled_files[i];
-    debundled_files.push_back({file_path, file_size});
+#ifdef FILE_BUNDLER_POSIX
+  if (options.backend == BACKEND::MAPPED)
+  {
+    _::Mapped_Stream input_stream(p_bundle_path);
 
-    if (p_to_memory)
-    {
-      auto& file_bytes = debundled_files[i].get_bytes();
-      file_bytes.resize(file_bytes.size() + file_size);
-      output_stream.open(file_bytes.data(), file_size);
-    }
-    else
+    /* Empty or unmappable files go through the descriptor backend, which reports them the usual way. */
+    if (input_stream.get_data() != nullptr)
     {
-      output_stream.open(file_path, std::ios::out | std::ios::binary | std::ios::app);
-    }
+      if (options.stats != nullptr)
+      {
+        options.stats->tuning.backend = BACKEND::MAPPED;
+      }
 
-    /* Could be more efficient but whatever... works fine with small to medium sized files. */
-    for (int offset = 0; offset < file_size; offset++)
-    {
-      char byte = CHAR_MAX;
-      p_input_stream.read(reinterpret_cast<std::uint8_t*>(&byte), sizeof(char));
-      output_stream.write(reinterpret_cast<std::uint8_t*>(&byte), sizeof(char));
+      return debundle(input_stream, p_output_directory, p_to_memory, p_status, options);
     }
   }
+#endif
 
-  return debundled_files;
+  _::Disk_Stream input_stream(p_bundle_path, std::ios::in | std::ios::binary);
+  return debundle(input_stream, p_output_directory, p_to_memory, p_status, options);
 }
 
 /* Debundle files from memory to disk.
  * Returns list of de-bundled files. 'bytes' property will be empty when de-bundled to disk.
  */
-std::vector<File> debundle(std::uint8_t* p_bundle_address, std::uint64_t p_bundle_size, const std::string& p_output_directory)
+inline std::vector<File> debundle(std::uint8_t* p_bundle_address, std::uint64_t p_bundle_size, const std::string& p_output_directory, int* p_status = nullptr, const Options& p_options = Options())
 {
-  _::Input_Stream input_stream(p_bundle_address, p_bundle_size);
-  return debundle(input_stream, p_output_directory, false);
+  _::Memory_Stream input_stream(p_bundle_address, p_bundle_size);
+  return debundle(input_stream, p_output_directory, false, p_status, p_options);
 }
 
 /* Debundle files from disk to disk. */
-std::vector<File> debundle(const std::string& p_bundle_path, const std::string& p_output_directory)
+inline std::vector<File> debundle(const std::string& p_bundle_path, const std::string& p_output_directory, int* p_status = nullptr, const Options& p_options = Options())
 {
-  _::Input_Stream input_stream(p_bundle_path, std::ios::in | std::ios::binary);
-  return debundle(input_stream, p_output_directory, false);
+  return debundle(p_bundle_path, p_output_directory, false, p_status, p_options);
 }
 
 /* Debundle files from memory to memory. */
-std::vector<File> debundle(std::uint8_t* p_bundle_address, std::uint64_t p_bundle_size)
+inline std::vector<File> debundle(std::uint8_t* p_bundle_address, std::uint64_t p_bundle_size, int* p_status = nullptr, const Options& p_options = Options())
 {
-  _::Input_Stream input_stream(p_bundle_address, p_bundle_size);
-  return debundle(input_stream, "", true);
+  _::Memory_Stream input_stream(p_bundle_address, p_bundle_size);
+  return debundle(input_stream, "", true, p_status, p_options);
 }
 
 /* Debundle files from disk to memory. */
-std::vector<File> debundle(const std::string& p_bundle_path)
+inline std::vector<File> debundle(const std::string& p_bundle_path, int* p_status = nullptr, const Options& p_options = Options())
+{
+  return debundle(p_bundle_path, "", true, p_status, p_options);
+}
+
+/* Debundle files from a custom source (see is_source) to disk. */
+template <typename Source, typename = std::enable_if_t<is_source<Source>::value>>
+std::vector<File> debundle(Source& p_source, const std::string& p_output_directory, int* p_status = nullptr, const Options& p_options = Options())
+{
+  return debundle(p_source, p_output_directory, false, p_status, p_options);
+}
+
+/* Debundle files from a custom source (see is_source) to memory. */
+template <typename Source, typename = std::enable_if_t<is_source<Source>::value>>
+std::vector<File> debundle(Source& p_source, int* p_status = nullptr, const Options& p_options = Options())
 {
-  _::Input_Stream input_stream(p_bundle_path, std::ios::in | std::ios::binary);
-  return debundle(input_stream, "", true);
+  return debundle(p_source, "", true, p_status, p_options);
 }
 
 /* Debundle files to memory. */
-std::vector<File> debundle(File& p_package)
+inline std::vector<File> debundle(File& p_package, int* p_status = nullptr, const Options& p_options = Options())
 {
   auto buffer_size = p_package.get_bytes().size();
   auto file_path = p_package.get_path();
@@ -561,20 +7435,20 @@ std::vector<File> debundle(File& p_package)
   if (buffer_size > 0)
   {
     /* Debundle files from memory to memory. */
-    return debundle(p_package.get_bytes().data(), buffer_size);
+    return debundle(p_package.get_bytes().data(), buffer_size, p_status, p_options);
   }
 
   if (!file_path.empty())
   {
     /* Debundle files from disk to memory. */
-    return debundle(file_path);
+    return debundle(file_path, p_status, p_options);
   }
 
   return {};
 }
 
 /* Debundle files to disk. */
-std::vector<File> debundle(File& p_package, const std::string& p_output_directory)
+inline std::vector<File> debundle(File& p_package, const std::string& p_output_directory, int* p_status = nullptr, const Options& p_options = Options())
 {
   auto buffer_size = p_package.get_bytes().size();
   auto file_path = p_package.get_path();
@@ -582,13 +7456,13 @@ std::vector<File> debundle(File& p_package, const std::string& p_output_director
   if (buffer_size > 0)
   {
     /* Debundle files from memory to disk. */
-    return debundle(p_package.get_bytes().data(), buffer_size, p_output_directory);
+    return debundle(p_package.get_bytes().data(), buffer_size, p_output_directory, p_status, p_options);
   }
 
   if (!file_path.empty())
   {
     /* Debundle files from disk to disk. */
-    return debundle(file_path, p_output_directory);
+    return debundle(file_path, p_output_directory, p_status, p_options);
   }
 
   return {};
@@ -0,0 +1,46 @@
+/* libFuzzer target: arbitrary bytes as a bundle in memory, fed to debundle() and to both readers.
+ * Built by fuzz/CMakeLists.txt, see FILE_BUNDLER_FUZZ there.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* p_data, std::size_t p_size)
+{
+  /* A buffer of exactly p_size bytes, so AddressSanitizer catches reads past the end of the bundle. */
+  std::vector<std::uint8_t> bundle(p_data, p_data + p_size);
+  std::uint8_t page[4096];
+  int status = fb::STATUS::OK;
+
+  fb::debundle(bundle.data(), bundle.size(), &status);
+
+  /* Entries are read a page at a time, sizes claimed by a corrupt bundle must not turn into allocations. */
+  fb::Memory_Reader reader(bundle.data(), bundle.size());
+
+  if (reader.get_status() == fb::STATUS::OK || reader.get_status() == fb::STATUS::MISSING_CHUNK)
+  {
+    for (std::uint64_t i = 0; i < reader.get_file_count(); i++)
+    {
+      reader.find(reader.get_path(i));
+      reader.read(i, 0, page, std::min<std::uint64_t>(reader.get_size(i), sizeof(page)));
+    }
+  }
+
+  fb::Indexed_Memory_Reader indexed_reader(bundle.data(), bundle.size());
+
+  if (indexed_reader.get_status() == fb::STATUS::OK)
+  {
+    for (std::uint64_t i = 0; i < indexed_reader.get_file_count(); i++)
+    {
+      indexed_reader.find(indexed_reader.get_path(i));
+      indexed_reader.read(i, 0, page, std::min<std::uint64_t>(indexed_reader.get_size(i), sizeof(page)));
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,94 @@
+/* Stand-in for libFuzzer's main() with compilers that don't ship it.
+ * Runs LLVMFuzzerTestOneInput() over the files (or directories of files) given, e.g. a corpus or a crash found by
+ * the fuzzer. Without arguments it runs a fixed number of random mutations of a few valid bundles instead, which is
+ * what the test registered in fuzz/CMakeLists.txt does.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* p_data, std::size_t p_size);
+
+static constexpr int MUTATION_COUNT = 20000;
+
+static void replay(const fs::path& p_path)
+{
+  std::ifstream file(p_path, std::ios::binary);
+  std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  LLVMFuzzerTestOneInput(bytes.data(), bytes.size());
+}
+
+static void mutate()
+{
+  std::vector<fb::File> files =
+  {
+    {"a", std::vector<std::uint8_t>(100, 1)},
+    {"dir/b", std::vector<std::uint8_t>(1000, 2)},
+    {"c", std::vector<std::uint8_t>()}
+  };
+
+  fb::Options indexed;
+  indexed.index = true;
+
+  std::vector<std::vector<std::uint8_t>> seeds =
+  {
+    fb::bundle(files).get_bytes(),
+    fb::bundle(files, nullptr, indexed).get_bytes()
+  };
+
+  std::mt19937_64 random(1);
+
+  for (int i = 0; i < MUTATION_COUNT; i++)
+  {
+    auto bytes = seeds[i % seeds.size()];
+
+    for (int j = 1 + random() % 4; j > 0; j--)
+    {
+      bytes[random() % bytes.size()] = static_cast<std::uint8_t>(random());
+    }
+
+    if (random() % 4 == 0)
+    {
+      bytes.resize(random() % bytes.size());
+    }
+
+    LLVMFuzzerTestOneInput(bytes.data(), bytes.size());
+  }
+}
+
+int main(int p_argc, char** p_argv)
+{
+  if (p_argc < 2)
+  {
+    mutate();
+  }
+
+  for (int i = 1; i < p_argc; i++)
+  {
+    if (fs::is_directory(p_argv[i]))
+    {
+      for (const auto& entry : fs::directory_iterator(p_argv[i]))
+      {
+        replay(entry.path());
+      }
+    }
+    else
+    {
+      replay(p_argv[i]);
+    }
+  }
+
+  std::cout << "ok" << std::endl;
+  return 0;
+}
@@ -0,0 +1,167 @@
+/* Counts heap allocations made by each API call through a replaced operator new, and fails if one makes more
+ * allocations, or allocates more bytes, than it should for the number of files. This is what keeps per-entry
+ * vectors, copies of File objects in loops and resizes per write from coming back unnoticed.
+ * Each call also reports its count, bytes and the peak RSS of the process so far.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+static std::atomic<std::uint64_t> allocation_count{0};
+static std::atomic<std::uint64_t> allocated_bytes{0};
+
+void* operator new(std::size_t p_size)
+{
+  allocation_count++;
+  allocated_bytes += p_size;
+
+  if (void* address = std::malloc(p_size == 0 ? 1 : p_size))
+  {
+    return address;
+  }
+
+  throw std::bad_alloc();
+}
+
+/* GCC inlines these into callers and then sees free() called on what it assumes came from the default operator new,
+ * not the malloc() above, and warns with -Wmismatched-new-delete. The pairs do match.
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* p_address) noexcept
+{
+  std::free(p_address);
+}
+
+void operator delete(void* p_address, std::size_t) noexcept
+{
+  std::free(p_address);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static constexpr std::uint64_t FILE_COUNT = 2000;
+static constexpr std::uint64_t FILE_SIZE = 32 << 10;
+static constexpr std::uint64_t PAYLOAD_SIZE = FILE_COUNT * FILE_SIZE;
+
+/* Room for buffers and metadata that don't grow with the contents. */
+static constexpr std::uint64_t SLACK_BYTES = 2 << 20;
+
+static int failures = 0;
+
+/* Allocations made between construction and check(). */
+class Allocation_Scope
+{
+  private:
+  std::string name;
+  std::uint64_t count = allocation_count;
+  std::uint64_t bytes = allocated_bytes;
+
+  public:
+  /* Reports the allocations so far and fails if there are more than p_max_count or more than p_max_bytes bytes. */
+  void check(std::uint64_t p_max_count, std::uint64_t p_max_bytes)
+  {
+    std::uint64_t count = allocation_count - this->count;
+    std::uint64_t bytes = allocated_bytes - this->bytes;
+    rusage usage;
+
+    ::getrusage(RUSAGE_SELF, &usage);
+    std::cout << this->name << ": " << count << " allocations, " << bytes / 1024 << " KiB, peak RSS " << usage.ru_maxrss / 1024 << " MiB" << std::endl;
+
+    if (count > p_max_count || bytes > p_max_bytes)
+    {
+      std::cerr << "FAILED: " << this->name << " allowed " << p_max_count << " allocations, " << p_max_bytes / 1024 << " KiB" << std::endl;
+      failures++;
+    }
+  }
+
+  Allocation_Scope(const std::string& p_name) : name(p_name) {}
+};
+
+int main(int p_argc, char** p_argv)
+{
+  fs::path directory = fs::absolute(fs::path(p_argc > 1 ? p_argv[1] : ".") / "allocations_test");
+  std::string bundle_path = (directory / "test.bundle").string();
+  std::vector<fb::File> files;
+  int status = -1;
+
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+  files.reserve(FILE_COUNT);
+
+  for (std::uint64_t i = 0; i < FILE_COUNT; i++)
+  {
+    files.emplace_back("dir/file" + std::to_string(i), std::vector<std::uint8_t>(FILE_SIZE, static_cast<std::uint8_t>(i)));
+  }
+
+  /* The output buffer and a constant number of others, nothing per file. */
+  fb::File package;
+  {
+    Allocation_Scope scope("bundle to memory");
+    package = fb::bundle(files, &status);
+    scope.check(8, PAYLOAD_SIZE + SLACK_BYTES);
+  }
+
+  {
+    Allocation_Scope scope("bundle to disk");
+    fb::bundle(bundle_path, files, &status);
+    scope.check(8, SLACK_BYTES);
+  }
+
+  /* One buffer per extracted file, which is what the returned Files own. */
+  std::vector<fb::File> debundled_files;
+  {
+    Allocation_Scope scope("debundle to memory");
+    debundled_files = fb::debundle(package, &status);
+    scope.check(FILE_COUNT + 16, PAYLOAD_SIZE + SLACK_BYTES);
+  }
+
+  if (status != fb::STATUS::OK || debundled_files.size() != FILE_COUNT || debundled_files.back().get_bytes() != files.back().get_bytes())
+  {
+    std::cerr << "FAILED: debundled files differ" << std::endl;
+    failures++;
+  }
+
+  /* A few for the path of each output file, no contents go through the heap. */
+  {
+    Allocation_Scope scope("debundle to disk");
+    fb::debundle(bundle_path, (directory / "output").string(), &status);
+    scope.check(4 * FILE_COUNT + 32, SLACK_BYTES);
+  }
+
+  /* Exactly the returned buffer per read. */
+  {
+    fb::Reader reader(bundle_path);
+    Allocation_Scope scope("Reader::read");
+
+    for (std::uint64_t i = 0; i < FILE_COUNT; i++)
+    {
+      reader.read(i, &status);
+    }
+
+    scope.check(FILE_COUNT, PAYLOAD_SIZE);
+  }
+
+  fs::remove_all(directory);
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+/* Extraction through Options::cache_directory: a bundle seen before is extracted from the cache without reading its
+ * payload, new bundles are read once, objects are stored read-only and extracted files can be changed without
+ * changing later extractions. Objects that went missing and bundles rewritten in place are noticed.
+ * Takes the directory to work in as its argument, the current one by default.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+static std::vector<std::uint8_t> read_bytes(const fs::path& p_path)
+{
+  std::ifstream stream(p_path, std::ios::binary);
+  return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+/* True if every file of p_files is in p_directory with its contents. */
+static bool check_output(const fs::path& p_directory, const std::vector<fb::File>& p_files)
+{
+  for (const auto& file : p_files)
+  {
+    if (read_bytes(p_directory / file.get_path()) != file.get_bytes())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Bundle in memory that counts the bytes read from it. */
+struct Counting_Source
+{
+  const std::vector<std::uint8_t>& bytes;
+  std::atomic<std::uint64_t> bytes_read{0};
+
+  explicit Counting_Source(const std::vector<std::uint8_t>& p_bytes) : bytes(p_bytes) {}
+
+  std::uint64_t get_size()
+  {
+    return this->bytes.size();
+  }
+
+  int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    if (p_offset > this->bytes.size() || p_size > this->bytes.size() - p_offset)
+    {
+      return fb::STATUS::TRUNCATED;
+    }
+
+    std::memcpy(p_address, this->bytes.data() + p_offset, p_size);
+    this->bytes_read += p_size;
+    return fb::STATUS::OK;
+  }
+};
+
+static std::vector<fb::File> make_files(std::uint8_t p_seed)
+{
+  std::vector<fb::File> files;
+
+  for (std::uint64_t size : {300000, 70000, 4096, 1, 0})
+  {
+    std::vector<std::uint8_t> bytes(size);
+
+    for (std::uint64_t i = 0; i < size; i++)
+    {
+      bytes[i] = static_cast<std::uint8_t>(i * 11 + size + p_seed);
+    }
+
+    files.emplace_back("dir/file" + std::to_string(files.size()), std::move(bytes));
+  }
+
+  return files;
+}
+
+int main(int p_argc, char** p_argv)
+{
+  fs::path directory = fs::absolute(fs::path(p_argc > 1 ? p_argv[1] : ".") / "cache_test");
+  std::string bundle_path = (directory / "test.bundle").string();
+  auto files = make_files(0);
+  int status = -1;
+
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+
+  fb::bundle(bundle_path, files, &status);
+  check(status == fb::STATUS::OK, "bundle");
+
+  fb::Stats stats;
+  fb::Options options;
+  options.cache_directory = (directory / "cache").string();
+  options.stats = &stats;
+
+  /* Cold: every file goes into the cache. */
+  fb::debundle(bundle_path, (directory / "cold").string(), &status, options);
+  check(status == fb::STATUS::OK && check_output(directory / "cold", files) && stats.cache_hits == 0, "cold extraction");
+
+  std::uint64_t object_count = 0;
+
+  for (const auto& object : fs::directory_iterator(directory / "cache" / "objects"))
+  {
+    auto permissions = object.status().permissions();
+    check((permissions & (fs::perms::owner_write | fs::perms::group_write | fs::perms::others_write)) == fs::perms::none,
+          object.path().filename().string() + " is read-only");
+    object_count++;
+  }
+
+  check(object_count == files.size(), "one object per distinct file");
+
+  /* Extracted files are the output's own: changing one leaves the cache alone. */
+  {
+    std::ofstream stream(directory / "cold" / files[0].get_path(), std::ios::binary | std::ios::trunc);
+    stream << "changed";
+  }
+
+  /* Warm: everything from the cache. */
+  fb::debundle(bundle_path, (directory / "warm").string(), &status, options);
+  check(status == fb::STATUS::OK && check_output(directory / "warm", files) && stats.cache_hits == files.size(), "warm extraction");
+
+  /* A missing object is put back from the bundle. */
+  for (const auto& object : fs::directory_iterator(directory / "cache" / "objects"))
+  {
+    if (object.file_size() == files[1].get_size())
+    {
+      fs::remove(object.path());
+    }
+  }
+
+  fb::debundle(bundle_path, (directory / "repaired").string(), &status, options);
+  check(status == fb::STATUS::OK && check_output(directory / "repaired", files) && stats.cache_hits == files.size() - 1, "missing object");
+
+  /* Hard links, where asked for, are the read-only objects. */
+  options.cache_hard_links = true;
+  fb::debundle(bundle_path, (directory / "linked").string(), &status, options);
+  check(status == fb::STATUS::OK && check_output(directory / "linked", files) && stats.cache_hits == files.size(), "hard linked extraction");
+  options.cache_hard_links = false;
+
+  /* A bundle rewritten in place with the same paths and sizes is a new bundle. */
+  auto changed_files = make_files(1);
+  fs::remove(bundle_path);
+  fb::bundle(bundle_path, changed_files, &status);
+  fb::debundle(bundle_path, (directory / "changed").string(), &status, options);
+  check(status == fb::STATUS::OK && check_output(directory / "changed", changed_files), "rewritten bundle");
+
+  /* Bundles that aren't files have no manifest, but read each entry only once, and share objects. */
+  {
+    fb::File package = fb::bundle(files, &status);
+    Counting_Source source(package.get_bytes());
+    fb::debundle(source, (directory / "memory").string(), &status, options);
+
+    std::uint64_t payload = 0;
+
+    for (const auto& file : files)
+    {
+      payload += file.get_size();
+    }
+
+    check(status == fb::STATUS::OK && check_output(directory / "memory", files) && stats.cache_hits == files.size(), "bundle in memory");
+    check(source.bytes_read < package.get_size() + payload / 2, "entries are read once");
+  }
+
+  fs::remove_all(directory);
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+/* Bundling into Options::chunk_store: chunks already in the store are reused only if their contents match, so a
+ * damaged chunk is replaced by the next bundle that has it, and unreferenced chunks are collected.
+ * Takes the directory to work in as its argument, the current one by default.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+/* True if p_bundle_path debundles to p_files through p_options.chunk_store. */
+static bool check_bundle(const std::string& p_bundle_path, const std::vector<fb::File>& p_files, const fb::Options& p_options)
+{
+  int status = -1;
+  auto debundled_files = fb::debundle(p_bundle_path, &status, p_options);
+
+  if (status != fb::STATUS::OK || debundled_files.size() != p_files.size())
+  {
+    return false;
+  }
+
+  for (std::uint64_t i = 0; i < p_files.size(); i++)
+  {
+    if (debundled_files[i].get_bytes() != p_files[i].get_bytes())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int main(int p_argc, char** p_argv)
+{
+  fs::path directory = fs::absolute(fs::path(p_argc > 1 ? p_argv[1] : ".") / "chunk_store_test");
+  std::string first_path = (directory / "first.bundle").string();
+  std::string second_path = (directory / "second.bundle").string();
+  std::vector<fb::File> files;
+  int status = -1;
+
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+
+  for (std::uint64_t size : {1 << 20, 70000, 1})
+  {
+    std::vector<std::uint8_t> bytes(size);
+
+    for (std::uint64_t i = 0; i < size; i++)
+    {
+      bytes[i] = static_cast<std::uint8_t>((i * 2654435761u) >> 13);
+    }
+
+    files.emplace_back("file" + std::to_string(files.size()), std::move(bytes));
+  }
+
+  fb::Options options;
+  options.chunk_store = (directory / "store").string();
+  fb::bundle(first_path, files, &status, options);
+  check(status == fb::STATUS::OK && check_bundle(first_path, files, options), "first bundle");
+
+  /* Damage every stored chunk, keeping its size. */
+  std::uint64_t damaged = 0;
+
+  for (const auto& object : fs::directory_iterator(directory / "store" / "objects"))
+  {
+    auto size = object.file_size();
+    fs::permissions(object.path(), fs::perms::owner_write, fs::perm_options::add);
+    std::ofstream(object.path(), std::ios::binary | std::ios::trunc) << std::string(size, 'x');
+    damaged++;
+  }
+
+  check(damaged != 0 && !check_bundle(first_path, files, options), "damaged chunks");
+
+  /* A bundle with the same contents stores them again, which repairs the first bundle too. */
+  fb::bundle(second_path, files, &status, options);
+  check(status == fb::STATUS::OK && check_bundle(second_path, files, options), "second bundle");
+  check(check_bundle(first_path, files, options), "first bundle repaired");
+
+  /* Nothing goes while bundles refer to it, everything once none does. */
+  std::uint64_t removed_count = 0;
+  check(fb::collect_garbage(options.chunk_store, {first_path, second_path}, 0, &removed_count) == fb::STATUS::OK && removed_count == 0, "referenced chunks stay");
+  check(fb::collect_garbage(options.chunk_store, {}, 0, &removed_count) == fb::STATUS::OK && removed_count == damaged, "unreferenced chunks go");
+
+  fs::remove_all(directory);
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
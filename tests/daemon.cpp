@@ -0,0 +1,216 @@
+/* Daemon and Client over a socket in a temporary directory: bundles are opened once however many clients use them,
+ * files are found and read through the client's mapping, paths can't leave the daemon's root, not even through
+ * symlinks, many clients can be served at once, and clients past the connection limit wait for a free one.
+ * Takes the directory to work in as its argument, the current one by default.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+static std::vector<fb::File> make_files(const std::string& p_prefix, std::uint64_t p_count)
+{
+  std::vector<fb::File> files;
+
+  for (std::uint64_t i = 0; i < p_count; i++)
+  {
+    std::vector<std::uint8_t> bytes(i * 1000);
+
+    for (std::uint64_t j = 0; j < bytes.size(); j++)
+    {
+      bytes[j] = static_cast<std::uint8_t>(i + j);
+    }
+
+    files.emplace_back(p_prefix + std::to_string(i), std::move(bytes));
+  }
+
+  return files;
+}
+
+/* Finds and reads every file of p_files through p_client, both through get_address() and read(). */
+static bool check_files(fb::Client& p_client, std::uint32_t p_bundle, const std::vector<fb::File>& p_files)
+{
+  for (std::uint64_t i = 0; i < p_files.size(); i++)
+  {
+    fb::Client::Entry entry;
+    std::vector<std::uint8_t> bytes(p_files[i].get_size());
+
+    if (p_client.find(p_bundle, p_files[i].get_path(), entry) != fb::STATUS::OK || entry.index != i || entry.size != p_files[i].get_size())
+    {
+      return false;
+    }
+
+    auto address = p_client.get_address(p_bundle, entry);
+
+    if (address == nullptr || (entry.size != 0 && std::memcmp(address, p_files[i].get_bytes().data(), entry.size) != 0) ||
+        p_client.read(p_bundle, entry, 0, bytes.data(), bytes.size()) != fb::STATUS::OK || bytes != p_files[i].get_bytes())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int main(int p_argc, char** p_argv)
+{
+  fs::path directory = fs::absolute(fs::path(p_argc > 1 ? p_argv[1] : ".") / "daemon_test");
+  fs::path root = directory / "root";
+  fs::path outside = directory / "outside";
+  int status = -1;
+
+  fs::remove_all(directory);
+  fs::create_directories(root / "sub");
+  fs::create_directories(outside);
+
+  /* Socket paths are short (sun_path), so the socket is named relative to the working directory. */
+  fs::current_path(directory);
+  const std::string socket_path = "daemon.socket";
+
+  auto files = make_files("a/file", 20);
+  auto sub_files = make_files("b/file", 5);
+  fb::bundle((root / "a.bundle").string(), files, &status);
+  fb::bundle((root / "sub" / "b.bundle").string(), sub_files, &status);
+  fb::bundle((outside / "secret.bundle").string(), files, &status);
+  std::ofstream(root / "garbage.bundle", std::ios::binary) << "not a bundle";
+  fs::create_symlink(outside / "secret.bundle", root / "link.bundle");
+  fs::create_directory_symlink(outside, root / "linked");
+
+  {
+    fb::Daemon daemon;
+    check(daemon.open(socket_path, root.string()) == fb::STATUS::OK, "daemon open");
+    std::thread server([&] { daemon.run(); });
+
+    fb::Client client;
+    check(client.connect(socket_path) == fb::STATUS::OK, "connect");
+
+    std::uint32_t bundle = 0;
+    std::uint64_t file_count = 0;
+    check(client.open("a.bundle", bundle, &file_count) == fb::STATUS::OK && file_count == files.size(), "open");
+    check(check_files(client, bundle, files), "find and read");
+
+    fb::Client::Entry entry;
+    check(client.find(bundle, "a/missing", entry) == fb::STATUS::OUT_OF_RANGE, "missing file");
+    check(client.find(bundle + 100, "a/file1", entry) == fb::STATUS::OUT_OF_RANGE, "bundle that isn't open");
+
+    /* One bundle, however it is named. */
+    std::uint32_t sub_bundle = 0;
+    std::uint32_t same_bundle = 0;
+    check(client.open("sub/b.bundle", sub_bundle) == fb::STATUS::OK && check_files(client, sub_bundle, sub_files), "open in a subdirectory");
+    check(client.open("./sub//b.bundle", same_bundle) == fb::STATUS::OK && same_bundle == sub_bundle, "same bundle under another name");
+
+    /* Nothing outside the root, and nothing but bundles. */
+    for (const std::string path : {"../outside/secret.bundle", "sub/../../outside/secret.bundle", "link.bundle", "linked/secret.bundle", "sub", "", "/tmp"})
+    {
+      std::uint32_t unsafe_bundle = 0;
+      check(client.open(path, unsafe_bundle) == fb::STATUS::UNSAFE_PATH, "\"" + path + "\" is refused");
+    }
+
+    std::uint32_t other_bundle = 0;
+    check(client.open("missing.bundle", other_bundle) == fb::STATUS::IO_ERROR, "missing bundle");
+    check(client.open("garbage.bundle", other_bundle) != fb::STATUS::OK, "not a bundle");
+
+    /* Closed bundles can't be used any more. */
+    client.close(sub_bundle);
+    check(client.find(sub_bundle, "b/file1", entry) == fb::STATUS::OUT_OF_RANGE && client.get_address(sub_bundle, entry) == nullptr, "closed bundle");
+
+    /* Many clients at once, opening the same bundles: they all get the same one. */
+    std::vector<std::thread> threads;
+    std::atomic<std::uint64_t> good{0};
+
+    for (int thread = 0; thread < 8; thread++)
+    {
+      threads.emplace_back([&]
+      {
+        fb::Client thread_client;
+        std::uint32_t thread_bundle = 0;
+        std::uint32_t thread_sub_bundle = 0;
+        bool ok = thread_client.connect(socket_path) == fb::STATUS::OK && thread_client.open("a.bundle", thread_bundle) == fb::STATUS::OK &&
+                  thread_bundle == bundle && thread_client.open("sub/b.bundle", thread_sub_bundle) == fb::STATUS::OK;
+
+        for (int i = 0; i < 20 && ok; i++)
+        {
+          ok = check_files(thread_client, thread_bundle, files) && check_files(thread_client, thread_sub_bundle, sub_files);
+        }
+
+        good += ok ? 1 : 0;
+      });
+    }
+
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+
+    check(good == threads.size(), "concurrent clients");
+
+    /* Clients that disconnected released their bundles; the first client still has its own. */
+    check(check_files(client, bundle, files), "bundle still open after other clients left");
+
+    daemon.stop();
+    server.join();
+  }
+
+  /* Past the connection limit, a client is only served once another one disconnects. */
+  {
+    fb::Daemon daemon;
+    daemon.set_connection_limit(1);
+    check(daemon.open(socket_path, root.string()) == fb::STATUS::OK, "limited daemon open");
+    std::thread server([&] { daemon.run(); });
+
+    fb::Client first;
+    std::uint32_t bundle = 0;
+    check(first.connect(socket_path) == fb::STATUS::OK && first.open("a.bundle", bundle) == fb::STATUS::OK, "first client");
+
+    std::atomic<bool> served{false};
+    std::atomic<int> second_status{-1};
+
+    std::thread second_thread([&]
+    {
+      fb::Client second;
+      std::uint32_t second_bundle = 0;
+      int connect_status = second.connect(socket_path);
+      second_status = connect_status == fb::STATUS::OK ? second.open("a.bundle", second_bundle) : connect_status;
+      served = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    check(!served, "second client waits while the first is connected");
+
+    first.close();
+    second_thread.join();
+    check(served && second_status == fb::STATUS::OK, "second client is served once the first has gone");
+
+    daemon.stop();
+    server.join();
+  }
+
+  fs::current_path(directory.parent_path());
+  fs::remove_all(directory);
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+/* Lookups through the index of a bundle (Options::index, Basic_Indexed_Reader): every path is found at its index,
+ * paths that aren't bundled are not, whatever slot they hash to, slots that collide are probed past, and duplicate
+ * paths find the first one, as with Basic_Reader. A bundle without an index or with a broken one is refused.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+static fb::File bundle_indexed(const std::vector<fb::File>& p_files)
+{
+  fb::Options options;
+  int status = -1;
+  options.index = true;
+
+  fb::File package = fb::bundle(p_files, &status, options);
+  check(status == fb::STATUS::OK, "bundle with an index");
+  return package;
+}
+
+/* Slot a path is probed from in a table of p_slot_count slots. */
+static std::uint64_t get_home_slot(const std::string& p_path, std::uint64_t p_slot_count)
+{
+  return fb::_::hash_path(p_path.data(), p_path.size()) & (p_slot_count - 1);
+}
+
+int main()
+{
+  /* Many files, so probe chains of every length come up, and every file is compared with the plain reader. */
+  {
+    std::vector<fb::File> files;
+
+    for (std::uint64_t i = 0; i < 5000; i++)
+    {
+      std::string path = "dir" + std::to_string(i % 13) + "/file" + std::to_string(i) + ".txt";
+      files.emplace_back(path, std::vector<std::uint8_t>(i % 97, static_cast<std::uint8_t>(i)));
+    }
+
+    /* Duplicates of earlier paths, found as the first one. */
+    files.emplace_back(files[10].get_path(), std::vector<std::uint8_t>{1, 2, 3});
+    files.emplace_back(files[4000].get_path(), std::vector<std::uint8_t>{4, 5, 6});
+
+    fb::File package = bundle_indexed(files);
+    fb::Indexed_Memory_Reader reader(package.get_bytes().data(), package.get_bytes().size());
+    fb::Memory_Reader plain_reader(package.get_bytes().data(), package.get_bytes().size());
+
+    check(reader.get_status() == fb::STATUS::OK && reader.get_file_count() == files.size(), "open");
+
+    bool found = true;
+    bool same = true;
+
+    for (std::uint64_t i = 0; i < files.size() - 2; i++)
+    {
+      found = found && reader.find(files[i].get_path()) == static_cast<std::int64_t>(i);
+      same = same && reader.get_path(i) == files[i].get_path() && reader.get_size(i) == files[i].get_size() &&
+             reader.get_offset(i) == plain_reader.get_offset(i) &&
+             (files[i].get_size() == 0 || std::memcmp(reader.get_data(i), files[i].get_bytes().data(), files[i].get_size()) == 0);
+    }
+
+    check(found, "every path is found at its index");
+    check(same, "entries match the plain reader");
+    check(reader.find(files[10].get_path()) == 10 && reader.find(files[4000].get_path()) == 4000, "duplicate paths find the first one");
+
+    /* Missing paths, including ones that only differ from bundled ones at the end or in case. */
+    bool missing = true;
+
+    for (const std::string path : {"", "dir0", "dir0/", "dir1/file1.tx", "dir1/file1.txt.", "DIR1/file1.txt", "dir1/file1.txt/", "nothing"})
+    {
+      missing = missing && reader.find(path) == -1;
+    }
+
+    for (std::uint64_t i = 5000; i < 20000; i++)
+    {
+      missing = missing && reader.find("dir" + std::to_string(i % 13) + "/file" + std::to_string(i) + ".txt") == -1;
+    }
+
+    check(missing, "missing paths are not found");
+
+    /* Reads are checked against the entry's size. */
+    std::uint8_t byte = 0;
+    check(reader.read(96, 95, &byte, 1) == fb::STATUS::OK && byte == 96, "read in range");
+    check(reader.read(96, 96, &byte, 1) == fb::STATUS::OUT_OF_RANGE && reader.read(files.size(), 0, &byte, 0) == fb::STATUS::OUT_OF_RANGE, "read out of range");
+    check(reader.get_data(files.size()) == nullptr && reader.get_path(files.size()).empty(), "no entry past the last file");
+  }
+
+  /* Paths that share their home slot: the second one is placed further along and still found. */
+  {
+    std::vector<fb::File> files;
+    std::vector<std::string> colliding;
+
+    /* Three files make an 8 slot table. */
+    for (std::uint64_t i = 0; colliding.size() < 3; i++)
+    {
+      std::string path = "collision" + std::to_string(i);
+
+      if (get_home_slot(path, 8) == 5)
+      {
+        colliding.push_back(path);
+        files.emplace_back(path, std::vector<std::uint8_t>{static_cast<std::uint8_t>(i)});
+      }
+    }
+
+    fb::File package = bundle_indexed(files);
+    fb::Indexed_Memory_Reader reader(package.get_bytes().data(), package.get_bytes().size());
+
+    check(reader.get_status() == fb::STATUS::OK, "open colliding");
+    check(reader.find(colliding[0]) == 0 && reader.find(colliding[1]) == 1 && reader.find(colliding[2]) == 2, "colliding paths are found");
+
+    /* A missing path with the same home slot runs the chain to its end. */
+    for (std::uint64_t i = 0; ; i++)
+    {
+      std::string path = "missing" + std::to_string(i);
+
+      if (get_home_slot(path, 8) == 5)
+      {
+        check(reader.find(path) == -1, "missing colliding path is not found");
+        break;
+      }
+    }
+
+    /* A slot whose hash matches but whose path doesn't (a full hash collision) is probed past:
+     * file 1's slot is given file 0's hash and put first in file 0's chain.
+     */
+    auto& bytes = package.get_bytes();
+    auto slots = bytes.data() + bytes.size() - 8 * sizeof(fb::_::Index_Slot);
+    std::uint64_t hash = fb::_::hash_path(colliding[0].data(), colliding[0].size());
+    fb::_::Index_Slot table[8] = {};
+
+    table[5] = {hash, 2};
+    table[6] = {hash, 1};
+    std::memcpy(slots, table, sizeof(table));
+
+    fb::Indexed_Memory_Reader patched_reader(bytes.data(), bytes.size());
+    check(patched_reader.get_status() == fb::STATUS::OK && patched_reader.find(colliding[0]) == 0, "equal hashes are told apart by path");
+
+    /* A full table with no empty slot still ends the search. */
+    for (auto& slot : table)
+    {
+      slot = {hash, 2};
+    }
+
+    std::memcpy(slots, table, sizeof(table));
+    fb::Indexed_Memory_Reader full_reader(bytes.data(), bytes.size());
+    check(full_reader.find(colliding[0]) == -1, "a full table ends the search");
+  }
+
+  /* An empty bundle has an index too. */
+  {
+    fb::File package = bundle_indexed({});
+    fb::Indexed_Memory_Reader reader(package.get_bytes().data(), package.get_bytes().size());
+    check(reader.get_status() == fb::STATUS::OK && reader.get_file_count() == 0 && reader.find("") == -1 && reader.find("a") == -1, "empty bundle");
+  }
+
+  /* Bundles without an index, and with a damaged one. */
+  {
+    std::vector<fb::File> files;
+    int status = -1;
+    files.emplace_back("a", std::vector<std::uint8_t>{1});
+    files.emplace_back("b", std::vector<std::uint8_t>{2});
+
+    fb::File plain = fb::bundle(files, &status);
+    fb::Indexed_Memory_Reader plain_reader(plain.get_bytes().data(), plain.get_bytes().size());
+    check(plain_reader.get_status() == fb::STATUS::MISSING_INDEX && plain_reader.find("a") == -1, "no index");
+
+    fb::File package = bundle_indexed(files);
+    auto& bytes = package.get_bytes();
+
+    fb::Indexed_Memory_Reader truncated_reader(bytes.data(), bytes.size() - 1);
+    check(truncated_reader.get_status() != fb::STATUS::OK && truncated_reader.get_file_count() == 0, "truncated index");
+
+    /* Entry 0 pointing past the files section is refused when it is used. */
+    auto entries = bytes.data() + bytes.size() - 4 * sizeof(fb::_::Index_Slot) - 2 * sizeof(fb::_::Index_Entry);
+    fb::_::Index_Entry entry;
+    std::memcpy(&entry, entries, sizeof(entry));
+    entry.size = 1 << 20;
+    std::memcpy(entries, &entry, sizeof(entry));
+
+    std::uint8_t byte = 0;
+    fb::Indexed_Memory_Reader corrupt_reader(bytes.data(), bytes.size());
+    check(corrupt_reader.get_status() == fb::STATUS::OK && corrupt_reader.read(0, 0, &byte, 1) == fb::STATUS::CORRUPT && corrupt_reader.get_data(0) == nullptr, "corrupt entry");
+    check(corrupt_reader.find("b") == 1, "other entries still work");
+  }
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
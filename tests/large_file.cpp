@@ -0,0 +1,152 @@
+/* Bundles and extracts a sparse 6 GiB file, with marks written around the 2^31 and 2^32 byte boundaries, so every
+ * offset, size and loop counter on the way has to be 64-bit. The holes keep the source cheap to make, the bundle and
+ * the extracted copy take up real disk space (up to 12 GiB) while the test runs.
+ * Takes the directory to work in as its argument, the current one by default.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+static constexpr std::uint64_t LARGE_FILE_SIZE = 6ULL << 30;
+
+static const std::uint64_t MARK_OFFSETS[] =
+{
+  0,
+  (1ULL << 31) - 4,
+  (1ULL << 32) - 4,
+  (5ULL << 30) + 12345,
+  LARGE_FILE_SIZE - 8
+};
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+/* The eight bytes at p_offset, distinct for every mark. */
+static std::uint64_t get_mark(std::uint64_t p_offset)
+{
+  return p_offset * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+static bool write_sparse_file(const std::string& p_path)
+{
+  int descriptor = ::open(p_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool written = descriptor >= 0 && ::ftruncate(descriptor, LARGE_FILE_SIZE) == 0;
+
+  for (std::uint64_t offset : MARK_OFFSETS)
+  {
+    std::uint64_t mark = get_mark(offset);
+    written = written && ::pwrite(descriptor, &mark, sizeof(mark), offset) == sizeof(mark);
+  }
+
+  if (descriptor >= 0)
+  {
+    ::close(descriptor);
+  }
+
+  return written;
+}
+
+/* Checks the marks (and a zero from a hole) through p_read(offset, address, size). */
+template <typename Read>
+static void check_marks(const std::string& p_what, Read p_read)
+{
+  for (std::uint64_t offset : MARK_OFFSETS)
+  {
+    std::uint64_t mark = 0;
+    check(p_read(offset, reinterpret_cast<std::uint8_t*>(&mark), sizeof(mark)) == fb::STATUS::OK && mark == get_mark(offset),
+      p_what + ": mark at " + std::to_string(offset));
+  }
+
+  std::uint64_t hole = 1;
+  check(p_read(3ULL << 30, reinterpret_cast<std::uint8_t*>(&hole), sizeof(hole)) == fb::STATUS::OK && hole == 0, p_what + ": hole");
+}
+
+int main(int p_argc, char** p_argv)
+{
+  /* Bundled paths have to be relative, so everything happens in the directory. */
+  fs::path directory = fs::absolute(fs::path(p_argc > 1 ? p_argv[1] : ".") / "large_file_test");
+  std::string large_path = "large.bin";
+  std::string small_path = "small.txt";
+  std::string bundle_path = "large.bundle";
+  int status = -1;
+
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+  fs::current_path(directory);
+
+  if (!write_sparse_file(large_path))
+  {
+    std::cerr << "can't create " << large_path << std::endl;
+    return 1;
+  }
+
+  std::ofstream(small_path, std::ios::binary) << "end";
+
+  /* The small file lands after more than 2^32 bytes of contents. */
+  fb::bundle(bundle_path, std::vector<std::string>{large_path, small_path}, &status);
+  check(status == fb::STATUS::OK, "bundle status");
+  check(fs::file_size(bundle_path) > LARGE_FILE_SIZE, "bundle size");
+
+  {
+    fb::Reader reader(bundle_path);
+    check(reader.get_status() == fb::STATUS::OK && reader.get_file_count() == 2, "reader status");
+
+    std::int64_t large = reader.find(large_path);
+    std::int64_t small = reader.find(small_path);
+    check(large >= 0 && small >= 0, "reader find");
+
+    if (large >= 0 && small >= 0)
+    {
+      check(reader.get_size(large) == LARGE_FILE_SIZE, "reader size");
+      check(reader.get_offset(small) > (1ULL << 32), "reader offset past 4 GiB");
+      check_marks("reader", [&](std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size) { return reader.read(large, p_offset, p_address, p_size); });
+
+      fb::File contents = reader.read(small, &status);
+      check(status == fb::STATUS::OK && contents.get_bytes() == std::vector<std::uint8_t>{'e', 'n', 'd'}, "reader small file");
+    }
+  }
+
+  /* The bundle is removed first, so the test never needs room for more than two copies of the large file. */
+  fb::debundle(bundle_path, "output", &status);
+  check(status == fb::STATUS::OK, "debundle status");
+  fs::remove(bundle_path);
+  fs::remove(large_path);
+
+  fs::path extracted = fs::path("output") / large_path;
+  std::error_code error;
+  check(fs::file_size(extracted, error) == LARGE_FILE_SIZE && !error, "extracted size");
+  check(fs::file_size(fs::path("output") / small_path, error) == 3 && !error, "extracted small file");
+
+  {
+    fb::_::Disk_Stream stream(extracted.string(), std::ios::in | std::ios::binary);
+    check(stream.is_open(), "open extracted file");
+    check_marks("extracted", [&](std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size) { return stream.read_at(p_offset, p_address, p_size); });
+  }
+
+  fs::current_path(directory.parent_path());
+  fs::remove_all(directory);
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
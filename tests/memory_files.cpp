@@ -0,0 +1,182 @@
+/* Extraction into sealed memory files (debundle_to_memory_files(), extract_memory_file()): contents match, the
+ * seals are in place and every way of changing the contents (writing, resizing, a writable mapping, removing the
+ * seals) is refused. Broken bundles and bad indices give no files.
+ * Takes the directory to work in as its argument, the current one by default.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+#ifdef MFD_ALLOW_SEALING
+/* Reads all of p_descriptor from the start. */
+static std::vector<std::uint8_t> read_all(int p_descriptor, std::uint64_t p_size)
+{
+  std::vector<std::uint8_t> bytes(p_size);
+  std::uint64_t done = 0;
+
+  while (done < p_size)
+  {
+    auto size = ::pread(p_descriptor, bytes.data() + done, p_size - done, done);
+
+    if (size <= 0)
+    {
+      return {};
+    }
+
+    done += size;
+  }
+
+  return bytes;
+}
+
+static void check_sealed(const fb::Memory_File& p_file, const fb::File& p_original)
+{
+  const std::string what = "\"" + p_original.get_path() + "\"";
+  int descriptor = p_file.get_descriptor();
+  std::uint8_t byte = 0;
+
+  check(descriptor >= 0 && p_file.get_path() == p_original.get_path() && p_file.get_size() == p_original.get_size(), what + ": extracted");
+  check(read_all(descriptor, p_file.get_size()) == p_original.get_bytes(), what + ": contents");
+  check((::fcntl(descriptor, F_GETFD) & FD_CLOEXEC) != 0, what + ": close-on-exec");
+
+  int seals = ::fcntl(descriptor, F_GET_SEALS);
+  const int required = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL;
+  check(seals >= 0 && (seals & required) == required, what + ": sealed");
+
+  /* Seal violations. */
+  check(::pwrite(descriptor, &byte, 1, 0) < 0 && errno == EPERM, what + ": writing is refused");
+  check(::ftruncate(descriptor, p_file.get_size() + 1) < 0 && errno == EPERM, what + ": growing is refused");
+  check(p_file.get_size() == 0 || (::ftruncate(descriptor, 0) < 0 && errno == EPERM), what + ": shrinking is refused");
+  check(::fcntl(descriptor, F_ADD_SEALS, F_SEAL_WRITE) < 0 && errno == EPERM, what + ": seals can't be changed");
+
+  if (p_file.get_size() != 0)
+  {
+    void* mapping = ::mmap(nullptr, p_file.get_size(), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    check(mapping == MAP_FAILED, what + ": a writable shared mapping is refused");
+
+    if (mapping != MAP_FAILED)
+    {
+      ::munmap(mapping, p_file.get_size());
+    }
+
+    mapping = ::mmap(nullptr, p_file.get_size(), PROT_READ, MAP_SHARED, descriptor, 0);
+    check(mapping != MAP_FAILED && std::memcmp(mapping, p_original.get_bytes().data(), p_file.get_size()) == 0, what + ": read-only mapping");
+
+    if (mapping != MAP_FAILED)
+    {
+      ::munmap(mapping, p_file.get_size());
+    }
+  }
+
+  /* Opened again by its path, as dlopen() would. */
+  int reopened = ::open(p_file.get_descriptor_path().c_str(), O_RDONLY | O_CLOEXEC);
+  check(reopened >= 0 && read_all(reopened, p_file.get_size()) == p_original.get_bytes(), what + ": reopened by path");
+
+  if (reopened >= 0)
+  {
+    ::close(reopened);
+  }
+}
+#endif
+
+int main(int p_argc, char** p_argv)
+{
+#ifdef MFD_ALLOW_SEALING
+  fs::path directory = fs::absolute(fs::path(p_argc > 1 ? p_argv[1] : ".") / "memory_files_test");
+  std::string bundle_path = (directory / "test.bundle").string();
+  std::vector<fb::File> files;
+  int status = -1;
+
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+
+  for (std::uint64_t size : {100000, 4096, 1, 0})
+  {
+    std::vector<std::uint8_t> bytes(size);
+
+    for (std::uint64_t i = 0; i < size; i++)
+    {
+      bytes[i] = static_cast<std::uint8_t>(i * 13 + size);
+    }
+
+    files.emplace_back("dir/file" + std::to_string(files.size()), std::move(bytes));
+  }
+
+  fb::bundle(bundle_path, files, &status);
+  check(status == fb::STATUS::OK, "bundle");
+
+  /* Every file, from a bundle on disk. */
+  {
+    auto memory_files = fb::debundle_to_memory_files(bundle_path, &status);
+    check(status == fb::STATUS::OK && memory_files.size() == files.size(), "debundle to memory files");
+
+    for (std::uint64_t i = 0; i < memory_files.size() && i < files.size(); i++)
+    {
+      check_sealed(memory_files[i], files[i]);
+    }
+
+    /* Descriptors move with their files, and released ones are left open. */
+    fb::Memory_File moved = std::move(memory_files[0]);
+    check(memory_files[0].get_descriptor() == -1 && moved.get_descriptor() >= 0, "moved");
+
+    int released = moved.release();
+    check(moved.get_descriptor() == -1 && ::fcntl(released, F_GETFD) >= 0, "released");
+    ::close(released);
+  }
+
+  /* One file, from a bundle in memory, executable. */
+  {
+    fb::File package = fb::bundle(files, &status);
+    fb::Memory_Reader reader(package.get_bytes().data(), package.get_bytes().size());
+    fb::Memory_File file;
+
+    check(fb::extract_memory_file(reader, 1, file, true) == fb::STATUS::OK, "extract executable");
+    check_sealed(file, files[1]);
+
+    check(fb::extract_memory_file(reader, files.size(), file) == fb::STATUS::OUT_OF_RANGE && file.get_descriptor() == -1, "missing entry");
+  }
+
+  /* Broken and missing bundles give no files. */
+  {
+    fs::resize_file(bundle_path, fs::file_size(bundle_path) - 1000);
+    auto memory_files = fb::debundle_to_memory_files(bundle_path, &status);
+    check(status != fb::STATUS::OK && memory_files.empty(), "truncated bundle");
+
+    memory_files = fb::debundle_to_memory_files((directory / "missing.bundle").string(), &status);
+    check(status != fb::STATUS::OK && memory_files.empty(), "missing bundle");
+  }
+
+  fs::remove_all(directory);
+#else
+  static_cast<void>(p_argc);
+  static_cast<void>(p_argv);
+  std::cout << "memfd sealing not available, skipped" << std::endl;
+#endif
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
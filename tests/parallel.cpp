@@ -0,0 +1,315 @@
+/* Parallel bundling and extraction: _::plan_tasks() has to cover every byte of every file exactly once, splitting
+ * large files into ranges, _::Scheduler has to run every task exactly once on any number of workers, and a bundle
+ * written by several threads has to match the single threaded one byte for byte, returned size included.
+ * Takes the directory to work in as its argument, the current one by default.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+/* Checks that p_tasks cover files p_sizes exactly once: whole files through p_order, split ones through ranges. */
+static void check_plan(const std::string& p_what, const std::vector<std::uint64_t>& p_sizes, std::uint64_t p_node_count, bool p_split)
+{
+  std::vector<std::uint64_t> order;
+  std::vector<fb::_::Task> tasks;
+  std::vector<std::uint64_t> covered(p_sizes.size(), 0);
+  std::vector<std::uint64_t> whole(p_sizes.size(), 0);
+  std::vector<std::uint64_t> next_offset(p_sizes.size(), 0);
+  bool ordered = true;
+  bool in_range = true;
+  bool contiguous = true;
+
+  fb::_::plan_tasks(p_sizes, p_node_count, p_split, order, tasks);
+  check(order.size() == p_sizes.size(), p_what + ": order lists every file");
+
+  for (const auto& task : tasks)
+  {
+    in_range = in_range && task.node < p_node_count;
+
+    if (task.count == 0)
+    {
+      /* Ranges of a file come in order, each starting where the previous one ended. */
+      contiguous = contiguous && task.file < p_sizes.size() && task.offset == next_offset[task.file] && task.size != 0;
+      in_range = in_range && task.size <= fb::_::PARALLEL_RANGE_SIZE;
+
+      if (task.file < p_sizes.size())
+      {
+        next_offset[task.file] = task.offset + task.size;
+        covered[task.file] += task.size;
+      }
+
+      continue;
+    }
+
+    for (std::uint64_t i = task.first; i < task.first + task.count; i++)
+    {
+      in_range = in_range && i < order.size() && order[i] < p_sizes.size();
+
+      if (i < order.size() && order[i] < p_sizes.size())
+      {
+        whole[order[i]]++;
+        covered[order[i]] += p_sizes[order[i]];
+      }
+    }
+  }
+
+  for (std::uint64_t i = 1; i < order.size(); i++)
+  {
+    /* Largest first within a node's files; nodes get contiguous runs of the bundle, so only compare within one. */
+    ordered = ordered && (p_node_count != 1 || p_sizes[order[i - 1]] >= p_sizes[order[i]]);
+  }
+
+  check(in_range, p_what + ": tasks stay in range");
+  check(contiguous, p_what + ": ranges are contiguous");
+  check(ordered, p_what + ": files are ordered largest first");
+
+  for (std::uint64_t i = 0; i < p_sizes.size(); i++)
+  {
+    bool split = p_split && p_sizes[i] > 2 * fb::_::PARALLEL_RANGE_SIZE;
+
+    check(covered[i] == p_sizes[i], p_what + ": file " + std::to_string(i) + " is covered exactly once");
+    check(whole[i] == (split ? 0 : 1), p_what + ": file " + std::to_string(i) + (split ? " is only split" : " is listed once"));
+    check(!split || next_offset[i] == p_sizes[i], p_what + ": file " + std::to_string(i) + " ranges reach its end");
+  }
+}
+
+static bool write_sparse_file(const std::string& p_path, std::uint64_t p_size)
+{
+  int descriptor = ::open(p_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool written = descriptor >= 0 && ::ftruncate(descriptor, p_size) == 0;
+
+  /* A mark in every range, so a range written to the wrong place shows. */
+  for (std::uint64_t offset = 0; offset + sizeof(offset) <= p_size; offset += fb::_::PARALLEL_RANGE_SIZE / 3)
+  {
+    written = written && ::pwrite(descriptor, &offset, sizeof(offset), offset) == sizeof(offset);
+  }
+
+  if (descriptor >= 0)
+  {
+    ::close(descriptor);
+  }
+
+  return written;
+}
+
+static bool same_contents(const std::string& p_left, const std::string& p_right)
+{
+  fb::_::Disk_Stream left(p_left, std::ios::in | std::ios::binary);
+  fb::_::Disk_Stream right(p_right, std::ios::in | std::ios::binary);
+  std::vector<std::uint8_t> left_chunk(1 << 20);
+  std::vector<std::uint8_t> right_chunk(1 << 20);
+
+  if (!left.is_open() || !right.is_open() || left.get_size() != right.get_size())
+  {
+    return false;
+  }
+
+  for (std::uint64_t offset = 0; offset < left.get_size(); offset += left_chunk.size())
+  {
+    auto size = std::min<std::uint64_t>(left_chunk.size(), left.get_size() - offset);
+
+    if (left.read_at(offset, left_chunk.data(), size) != fb::STATUS::OK || right.read_at(offset, right_chunk.data(), size) != fb::STATUS::OK ||
+        !std::equal(left_chunk.begin(), left_chunk.begin() + size, right_chunk.begin()))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int main(int p_argc, char** p_argv)
+{
+  fs::path directory = fs::absolute(fs::path(p_argc > 1 ? p_argv[1] : ".") / "parallel_test");
+  int status = -1;
+
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+
+  /* Planning alone, with sizes around every threshold. */
+  {
+    const std::uint64_t range = fb::_::PARALLEL_RANGE_SIZE;
+    const std::uint64_t batch = fb::_::PARALLEL_BATCH_SIZE;
+    std::vector<std::uint64_t> sizes = {0, 1, 4096, batch - fb::_::FILE_COST - 1, batch, 2 * range, 2 * range + 1, 5 * range + 12345, 3, 0, range, 7 * batch};
+
+    for (std::uint64_t i = 0; i < 500; i++)
+    {
+      sizes.push_back((i * 7919) % (64 << 10));
+    }
+
+    for (std::uint64_t node_count : {1, 2, 3})
+    {
+      check_plan("split on " + std::to_string(node_count) + " nodes", sizes, node_count, true);
+      check_plan("unsplit on " + std::to_string(node_count) + " nodes", sizes, node_count, false);
+    }
+
+    check_plan("no files", {}, 1, true);
+  }
+
+  /* Every task runs once, on any number of workers, and a task returning false stops the rest. */
+  {
+    for (std::uint64_t worker_count : {1, 2, 4, 16})
+    {
+      const std::uint64_t task_count = 1000;
+      std::vector<std::atomic<std::uint64_t>> runs(task_count);
+      std::atomic<bool> worker_in_range{true};
+      fb::_::Scheduler scheduler;
+
+      scheduler.run(task_count, worker_count, [&](std::uint64_t p_task, std::uint64_t p_worker)
+      {
+        runs[p_task]++;
+        worker_in_range = worker_in_range && p_worker < worker_count;
+        return true;
+      });
+
+      bool once = true;
+
+      for (auto& count : runs)
+      {
+        once = once && count == 1;
+      }
+
+      check(once, std::to_string(worker_count) + " workers run every task once");
+      check(worker_in_range && scheduler.get_worker_count() <= worker_count, std::to_string(worker_count) + " workers stay in range");
+    }
+
+    /* One worker takes its tasks in order, so the stop is exact. */
+    std::uint64_t run_count = 0;
+    fb::_::Scheduler scheduler;
+    scheduler.run(1000, 1, [&](std::uint64_t p_task, std::uint64_t) { run_count++; return p_task != 9; });
+    check(run_count == 10, "returning false stops the workers");
+  }
+
+  /* Same bundle from one thread and from several, in memory. */
+  {
+    std::vector<fb::File> files;
+
+    for (std::uint64_t i = 0; i < 300; i++)
+    {
+      std::vector<std::uint8_t> bytes((i * 104729) % (3 << 20));
+
+      for (std::uint64_t j = 0; j < bytes.size(); j++)
+      {
+        bytes[j] = static_cast<std::uint8_t>(i * 31 + j);
+      }
+
+      files.emplace_back("dir" + std::to_string(i % 7) + "/file" + std::to_string(i), std::move(bytes));
+    }
+
+    for (bool index : {false, true})
+    {
+      fb::Options sequential;
+      fb::Options parallel;
+      sequential.thread_count = 1;
+      sequential.index = index;
+      parallel.thread_count = 4;
+      parallel.index = index;
+
+      std::string what = index ? "indexed " : "";
+      fb::File sequential_package = fb::bundle(files, &status, sequential);
+      check(status == fb::STATUS::OK, what + "sequential bundle to memory");
+      fb::File parallel_package = fb::bundle(files, &status, parallel);
+      check(status == fb::STATUS::OK, what + "parallel bundle to memory");
+
+      check(sequential_package.get_bytes() == parallel_package.get_bytes(), what + "bundles to memory match");
+      check(sequential_package.get_size() == parallel_package.get_size() && sequential_package.get_size() == sequential_package.get_bytes().size(),
+        what + "bundles to memory report the same size");
+
+      std::string sequential_path = (directory / "sequential.bundle").string();
+      std::string parallel_path = (directory / "parallel.bundle").string();
+      auto sequential_file = fb::bundle(sequential_path, files, &status, sequential);
+      check(status == fb::STATUS::OK, what + "sequential bundle to disk");
+      auto parallel_file = fb::bundle(parallel_path, files, &status, parallel);
+      check(status == fb::STATUS::OK, what + "parallel bundle to disk");
+
+      check(same_contents(sequential_path, parallel_path), what + "bundles to disk match");
+      check(sequential_file.get_size() == parallel_file.get_size() && parallel_file.get_size() == fs::file_size(parallel_path), what + "bundles to disk report the same size");
+
+      auto debundled_files = fb::debundle(parallel_path, (directory / "output").string(), &status, parallel);
+      check(status == fb::STATUS::OK && debundled_files.size() == files.size(), what + "parallel debundle");
+      bool extracted = true;
+
+      for (const auto& file : files)
+      {
+        fb::_::Disk_Stream stream((directory / "output" / file.get_path()).string(), std::ios::in | std::ios::binary);
+        std::vector<std::uint8_t> bytes(stream.get_size());
+        extracted = extracted && stream.get_size() == file.get_size() && stream.read_at(0, bytes.data(), bytes.size()) == fb::STATUS::OK && bytes == file.get_bytes();
+      }
+
+      check(extracted, what + "parallel debundle contents");
+      fs::remove_all(directory / "output");
+
+      /* Appended to an existing file, the parallel bundle has to land after what was there, not on top of it. */
+      std::string appended_path = (directory / "appended.bundle").string();
+      std::vector<std::uint8_t> prefix(1000, 0xab);
+      bool appended = false;
+
+      {
+        fb::_::Disk_Stream stream(appended_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        appended = stream.write(prefix.data(), prefix.size()) == fb::STATUS::OK;
+      }
+
+      {
+        fb::_::Disk_Stream stream(appended_path, std::ios::out | std::ios::binary | std::ios::app);
+        auto package = fb::bundle(stream, files, true, &status, parallel);
+        appended = appended && status == fb::STATUS::OK && package.get_size() == parallel_package.get_size();
+      }
+
+      fb::_::Disk_Stream stream(appended_path, std::ios::in | std::ios::binary);
+      std::vector<std::uint8_t> bytes(stream.get_size());
+      appended = appended && bytes.size() == prefix.size() + parallel_package.get_size() && stream.read_at(0, bytes.data(), bytes.size()) == fb::STATUS::OK &&
+                 std::equal(prefix.begin(), prefix.end(), bytes.begin()) && std::equal(bytes.begin() + prefix.size(), bytes.end(), parallel_package.get_bytes().begin());
+      check(appended, what + "parallel bundle appended to a file");
+    }
+  }
+
+  /* A file large enough to be split into ranges, bundled from disk. */
+  {
+    std::string large_path = (directory / "large.bin").string();
+    std::string small_path = (directory / "small.bin").string();
+    check(write_sparse_file(large_path, 2 * fb::_::PARALLEL_RANGE_SIZE + 4097) && write_sparse_file(small_path, 1000), "create input files");
+
+    fb::Options sequential;
+    fb::Options parallel;
+    sequential.thread_count = 1;
+    parallel.thread_count = 3;
+
+    std::string sequential_path = (directory / "sequential.bundle").string();
+    std::string parallel_path = (directory / "parallel.bundle").string();
+    auto sequential_file = fb::bundle(sequential_path, std::vector<std::string>{large_path, small_path}, &status, sequential);
+    check(status == fb::STATUS::OK, "sequential bundle of a split file");
+    auto parallel_file = fb::bundle(parallel_path, std::vector<std::string>{large_path, small_path}, &status, parallel);
+    check(status == fb::STATUS::OK, "parallel bundle of a split file");
+
+    check(same_contents(sequential_path, parallel_path), "bundles of a split file match");
+    check(sequential_file.get_size() == parallel_file.get_size() && parallel_file.get_size() == fs::file_size(parallel_path), "bundles of a split file report the same size");
+  }
+
+  fs::remove_all(directory);
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/* Extraction of bundles whose paths try to leave the output directory: "..", absolute and drive letter paths must
+ * reject the whole bundle before anything is written, and symlinks planted inside the output directory must not
+ * redirect a write to where they point.
+ * Takes the directory to work in as its argument, the current one by default.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+static std::vector<std::uint8_t> to_bytes(const std::string& p_text)
+{
+  return std::vector<std::uint8_t>(p_text.begin(), p_text.end());
+}
+
+static std::string read_text(const fs::path& p_path)
+{
+  std::ifstream stream(p_path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+/* Number of entries below p_directory, 0 if it doesn't exist. */
+static std::uint64_t count_entries(const fs::path& p_directory)
+{
+  std::error_code error;
+  std::uint64_t count = 0;
+
+  for (auto entry = fs::recursive_directory_iterator(p_directory, error); !error && entry != fs::recursive_directory_iterator(); entry.increment(error))
+  {
+    count++;
+  }
+
+  return count;
+}
+
+int main(int p_argc, char** p_argv)
+{
+  fs::path directory = fs::absolute(fs::path(p_argc > 1 ? p_argv[1] : ".") / "paths_test");
+  fs::path outside = directory / "outside";
+  fs::path output = directory / "output";
+  int status = -1;
+
+  fs::remove_all(directory);
+  fs::create_directories(outside);
+
+  /* Each of these rejects the bundle it is in, even behind a harmless entry. */
+  const std::vector<std::string> unsafe_paths =
+  {
+    "../escaped", "a/../../escaped", "a/b/../../../escaped", "..\\escaped", "/tmp/escaped", "\\escaped", "C:escaped", "C:\\escaped", "", ".", "a/.."
+  };
+
+  for (const auto& unsafe_path : unsafe_paths)
+  {
+    std::vector<fb::File> files;
+    files.emplace_back("safe.txt", to_bytes("safe"));
+    files.emplace_back(unsafe_path, to_bytes("escaped"));
+
+    fb::File package = fb::bundle(files, &status);
+    check(status == fb::STATUS::OK, "bundle \"" + unsafe_path + "\"");
+
+    std::string output_path = (output / "nested").string();
+    auto debundled_files = fb::debundle(package, output_path, &status);
+    check(status == fb::STATUS::UNSAFE_PATH && debundled_files.empty(), "\"" + unsafe_path + "\" is rejected");
+    check(count_entries(output) == 0 && count_entries(outside) == 0 && !fs::exists(directory / "escaped"), "\"" + unsafe_path + "\" writes nothing");
+
+    /* Extracting to memory keeps the path as it is, nothing is created from it. */
+    debundled_files = fb::debundle(package, &status);
+    check(status == fb::STATUS::OK && debundled_files.size() == 2 && debundled_files[1].get_path() == unsafe_path, "\"" + unsafe_path + "\" to memory");
+
+    fs::remove_all(output);
+  }
+
+  /* Components that stay inside are normalised away. */
+  {
+    std::vector<fb::File> files;
+    files.emplace_back("./a//b/./c.txt", to_bytes("c"));
+    files.emplace_back("a\\d.txt", to_bytes("d"));
+
+    fb::File package = fb::bundle(files, &status);
+    fb::debundle(package, output.string(), &status);
+    check(status == fb::STATUS::OK, "normalised paths status");
+    check(read_text(output / "a" / "b" / "c.txt") == "c" && read_text(output / "a" / "d.txt") == "d", "normalised paths contents");
+    fs::remove_all(output);
+  }
+
+#ifdef FILE_BUNDLER_POSIX
+  /* A symlinked directory inside the output directory, pointing outside of it. */
+  {
+    fs::create_directories(output);
+    fs::create_directory_symlink(outside, output / "link");
+
+    std::vector<fb::File> files;
+    files.emplace_back("link/planted.txt", to_bytes("planted"));
+
+    fb::File package = fb::bundle(files, &status);
+    fb::debundle(package, output.string(), &status);
+    check(status != fb::STATUS::OK, "symlinked directory fails");
+    check(count_entries(outside) == 0, "symlinked directory writes nothing outside");
+    fs::remove_all(output);
+  }
+
+  /* A symlink in place of the file itself, pointing at a file outside. */
+  {
+    std::ofstream(outside / "target.txt", std::ios::binary) << "target";
+    fs::create_directories(output);
+    fs::create_symlink(outside / "target.txt", output / "file.txt");
+
+    std::vector<fb::File> files;
+    files.emplace_back("file.txt", to_bytes("overwritten"));
+
+    fb::File package = fb::bundle(files, &status);
+    fb::debundle(package, output.string(), &status);
+    check(status != fb::STATUS::OK, "symlinked file fails");
+    check(read_text(outside / "target.txt") == "target", "symlinked file leaves its target alone");
+    fs::remove_all(output);
+  }
+#endif
+
+  fs::remove_all(directory);
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,381 @@
+/* Bundles read through range requests (Remote_Reader, Http_Reader): first through a stand-in transport over a
+ * bundle in memory, which counts requests and can be made to fail, then through Http_Transport against a small
+ * HTTP server on the loopback interface, which can also answer wrongly: closing part way through the body,
+ * with a Content-Range other than the one asked for, or without a partial response at all.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+/* Transport over a bundle in memory, one read_at() per request as with a real one. */
+class Memory_Transport
+{
+  private:
+  const std::vector<std::uint8_t>* bytes = nullptr;
+
+  public:
+  std::atomic<std::uint64_t> request_count{0};
+  std::atomic<bool> failing{false};
+
+  std::uint64_t get_size()
+  {
+    return this->bytes->size();
+  }
+
+  int read_at(std::uint64_t p_offset, std::uint8_t* p_address, std::uint64_t p_size)
+  {
+    this->request_count++;
+
+    if (this->failing)
+    {
+      return fb::STATUS::IO_ERROR;
+    }
+
+    if (p_offset > this->bytes->size() || p_size > this->bytes->size() - p_offset)
+    {
+      return fb::STATUS::TRUNCATED;
+    }
+
+    std::memcpy(p_address, this->bytes->data() + p_offset, p_size);
+    return fb::STATUS::OK;
+  }
+
+  Memory_Transport(const std::vector<std::uint8_t>* p_bytes) : bytes(p_bytes) {}
+};
+
+/* Ways the server answers a range request. */
+enum class ANSWER
+{
+  PARTIAL,      // 206 with the requested range.
+  CLOSE_EARLY,  // 206 with the requested range, closed half way through the body.
+  SHORT_RANGE,  // 206 with a range one byte shorter than requested, as servers cutting large requests do.
+  WRONG_RANGE,  // 206 with a Content-Range one byte further along.
+  WHOLE_FILE    // 200 with the whole file, as servers without range support do.
+};
+
+/* Serves one file over HTTP/1.1 range requests on 127.0.0.1, one connection at a time. */
+class Http_Server
+{
+  private:
+  const std::vector<std::uint8_t>* bytes = nullptr;
+  int listener = -1;
+  std::uint16_t port = 0;
+  std::thread thread;
+
+  static void send_all(int p_connection, const void* p_address, std::uint64_t p_size)
+  {
+    auto address = static_cast<const char*>(p_address);
+
+    while (p_size != 0)
+    {
+      auto sent = ::send(p_connection, address, p_size, MSG_NOSIGNAL);
+
+      if (sent <= 0)
+      {
+        return;
+      }
+
+      address += sent;
+      p_size -= sent;
+    }
+  }
+
+  void serve(int p_connection)
+  {
+    std::string request;
+    char buffer[4096];
+
+    while (request.find("\r\n\r\n") == std::string::npos)
+    {
+      auto received = ::recv(p_connection, buffer, sizeof(buffer), 0);
+
+      if (received <= 0)
+      {
+        return;
+      }
+
+      request.append(buffer, received);
+    }
+
+    const std::uint64_t size = this->bytes->size();
+    auto range = request.find("Range: bytes=");
+    std::uint64_t first = 0;
+    std::uint64_t last = size - 1;
+
+    if (range != std::string::npos)
+    {
+      char* end = nullptr;
+      first = std::strtoull(request.c_str() + range + 13, &end, 10);
+      last = std::min<std::uint64_t>(std::strtoull(end + 1, nullptr, 10), size - 1);
+    }
+
+    ANSWER current = this->answer;
+    std::string headers;
+    std::uint64_t body_size = last - first + 1;
+
+    if (current == ANSWER::WHOLE_FILE)
+    {
+      first = 0;
+      body_size = size;
+      headers = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(size) + "\r\n";
+    }
+    else
+    {
+      std::uint64_t shift = current == ANSWER::WRONG_RANGE ? 1 : 0;
+
+      if (current == ANSWER::SHORT_RANGE && last > first)
+      {
+        last--;
+        body_size--;
+      }
+
+      headers = "HTTP/1.1 206 Partial Content\r\nContent-Length: " + std::to_string(body_size) + "\r\nContent-Range: bytes " +
+                std::to_string(first + shift) + '-' + std::to_string(last + shift) + '/' + std::to_string(size) + "\r\n";
+    }
+
+    headers += "Connection: close\r\n\r\n";
+    send_all(p_connection, headers.data(), headers.size());
+    send_all(p_connection, this->bytes->data() + first, current == ANSWER::CLOSE_EARLY ? body_size / 2 : body_size);
+  }
+
+  public:
+  std::atomic<ANSWER> answer{ANSWER::PARTIAL};
+  std::atomic<std::uint64_t> request_count{0};
+
+  std::uint16_t get_port()
+  {
+    return this->port;
+  }
+
+  Http_Server(const std::vector<std::uint8_t>* p_bytes) : bytes(p_bytes)
+  {
+    sockaddr_in address = {};
+    socklen_t address_size = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    this->listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (this->listener < 0 || ::bind(this->listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(this->listener, SOMAXCONN) != 0 || ::getsockname(this->listener, reinterpret_cast<sockaddr*>(&address), &address_size) != 0)
+    {
+      return;
+    }
+
+    this->port = ntohs(address.sin_port);
+
+    this->thread = std::thread([this]
+    {
+      int connection = -1;
+
+      while ( (connection = ::accept(this->listener, nullptr, nullptr)) >= 0 )
+      {
+        this->request_count++;
+        serve(connection);
+        ::close(connection);
+      }
+    });
+  }
+
+  ~Http_Server()
+  {
+    if (this->listener >= 0)
+    {
+      ::shutdown(this->listener, SHUT_RDWR);
+    }
+
+    if (this->thread.joinable())
+    {
+      this->thread.join();
+    }
+
+    if (this->listener >= 0)
+    {
+      ::close(this->listener);
+    }
+  }
+};
+
+/* Reads every file of p_files through p_reader, in pieces of p_piece_size bytes. */
+template <typename Reader>
+static bool read_files(Reader& p_reader, const std::vector<fb::File>& p_files, std::uint64_t p_piece_size)
+{
+  for (std::uint64_t i = 0; i < p_files.size(); i++)
+  {
+    std::vector<std::uint8_t> bytes(p_files[i].get_size());
+
+    for (std::uint64_t offset = 0; offset < bytes.size(); offset += p_piece_size)
+    {
+      auto size = std::min(p_piece_size, bytes.size() - offset);
+
+      if (p_reader.read(i, offset, bytes.data() + offset, size) != fb::STATUS::OK)
+      {
+        return false;
+      }
+    }
+
+    if (p_reader.get_path(i) != p_files[i].get_path() || bytes != p_files[i].get_bytes())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int main()
+{
+  std::vector<fb::File> files;
+  int status = -1;
+
+  for (std::uint64_t i = 0; i < 40; i++)
+  {
+    std::vector<std::uint8_t> bytes(i == 0 ? 3 << 20 : i * 5000);
+
+    for (std::uint64_t j = 0; j < bytes.size(); j++)
+    {
+      bytes[j] = static_cast<std::uint8_t>(i * 11 + j * 3);
+    }
+
+    files.emplace_back("dir/file" + std::to_string(i), std::move(bytes));
+  }
+
+  fb::File package = fb::bundle(files, &status);
+  const std::vector<std::uint8_t>& bundle_bytes = package.get_bytes();
+  check(status == fb::STATUS::OK, "bundle");
+
+  /* A stand-in transport. */
+  {
+    fb::Remote_Reader<Memory_Transport> reader(&bundle_bytes);
+    auto& stream = reader.get_source();
+
+    check(reader.get_status() == fb::STATUS::OK && reader.get_file_count() == files.size(), "open");
+    check(stream.get_fetched_bytes() < bundle_bytes.size() / 4, "opening fetches the metadata, not the files");
+
+    /* One small entry costs a request or two, not the bundle. */
+    std::uint64_t requests = stream.get_request_count();
+    std::uint64_t fetched = stream.get_fetched_bytes();
+    std::vector<std::uint8_t> bytes(files[5].get_size());
+    check(reader.read(5, 0, bytes.data(), bytes.size()) == fb::STATUS::OK && bytes == files[5].get_bytes(), "read one entry");
+    check(stream.get_request_count() - requests <= 2 && stream.get_fetched_bytes() - fetched <= bytes.size() + 2 * fb::_::REMOTE_BLOCK_SIZE,
+          "one entry fetches about its own size");
+
+    /* Again from the cache. */
+    requests = stream.get_request_count();
+    check(reader.read(5, 0, bytes.data(), bytes.size()) == fb::STATUS::OK && stream.get_request_count() == requests, "cached entry");
+
+    /* Everything, from several threads at once: no block is fetched twice while the cache holds them all. */
+    std::vector<std::thread> threads;
+    std::atomic<std::uint64_t> good{0};
+
+    for (int thread = 0; thread < 6; thread++)
+    {
+      threads.emplace_back([&, thread] { good += read_files(reader, files, 1000 + thread * 777) ? 1 : 0; });
+    }
+
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+
+    check(good == threads.size(), "concurrent reads");
+    check(stream.get_fetched_bytes() <= bundle_bytes.size(), "blocks are fetched once");
+    check(stream.get_transport().request_count == stream.get_request_count(), "one transport read per request");
+
+    /* A cache much smaller than the entries read through it. */
+    stream.set_cache_size(4096, 16384);
+    check(read_files(reader, files, 1 << 20), "small cache");
+
+    /* Failed requests reach the reader and aren't cached: the next read asks again. */
+    stream.set_cache_size(fb::_::REMOTE_BLOCK_SIZE, fb::_::REMOTE_CACHE_SIZE);
+    stream.get_transport().failing = true;
+    check(reader.read(0, 0, bytes.data(), 1000) == fb::STATUS::IO_ERROR, "failed request");
+    stream.get_transport().failing = false;
+    check(reader.read(0, 0, bytes.data(), 1000) == fb::STATUS::OK && std::equal(bytes.begin(), bytes.begin() + 1000, files[0].get_bytes().begin()), "retried request");
+
+    /* Reads past the end never reach the transport. */
+    requests = stream.get_request_count();
+    check(stream.read_at(bundle_bytes.size() - 1, bytes.data(), 2) == fb::STATUS::TRUNCATED && stream.get_request_count() == requests, "read past the end");
+  }
+
+  /* HTTP. */
+  {
+    Http_Server server(&bundle_bytes);
+    check(server.get_port() != 0, "server");
+
+    fb::Http_Reader reader("127.0.0.1", server.get_port(), "/test.bundle");
+    auto& stream = reader.get_source();
+    check(stream.get_transport().is_open() && stream.get_size() == bundle_bytes.size(), "http open");
+    check(reader.get_status() == fb::STATUS::OK && reader.get_file_count() == files.size(), "http parse");
+    check(read_files(reader, files, 300000), "http reads");
+    check(server.request_count == stream.get_request_count() + 1, "http requests are counted");
+
+    /* Wrong answers; each read goes to the server as the cache is dropped first. */
+    std::vector<std::uint8_t> bytes(files[0].get_size());
+
+    server.answer = ANSWER::CLOSE_EARLY;
+    stream.set_cache_size(fb::_::REMOTE_BLOCK_SIZE, fb::_::REMOTE_CACHE_SIZE);
+    check(reader.read(0, 0, bytes.data(), bytes.size()) == fb::STATUS::TRUNCATED, "connection closed early");
+
+    server.answer = ANSWER::SHORT_RANGE;
+    stream.set_cache_size(fb::_::REMOTE_BLOCK_SIZE, fb::_::REMOTE_CACHE_SIZE);
+    check(reader.read(0, 0, bytes.data(), bytes.size()) == fb::STATUS::IO_ERROR, "short range");
+
+    server.answer = ANSWER::WRONG_RANGE;
+    stream.set_cache_size(fb::_::REMOTE_BLOCK_SIZE, fb::_::REMOTE_CACHE_SIZE);
+    check(reader.read(0, 0, bytes.data(), bytes.size()) == fb::STATUS::IO_ERROR, "shifted range");
+
+    server.answer = ANSWER::WHOLE_FILE;
+    stream.set_cache_size(fb::_::REMOTE_BLOCK_SIZE, fb::_::REMOTE_CACHE_SIZE);
+    check(reader.read(0, 0, bytes.data(), bytes.size()) == fb::STATUS::IO_ERROR, "no partial response");
+
+    /* A server without range support can't be opened at all. */
+    fb::Http_Reader whole_reader("127.0.0.1", server.get_port(), "/test.bundle");
+    check(!whole_reader.get_source().get_transport().is_open() && whole_reader.get_status() != fb::STATUS::OK, "server without ranges");
+
+    server.answer = ANSWER::PARTIAL;
+    stream.set_cache_size(fb::_::REMOTE_BLOCK_SIZE, fb::_::REMOTE_CACHE_SIZE);
+    check(read_files(reader, files, 1 << 20), "http reads after errors");
+  }
+
+  /* Nobody listening. */
+  {
+    std::uint16_t port = 0;
+
+    {
+      Http_Server server(&bundle_bytes);
+      port = server.get_port();
+    }
+
+    fb::Http_Reader reader("127.0.0.1", port, "/test.bundle");
+    check(!reader.get_source().get_transport().is_open() && reader.get_status() != fb::STATUS::OK, "no server");
+  }
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+/* send_entry() over a socketpair and a pipe, from every kind of reader: sendfile() from a bundle on disk,
+ * straight from memory for memory and mapped bundles, through a buffer for chunk stores. Covers ranges,
+ * non-blocking sockets, bad indices and ranges, and a peer that hangs up part way.
+ * Takes the directory to work in as its argument, the current one by default.
+ */
+
+#include <csignal>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+namespace fs = std::filesystem;
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+/* Reads p_descriptor until the other end is closed. */
+static std::vector<std::uint8_t> receive_all(int p_descriptor)
+{
+  std::vector<std::uint8_t> bytes;
+  std::uint8_t buffer[64 << 10];
+
+  while (true)
+  {
+    auto size = ::read(p_descriptor, buffer, sizeof(buffer));
+
+    if (size < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (size <= 0)
+    {
+      return bytes;
+    }
+
+    bytes.insert(bytes.end(), buffer, buffer + size);
+  }
+}
+
+/* Sends the p_range part of the file at p_index through a fresh socketpair (a pipe with p_pipe), returns what arrived. */
+template <typename Reader>
+static std::vector<std::uint8_t> send_through(Reader& p_reader, std::uint64_t p_index, fb::Range p_range, bool p_pipe, bool p_non_blocking, int& p_status,
+                                              std::uint64_t& p_sent)
+{
+  int descriptors[2] = {-1, -1};
+  bool opened = p_pipe ? ::pipe(descriptors) == 0 : ::socketpair(AF_UNIX, SOCK_STREAM, 0, descriptors) == 0;
+  std::vector<std::uint8_t> received;
+
+  if (!opened)
+  {
+    p_status = -1;
+    return received;
+  }
+
+  /* Pipes read from [0] and write to [1]; either end of a socketpair does both. */
+  int output = descriptors[1];
+  int input = descriptors[0];
+
+  if (p_non_blocking)
+  {
+    ::fcntl(output, F_SETFL, ::fcntl(output, F_GETFL) | O_NONBLOCK);
+  }
+
+  std::thread receiver([&] { received = receive_all(input); });
+  p_status = fb::send_entry(p_reader, p_index, output, p_range, &p_sent);
+  ::close(output);
+  receiver.join();
+  ::close(input);
+  return received;
+}
+
+template <typename Reader>
+static void check_reader(const std::string& p_what, Reader& p_reader, const std::vector<fb::File>& p_files)
+{
+  int status = -1;
+  std::uint64_t sent = 0;
+
+  check(p_reader.get_status() == fb::STATUS::OK, p_what + ": open");
+
+  for (bool pipe : {false, true})
+  {
+    for (bool non_blocking : {false, true})
+    {
+      std::string what = p_what + (pipe ? " to a pipe" : " to a socket") + (non_blocking ? ", non-blocking" : "");
+
+      for (std::uint64_t i = 0; i < p_files.size(); i++)
+      {
+        auto& bytes = p_files[i].get_bytes();
+        auto received = send_through(p_reader, i, fb::Range(), pipe, non_blocking, status, sent);
+        check(status == fb::STATUS::OK && sent == bytes.size() && received == bytes, what + ": file " + std::to_string(i));
+      }
+
+      /* Part of the largest file, and a range running past its end, which stops at the end. */
+      auto& bytes = p_files[0].get_bytes();
+      auto received = send_through(p_reader, 0, {12345, 300000}, pipe, non_blocking, status, sent);
+      check(status == fb::STATUS::OK && sent == 300000 && received == std::vector<std::uint8_t>(bytes.begin() + 12345, bytes.begin() + 312345), what + ": range");
+
+      received = send_through(p_reader, 0, {bytes.size() - 10, 1000}, pipe, non_blocking, status, sent);
+      check(status == fb::STATUS::OK && sent == 10 && received == std::vector<std::uint8_t>(bytes.end() - 10, bytes.end()), what + ": range past the end");
+    }
+  }
+
+  /* Nothing is sent for entries and ranges that don't exist. */
+  auto received = send_through(p_reader, p_files.size(), fb::Range(), false, false, status, sent);
+  check(status == fb::STATUS::OUT_OF_RANGE && sent == 0 && received.empty(), p_what + ": missing entry");
+
+  received = send_through(p_reader, 0, {p_files[0].get_size() + 1, 1}, false, false, status, sent);
+  check(status == fb::STATUS::OUT_OF_RANGE && sent == 0 && received.empty(), p_what + ": range past the end of the file");
+
+  received = send_through(p_reader, 0, {p_files[0].get_size(), 1}, false, false, status, sent);
+  check(status == fb::STATUS::OK && sent == 0 && received.empty(), p_what + ": empty range at the end of the file");
+
+  /* The peer hangs up before the file is through: an error, with what made it out counted. */
+  int descriptors[2] = {-1, -1};
+  check(::socketpair(AF_UNIX, SOCK_STREAM, 0, descriptors) == 0, p_what + ": socketpair");
+  ::close(descriptors[0]);
+  status = fb::send_entry(p_reader, 0, descriptors[1], fb::Range(), &sent);
+  check(status == fb::STATUS::IO_ERROR && sent < p_files[0].get_size(), p_what + ": peer gone");
+  ::close(descriptors[1]);
+
+  /* Not a descriptor at all. */
+  status = fb::send_entry(p_reader, 0, -1, fb::Range(), &sent);
+  check(status == fb::STATUS::IO_ERROR && sent == 0, p_what + ": bad descriptor");
+}
+
+int main(int p_argc, char** p_argv)
+{
+  fs::path directory = fs::absolute(fs::path(p_argc > 1 ? p_argv[1] : ".") / "send_entry_test");
+  std::string bundle_path = (directory / "test.bundle").string();
+  std::string chunked_path = (directory / "chunked.bundle").string();
+  std::vector<fb::File> files;
+  int status = -1;
+
+  /* Writes to a socket whose peer has gone raise SIGPIPE, see send_entry(). */
+  std::signal(SIGPIPE, SIG_IGN);
+
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+
+  /* Larger than a socket buffer first, then small and empty ones. */
+  for (std::uint64_t size : {3 << 20, 70000, 1, 0})
+  {
+    std::vector<std::uint8_t> bytes(size);
+
+    for (std::uint64_t i = 0; i < size; i++)
+    {
+      bytes[i] = static_cast<std::uint8_t>(i * 7 + size);
+    }
+
+    files.emplace_back("file" + std::to_string(files.size()), std::move(bytes));
+  }
+
+  fb::bundle(bundle_path, files, &status);
+  check(status == fb::STATUS::OK, "bundle");
+
+  {
+    fb::Reader reader(bundle_path);
+    check_reader("Reader", reader, files);
+  }
+
+  {
+    fb::Mapped_Reader reader(bundle_path);
+    check_reader("Mapped_Reader", reader, files);
+  }
+
+  {
+    fb::File package = fb::bundle(files, &status);
+    fb::Memory_Reader reader(package.get_bytes().data(), package.get_bytes().size());
+    check_reader("Memory_Reader", reader, files);
+  }
+
+  {
+    fb::Options options;
+    options.chunk_store = (directory / "store").string();
+    fb::bundle(chunked_path, files, &status, options);
+    check(status == fb::STATUS::OK, "bundle into a chunk store");
+
+    fb::Reader reader(chunked_path);
+    reader.set_chunk_store(options.chunk_store);
+    check_reader("Reader of a chunk store bundle", reader, files);
+  }
+
+  fs::remove_all(directory);
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
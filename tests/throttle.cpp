@@ -0,0 +1,170 @@
+/* Pacing of Options::bytes_per_second and Options::operations_per_second: a run may not move more than its budget
+ * allows, from any number of threads, and shouldn't take much longer than the budget demands either.
+ * Also checks that runs with Options::nice and Options::io_priority, which happen on a thread of their own,
+ * report their results and errors as if they ran on the calling thread.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_bundler.h"
+
+namespace fb = file_bundler;
+
+static int failures = 0;
+
+static void check(bool p_condition, const std::string& p_what)
+{
+  if (!p_condition)
+  {
+    std::cerr << "FAILED: " << p_what << std::endl;
+    failures++;
+  }
+}
+
+template <typename Function>
+static double time_call(Function p_function)
+{
+  auto start = std::chrono::steady_clock::now();
+  p_function();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* The budget allows its burst up front, then its rate. Slow machines (and sanitizers) may take longer, never shorter. */
+static void check_pace(const std::string& p_what, double p_seconds, double p_amount, double p_rate)
+{
+  double expected = p_amount / p_rate - fb::_::THROTTLE_BURST;
+
+  std::cout << p_what << ": " << p_seconds << " s, " << expected << " s expected" << std::endl;
+  check(p_seconds >= expected * 0.95, p_what + " is not faster than its budget");
+  check(p_seconds <= expected * 2 + 0.5, p_what + " is not much slower than its budget");
+}
+
+int main()
+{
+  /* Bytes from one thread, in chunks larger than the burst. */
+  {
+    fb::Options options;
+    options.bytes_per_second = 8 << 20;
+    fb::_::Throttle throttle(options);
+
+    check(throttle.get() == &throttle, "a byte rate throttles");
+    double seconds = time_call([&] { for (int i = 0; i < 6; i++) throttle.acquire(2 << 20); });
+    check_pace("12 MiB at 8 MiB/s from one thread", seconds, 12 << 20, 8 << 20);
+  }
+
+  /* Bytes from four threads share the one budget. */
+  {
+    fb::Options options;
+    options.bytes_per_second = 16 << 20;
+    fb::_::Throttle throttle(options);
+    std::vector<std::thread> threads;
+
+    double seconds = time_call([&]
+    {
+      for (int thread = 0; thread < 4; thread++)
+      {
+        threads.emplace_back([&] { for (int i = 0; i < 32; i++) throttle.acquire(64 << 10); });
+      }
+
+      for (auto& thread : threads)
+      {
+        thread.join();
+      }
+    });
+
+    check_pace("8 MiB at 16 MiB/s from four threads", seconds, 8 << 20, 16 << 20);
+  }
+
+  /* Operations, whatever their size. */
+  {
+    fb::Options options;
+    options.operations_per_second = 200;
+    fb::_::Throttle throttle(options);
+
+    double seconds = time_call([&] { for (int i = 0; i < 120; i++) throttle.acquire(i % 2 == 0 ? 0 : 1 << 20); });
+    check_pace("120 operations at 200/s", seconds, 120, 200);
+  }
+
+  /* No budget, no throttle. */
+  {
+    fb::Options options;
+    fb::_::Throttle throttle(options);
+    check(throttle.get() == nullptr, "no budget doesn't throttle");
+  }
+
+  /* A whole bundle and debundle run. */
+  {
+    std::vector<fb::File> files;
+    int status = -1;
+
+    for (int i = 0; i < 8; i++)
+    {
+      files.emplace_back("file" + std::to_string(i), std::vector<std::uint8_t>(512 << 10, static_cast<std::uint8_t>(i)));
+    }
+
+    fb::Options options;
+    options.bytes_per_second = 16 << 20;
+    options.chunk_size = 256 << 10;
+    options.thread_count = 2;
+
+    fb::File package;
+    double seconds = time_call([&] { package = fb::bundle(files, &status, options); });
+    check(status == fb::STATUS::OK, "throttled bundle");
+    check_pace("bundle of 4 MiB at 16 MiB/s", seconds, 4 << 20, 16 << 20);
+
+    std::vector<fb::File> debundled_files;
+    seconds = time_call([&] { debundled_files = fb::debundle(package, &status, options); });
+    check(status == fb::STATUS::OK && debundled_files.size() == files.size() && debundled_files[7].get_bytes() == files[7].get_bytes(), "throttled debundle");
+    check_pace("debundle of 4 MiB at 16 MiB/s", seconds, 4 << 20, 16 << 20);
+  }
+
+  /* Prioritised runs happen on their own thread, with both priorities cleared for the run itself. */
+  {
+    fb::Options options;
+    options.nice = 5;
+    options.io_priority = fb::IO_PRIORITY::IDLE;
+
+    if (fb::_::has_priority(options))
+    {
+      std::thread::id caller = std::this_thread::get_id();
+      std::thread::id runner;
+
+      int result = fb::_::run_prioritized(options, [&](const fb::Options& p_options)
+      {
+        runner = std::this_thread::get_id();
+        return p_options.nice == 0 && p_options.io_priority == fb::IO_PRIORITY::UNCHANGED ? 42 : 0;
+      });
+
+      check(result == 42 && runner != caller, "prioritised run");
+
+      /* Exceptions (e.g. std::bad_alloc) reach the caller instead of terminating the process. */
+      bool caught = false;
+
+      try
+      {
+        fb::_::run_prioritized(options, [](const fb::Options&) -> int { throw std::runtime_error("thrown by the run"); });
+      }
+      catch (const std::runtime_error& p_error)
+      {
+        caught = std::string(p_error.what()) == "thrown by the run";
+      }
+
+      check(caught, "exceptions of a prioritised run are rethrown on the calling thread");
+
+      std::vector<fb::File> files;
+      int status = -1;
+      files.emplace_back("file", std::vector<std::uint8_t>{1, 2, 3});
+      fb::File package = fb::bundle(files, &status, options);
+      check(status == fb::STATUS::OK && fb::debundle(package, &status, options).size() == 1 && status == fb::STATUS::OK, "prioritised bundle and debundle");
+    }
+  }
+
+  std::cout << (failures == 0 ? "ok" : "failed") << std::endl;
+  return failures == 0 ? 0 : 1;
+}